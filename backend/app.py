@@ -1,5 +1,6 @@
 ﻿from flask import Flask, request, jsonify, send_from_directory # type: ignore
 from flask_cors import CORS  # type: ignore
+from flask_sock import Sock  # type: ignore
 from flask import render_template  # type: ignore
 from pathlib import Path
 from datetime import datetime
@@ -8,15 +9,21 @@ import os
 import time
 from db import init_db, insert_reading, get_recent, get_history, prune_old, insert_event, get_events, get_latest
 from config import load_config
-from security import NonceCache, verify_signature
+from diag import HealthStore, TimingStore
+from firmware_store import FirmwareStore
+from node_config import NodeConfigStore
+from security import NonceCache, may_report_for, verify_signature
 from status_engine import StatusEngine
-from ingest_utils import normalize_reading
+from ingest_utils import expand_telemetry, normalize_reading
+from wire_format import decode_msgpack, is_msgpack
+from ws_uplink import format_reply, header, parse_frame, upgrade_headers
 
 BASE_DIR = Path(__file__).resolve().parent
 FRONTEND_DIR = BASE_DIR.parent / "frontend"
 STATIC_DIR = FRONTEND_DIR / "static"
 
 app = Flask(__name__, static_folder=str(STATIC_DIR), static_url_path="/static")
+SOCK = Sock(app)
 CORS(app, resources={r"/api/*": {"origins": [r"http://127\\.0\\.0\\.1:\\d+", r"http://localhost:\\d+","http://127.0.0.1","http://localhost"]}})
 init_db()
 APP_CONFIG = load_config()
@@ -35,6 +42,17 @@ last_ingest_snapshot = {
     "server_received_utc": None,
 }
 TELEMETRY_LOG_PATH = BASE_DIR / "telemetry_log.jsonl"
+# Per-stage firmware latency histograms from telemetry "diag" blocks.
+TIMING = TimingStore()
+# Latest watchdog / recovery state per node from telemetry "health" blocks.
+HEALTH = HealthStore()
+# Sampling parameters pushed to nodes in telemetry responses (node_config.py).
+NODE_CONFIG = NodeConfigStore(os.getenv("NODE_CONFIG_PATH", str(BASE_DIR / "node_config.json")))
+# OTA images offered the same way (firmware_store.py).
+FIRMWARE = FirmwareStore(os.getenv("FIRMWARE_DIR", str(BASE_DIR / "firmware")))
+# A WebSocket uplink idle this long is closed so a dead node does not pin a
+# worker thread; the firmware reconnects on its next send.
+WS_IDLE_TIMEOUT_SEC = int(os.getenv("WS_IDLE_TIMEOUT_SEC", "300"))
 
 @app.get("/api/health")
 def health():
@@ -42,7 +60,8 @@ def health():
 
 @app.get("/api/time")
 def time_endpoint():
-    return jsonify({"epoch": int(time.time())})
+    now = time.time()
+    return jsonify({"epoch": int(now), "epoch_ms": int(now * 1000)})
 
 @app.post("/api/ingest")
 def ingest():
@@ -110,26 +129,46 @@ def ingest():
     }
     return jsonify(payload)
 
-@app.post("/api/telemetry")
-def telemetry():
+def _json_body(body_bytes, content_type):
+    mimetype = (content_type or "").split(";", 1)[0].strip().lower()
+    if mimetype != "application/json" and not mimetype.endswith("+json"):
+        return None
+    try:
+        return json.loads(body_bytes)
+    except ValueError:
+        return None
+
+def check_api_key(headers):
+    """Returns (error, status) for a bad X-API-Key, else None."""
     expected_key = os.getenv("ESP32_API_KEY")
     if not expected_key:
-        return jsonify({"error": "ESP32_API_KEY not set on server"}), 500
-    if request.headers.get("X-API-Key") != expected_key:
-        return jsonify({"error": "Unauthorized"}), 401
-
-    body_bytes = request.get_data()
-    sig_result = verify_signature(dict(request.headers), body_bytes, APP_CONFIG.security, NONCE_CACHE)
+        return {"error": "ESP32_API_KEY not set on server"}, 500
+    if header(headers, "X-API-Key") != expected_key:
+        return {"error": "Unauthorized"}, 401
+    return None
+
+def process_telemetry(headers, body_bytes, content_type):
+    """Validates and stores one signed telemetry body; shared by the HTTP
+    endpoint and the WebSocket uplink. Returns (response, status)."""
+    key_error = check_api_key(headers)
+    if key_error:
+        return key_error
+
+    sig_result = verify_signature(headers, body_bytes, APP_CONFIG.security, NONCE_CACHE)
     if not sig_result.ok:
-        return jsonify({"error": sig_result.error}), 401
+        return {"error": sig_result.error}, 401
 
-    payload = request.get_json(silent=True)
+    if is_msgpack(content_type):
+        payload, decode_error = decode_msgpack(body_bytes)
+        if decode_error:
+            return {"error": decode_error}, 400
+    else:
+        payload = _json_body(body_bytes, content_type)
     if not isinstance(payload, dict):
-        return jsonify({"error": "JSON body required"}), 400
+        return {"error": "JSON body required"}, 400
 
     device_id = payload.get("device_id")
     node_id = payload.get("node_id")
-    data = payload.get("data")
     ts_in = payload.get("timestamp") or payload.get("ts")
 
     if isinstance(device_id, str) and device_id.strip():
@@ -137,7 +176,9 @@ def telemetry():
     elif isinstance(node_id, str) and node_id.strip():
         node_id = node_id.strip()
     else:
-        return jsonify({"error": "device_id or node_id required"}), 400
+        return {"error": "device_id or node_id required"}, 400
+    if not may_report_for(APP_CONFIG.security, sig_result.node_id, node_id):
+        return {"error": f"{sig_result.node_id} may not report for {node_id}"}, 403
 
     if sig_result.timestamp:
         server_ts = int(sig_result.timestamp)
@@ -145,26 +186,92 @@ def telemetry():
         server_ts = int(ts_in)
     else:
         server_ts = int(time.time())
-    ts_iso = datetime.utcfromtimestamp(server_ts).replace(microsecond=0).isoformat() + "Z"
 
-    if not isinstance(data, dict):
-        data = payload
+    items, batch_error = expand_telemetry(
+        payload,
+        server_ts,
+        APP_CONFIG.ingest.max_batch_readings,
+        int(time.time()) + APP_CONFIG.security.sig_window_sec,
+    )
+    if batch_error:
+        return {"error": batch_error}, 400
 
     fields = GROUND_FIELDS if node_id.startswith("ground") else WATER_FIELDS
-    reading, flags = normalize_reading(node_id, data, ts_iso, fields, APP_CONFIG)
-    insert_reading(reading)
-    prune_old()
-
-    record = {
-        "device_id": node_id,
-        "timestamp": server_ts,
-        "data": data,
-        "server_received_utc": datetime.utcnow().isoformat() + "Z",
-    }
+    received_utc = datetime.utcnow().isoformat() + "Z"
+    flags = {}
+    ts_iso = None
     with open(TELEMETRY_LOG_PATH, "a", encoding="utf-8") as handle:
-        handle.write(json.dumps(record) + "\n")
+        for item_ts, data in items:
+            ts_iso = datetime.utcfromtimestamp(item_ts).replace(microsecond=0).isoformat() + "Z"
+            reading, flags = normalize_reading(node_id, data, ts_iso, fields, APP_CONFIG)
+            insert_reading(reading)
+            record = {
+                "device_id": node_id,
+                "timestamp": item_ts,
+                "data": data,
+                "server_received_utc": received_utc,
+            }
+            handle.write(json.dumps(record) + "\n")
+    prune_old()
+    if "diag" in payload and not TIMING.add(node_id, payload["diag"]):
+        app.logger.info(f"TELEMETRY ignored malformed diag block from {node_id}")
+    if "health" in payload and not HEALTH.add(node_id, payload["health"]):
+        app.logger.info(f"TELEMETRY ignored malformed health block from {node_id}")
+
+    response = {"ok": True, "node_id": node_id, "ts": ts_iso, "count": len(items), "flags": flags}
+    offer = NODE_CONFIG.offer(
+        sig_result.node_id,
+        header(headers, "X-Config-Version"),
+        APP_CONFIG.security.hmac_secrets.get(sig_result.node_id),
+    )
+    if offer:
+        response["config"] = offer
+    update = FIRMWARE.offer(
+        sig_result.node_id,
+        header(headers, "X-Firmware-Version"),
+        APP_CONFIG.security.hmac_secrets.get(sig_result.node_id),
+        sig_result.nonce,
+    )
+    if update:
+        response["ota"] = update
+    return response, 200
 
-    return jsonify({"ok": True, "node_id": node_id, "ts": ts_iso, "flags": flags})
+@app.post("/api/telemetry")
+def telemetry():
+    response, status = process_telemetry(dict(request.headers), request.get_data(), request.content_type)
+    return jsonify(response), status
+
+@app.get("/api/firmware/<name>")
+def firmware_image(name):
+    # Only images the manifest offers; the signed digest in the offer is what
+    # makes a download trustworthy, the API key just keeps scrapers out.
+    key_error = check_api_key(request.headers)
+    if key_error:
+        return jsonify(key_error[0]), key_error[1]
+    if not FIRMWARE.has_image(name):
+        return jsonify({"error": "Unknown image"}), 404
+    return send_from_directory(FIRMWARE.directory, name, mimetype="application/octet-stream")
+
+@SOCK.route("/api/telemetry/ws")
+def telemetry_ws(ws):
+    # One long-lived connection per node: authenticate the upgrade once, then
+    # every frame is a signed body answered in order.
+    base = upgrade_headers(dict(request.headers))
+    key_error = check_api_key(base)
+    if key_error:
+        ws.send(format_reply(key_error[1], key_error[0]))
+        return
+    while True:
+        frame = ws.receive(timeout=WS_IDLE_TIMEOUT_SEC)
+        if frame is None:  # idle timeout
+            ws.close()
+            return
+        sig_headers, body, frame_error = parse_frame(frame)
+        if frame_error:
+            ws.send(format_reply(400, {"error": frame_error}))
+            continue
+        response, status = process_telemetry({**base, **sig_headers}, body, base["Content-Type"])
+        ws.send(format_reply(status, response))
 
 @app.get("/api/recent")
 def recent():
@@ -328,7 +435,15 @@ def latest_one(node_id):
 
 @app.get("/api/debug/last_ingest")
 def debug_last_ingest():
-    return jsonify(last_ingest_snapshot)
+    return jsonify({**last_ingest_snapshot, "timing": TIMING.summary()})
+
+@app.get("/api/debug/timing")
+def debug_timing():
+    return jsonify(TIMING.summary())
+
+@app.get("/api/debug/health")
+def debug_health():
+    return jsonify(HEALTH.summary())
 
 @app.get("/")
 def index():
@@ -1,9 +1,9 @@
 from __future__ import annotations
 
-from dataclasses import dataclass
+from dataclasses import dataclass, field
 import json
 import os
-from typing import Dict, Set
+from typing import Dict, FrozenSet, Set
 
 
 @dataclass(frozen=True)
@@ -11,6 +11,8 @@ class SecurityConfig:
     hmac_secrets: Dict[str, str]
     sig_window_sec: int = 300
     nonce_ttl_sec: int = 600
+    # gateway node -> leaf nodes it may upload for (ESP-NOW aggregation)
+    gateways: Dict[str, FrozenSet[str]] = field(default_factory=dict)
 
 
 @dataclass(frozen=True)
@@ -26,11 +28,17 @@ class StatusConfig:
     hysteresis_sec: int = 60
 
 
+@dataclass(frozen=True)
+class IngestConfig:
+    max_batch_readings: int = 100
+
+
 @dataclass(frozen=True)
 class AppConfig:
     security: SecurityConfig
     behavior: NodeBehaviorConfig
     status: StatusConfig
+    ingest: IngestConfig = field(default_factory=IngestConfig)
 
 
 def _parse_hmac_secrets(raw: str) -> Dict[str, str]:
@@ -54,8 +62,30 @@ def _parse_hmac_secrets(raw: str) -> Dict[str, str]:
     return result
 
 
+def _parse_gateways(raw: str) -> Dict[str, FrozenSet[str]]:
+    if not raw:
+        return {}
+    try:
+        data = json.loads(raw)
+        if isinstance(data, dict):
+            return {str(k): frozenset(str(v) for v in leaves) for k, leaves in data.items()
+                    if isinstance(leaves, list)}
+    except json.JSONDecodeError:
+        pass
+    # allow simple "gateway=leaf1|leaf2,gateway2=leaf3" form
+    result: Dict[str, FrozenSet[str]] = {}
+    for pair in raw.split(","):
+        if "=" in pair:
+            k, v = pair.split("=", 1)
+            leaves = frozenset(leaf.strip() for leaf in v.split("|") if leaf.strip())
+            if k.strip() and leaves:
+                result[k.strip()] = leaves
+    return result
+
+
 def load_config() -> AppConfig:
     hmac_raw = os.getenv("TELEMETRY_HMAC_SECRETS", "")
+    gateways_raw = os.getenv("TELEMETRY_GATEWAYS", "")
     sig_window = int(os.getenv("TELEMETRY_SIG_WINDOW_SEC", "300"))
     nonce_ttl = int(os.getenv("TELEMETRY_NONCE_TTL_SEC", "600"))
     disable_pm25 = {s.strip() for s in os.getenv("DISABLE_PM25_NODES", "").split(",") if s.strip()}
@@ -63,12 +93,14 @@ def load_config() -> AppConfig:
     pm25_flag = os.getenv("PM25_FLAG_NAME", "pm25_forced_normal")
     recompute_interval = int(os.getenv("STATUS_RECOMPUTE_SEC", "30"))
     hysteresis = int(os.getenv("STATUS_HYSTERESIS_SEC", "60"))
+    max_batch = int(os.getenv("TELEMETRY_MAX_BATCH", "100"))
 
     return AppConfig(
         security=SecurityConfig(
             hmac_secrets=_parse_hmac_secrets(hmac_raw),
             sig_window_sec=sig_window,
             nonce_ttl_sec=nonce_ttl,
+            gateways=_parse_gateways(gateways_raw),
         ),
         behavior=NodeBehaviorConfig(
             disable_pm25_nodes=disable_pm25,
@@ -79,4 +111,7 @@ def load_config() -> AppConfig:
             recompute_interval_sec=recompute_interval,
             hysteresis_sec=hysteresis,
         ),
+        ingest=IngestConfig(
+            max_batch_readings=max_batch,
+        ),
     )
@@ -0,0 +1,131 @@
+"""Aggregate the per-stage timing histograms nodes attach as "diag".
+
+Each block carries bucket upper edges (microseconds, last bucket open),
+per-stage bucket counts and per-stage maxima. Blocks are deltas: the node
+clears what it has reported, so they are summed here.
+
+Nodes attach a "health" block alongside (last reset reason, uptime, the task
+and stage a watchdog reset caught, failure and recovery counters). Those are
+snapshots, so only the latest one per node is kept.
+"""
+from __future__ import annotations
+
+import threading
+from datetime import datetime
+from typing import Dict, List, Optional, Sequence
+
+
+def percentile(counts: Sequence[int], edges: Sequence[float], q: float, max_us: float) -> Optional[float]:
+    """Approximate q-quantile (0..1), interpolating linearly inside a bucket."""
+    total = sum(counts)
+    if total == 0:
+        return None
+    rank = q * total
+    seen = 0
+    for i, c in enumerate(counts):
+        if c and seen + c >= rank:
+            lower = edges[i - 1] if i > 0 else 0.0
+            upper = edges[i] if i < len(edges) else max(max_us, lower)
+            upper = min(upper, max_us) if max_us else upper
+            frac = (rank - seen) / c
+            return lower + frac * max(upper - lower, 0.0)
+        seen += c
+    return float(max_us)
+
+
+def _is_int(value) -> bool:
+    return isinstance(value, int) and not isinstance(value, bool)
+
+
+def _is_number(value) -> bool:
+    return isinstance(value, (int, float)) and not isinstance(value, bool)
+
+
+def _valid(diag) -> bool:
+    if not isinstance(diag, dict):
+        return False
+    edges, hist, max_us = diag.get("edges_us"), diag.get("hist"), diag.get("max_us", {})
+    if not isinstance(edges, list) or not isinstance(hist, dict) or not isinstance(max_us, dict):
+        return False
+    if not all(_is_number(e) for e in edges) or not all(_is_number(v) for v in max_us.values()):
+        return False
+    return all(
+        isinstance(v, list) and len(v) == len(edges) + 1 and all(_is_int(c) for c in v) for v in hist.values()
+    )
+
+
+class TimingStore:
+    def __init__(self) -> None:
+        self._lock = threading.Lock()
+        self._nodes: Dict[str, Dict] = {}
+
+    def add(self, node_id: str, diag) -> bool:
+        if not _valid(diag):
+            return False
+        edges = [float(e) for e in diag["edges_us"]]
+        max_us = diag.get("max_us", {})
+        with self._lock:
+            node = self._nodes.get(node_id)
+            if node is None or node["edges_us"] != edges:
+                node = {"edges_us": edges, "hist": {}, "max_us": {}}
+                self._nodes[node_id] = node
+            for stage, counts in diag["hist"].items():
+                acc = node["hist"].setdefault(stage, [0] * len(counts))
+                node["hist"][stage] = [a + int(c) for a, c in zip(acc, counts)]
+                node["max_us"][stage] = max(node["max_us"].get(stage, 0), float(max_us.get(stage, 0) or 0))
+            node["updated_utc"] = datetime.utcnow().isoformat() + "Z"
+        return True
+
+    @staticmethod
+    def _summarize(edges: List[float], hist: Dict, max_us: Dict) -> Dict:
+        out = {}
+        for stage, counts in sorted(hist.items()):
+            top = max_us.get(stage, 0)
+            out[stage] = {
+                "count": sum(counts),
+                "p50_us": percentile(counts, edges, 0.50, top),
+                "p99_us": percentile(counts, edges, 0.99, top),
+                "max_us": top,
+            }
+        return out
+
+    def summary(self) -> Dict:
+        with self._lock:
+            nodes = {k: dict(v, hist=dict(v["hist"]), max_us=dict(v["max_us"])) for k, v in self._nodes.items()}
+        result = {"nodes": {}, "fleet": {}}
+        fleet_hist: Dict[str, List[int]] = {}
+        fleet_max: Dict[str, float] = {}
+        fleet_edges = None
+        for node_id, node in nodes.items():
+            result["nodes"][node_id] = {
+                "updated_utc": node.get("updated_utc"),
+                "stages": self._summarize(node["edges_us"], node["hist"], node["max_us"]),
+            }
+            if fleet_edges is None:
+                fleet_edges = node["edges_us"]
+            if node["edges_us"] != fleet_edges:
+                continue  # different firmware bucket layout; reported per node only
+            for stage, counts in node["hist"].items():
+                acc = fleet_hist.setdefault(stage, [0] * len(counts))
+                fleet_hist[stage] = [a + c for a, c in zip(acc, counts)]
+                fleet_max[stage] = max(fleet_max.get(stage, 0), node["max_us"].get(stage, 0))
+        if fleet_edges is not None:
+            result["fleet"] = self._summarize(fleet_edges, fleet_hist, fleet_max)
+        return result
+
+
+class HealthStore:
+    def __init__(self) -> None:
+        self._lock = threading.Lock()
+        self._nodes: Dict[str, Dict] = {}
+
+    def add(self, node_id: str, health) -> bool:
+        if not isinstance(health, dict) or not isinstance(health.get("reset"), str):
+            return False
+        with self._lock:
+            self._nodes[node_id] = dict(health, updated_utc=datetime.utcnow().isoformat() + "Z")
+        return True
+
+    def summary(self) -> Dict:
+        with self._lock:
+            return {"nodes": {k: dict(v) for k, v in self._nodes.items()}}
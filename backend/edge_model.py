@@ -0,0 +1,175 @@
+"""Compile anomaly models into constexpr C++ headers for the firmware.
+
+The node scores each sample with the same model the server applies in
+ai/predict.py, so an anomalous reading can be uploaded immediately instead
+of waiting for the next batch. Two model kinds are supported:
+
+- forest: the trained IsolationForest, trees optionally truncated to
+  max_depth (a truncated branch becomes a leaf whose path length is
+  depth + c(n_samples), exactly as sklearn scores a real leaf).
+- zscore: per-feature median/MAD with a |z| threshold, for nodes without
+  enough history or flash to spare for a forest.
+
+Everything here is pure Python on plain sequences; scripts/export_edge_model.py
+does the loading.
+"""
+from __future__ import annotations
+
+import math
+from typing import Dict, List, Sequence, Tuple
+
+# Server feature name -> firmware EdgeFeature enumerator (edge_scorer.h).
+FIRMWARE_FEATURES: Dict[str, str] = {
+    "radiation_cpm": "EDGE_RADIATION",
+    "pm25": "EDGE_PM25",
+    "air_temp_c": "EDGE_AIR_TEMP",
+    "humidity": "EDGE_HUMIDITY",
+    "pressure_hpa": "EDGE_PRESSURE",
+    "voc": "EDGE_VOC",
+    "tds": "EDGE_TDS",
+    "ph": "EDGE_PH",
+    "turbidity": "EDGE_TURBIDITY",
+    "water_temp_c": "EDGE_WATER_TEMP",
+}
+
+EULER_GAMMA = 0.5772156649015329
+
+# (feature, value, left, right); feature is unused and left/right are -1 on
+# leaves, where value is the path length. Internal nodes go left on x <= value.
+Node = Tuple[int, float, int, int]
+
+
+def average_path_length(n: int) -> float:
+    """c(n): mean depth of an unsuccessful BST search over n points."""
+    if n <= 1:
+        return 0.0
+    if n == 2:
+        return 1.0
+    return 2.0 * (math.log(n - 1) + EULER_GAMMA) - 2.0 * (n - 1) / n
+
+
+def flatten_tree(
+    children_left: Sequence[int],
+    children_right: Sequence[int],
+    feature: Sequence[int],
+    threshold: Sequence[float],
+    n_node_samples: Sequence[int],
+    feature_index: Sequence[int],
+    max_depth: int,
+) -> List[Node]:
+    """Re-number one sklearn tree depth-first from the root, truncated at max_depth.
+
+    feature_index maps the tree's (subsampled) feature columns to the
+    forest's feature order.
+    """
+    nodes: List[Node] = []
+
+    def visit(idx: int, depth: int) -> int:
+        pos = len(nodes)
+        nodes.append((0, 0.0, -1, -1))
+        left, right = children_left[idx], children_right[idx]
+        if left < 0 or depth >= max_depth:
+            nodes[pos] = (0, float(depth + average_path_length(int(n_node_samples[idx]))), -1, -1)
+            return pos
+        l_pos = visit(left, depth + 1)
+        r_pos = visit(right, depth + 1)
+        nodes[pos] = (int(feature_index[feature[idx]]), float(threshold[idx]), l_pos, r_pos)
+        return pos
+
+    visit(0, 0)
+    return nodes
+
+
+def forest_path_length(trees: Sequence[Sequence[Node]], x: Sequence[float]) -> float:
+    """Mean path length of x over the flattened trees (reference for the C++ scorer)."""
+    total = 0.0
+    for nodes in trees:
+        i = 0
+        while nodes[i][2] >= 0:
+            feat, value, left, right = nodes[i]
+            i = left if x[feat] <= value else right
+        total += nodes[i][1]
+    return total / len(trees)
+
+
+def forest_score(trees: Sequence[Sequence[Node]], psi: int, x: Sequence[float]) -> float:
+    """2^(-E[h(x)] / c(psi)); higher is more anomalous (= -score_samples)."""
+    return 2.0 ** (-forest_path_length(trees, x) / average_path_length(psi))
+
+
+def robust_center_scale(values: Sequence[float]) -> Tuple[float, float]:
+    ordered = sorted(values)
+    n = len(ordered)
+    med = ordered[n // 2] if n % 2 else 0.5 * (ordered[n // 2 - 1] + ordered[n // 2])
+    dev = sorted(abs(v - med) for v in ordered)
+    mad = dev[n // 2] if n % 2 else 0.5 * (dev[n // 2 - 1] + dev[n // 2])
+    scale = 1.4826 * mad
+    if scale == 0:
+        mean = sum(ordered) / n
+        scale = math.sqrt(sum((v - mean) ** 2 for v in ordered) / n) or 1e-6
+    return med, scale
+
+
+def _cfloat(v: float) -> str:
+    text = f"{v:.7g}"
+    if not any(c in text for c in ".e"):
+        text += ".0"
+    return text + "f"
+
+
+def _floats(values: Sequence[float]) -> str:
+    return ", ".join(_cfloat(v) for v in values)
+
+
+def render_header(
+    kind: str,
+    features: Sequence[str],
+    threshold: float,
+    source: str,
+    trees: Sequence[Sequence[Node]] = (),
+    psi: int = 0,
+    centers: Sequence[float] = (),
+    scales: Sequence[float] = (),
+) -> str:
+    missing = [f for f in features if f not in FIRMWARE_FEATURES]
+    if missing:
+        raise ValueError(f"No firmware field for feature(s): {', '.join(missing)}")
+    if kind not in ("forest", "zscore"):
+        raise ValueError(f"Unknown model kind {kind!r}")
+
+    lines = [
+        f"// Generated by backend/scripts/export_edge_model.py from {source}; do not edit.",
+        "#pragma once",
+        "",
+        '#include "edge_scorer.h"',
+        "",
+        f"#define EDGE_MODEL_KIND {'EDGE_MODEL_FOREST' if kind == 'forest' else 'EDGE_MODEL_ZSCORE'}",
+        "",
+        "namespace edge_model {",
+        f"constexpr uint8_t FEATURE_COUNT = {len(features)};",
+        f"constexpr EdgeFeature FEATURES[] = {{{', '.join(FIRMWARE_FEATURES[f] for f in features)}}};",
+        f"constexpr float THRESHOLD = {_cfloat(threshold)};",
+    ]
+    if kind == "forest":
+        roots, flat = [], []
+        for nodes in trees:
+            base = len(flat)
+            roots.append(base)
+            flat.extend((f, v, l + base if l >= 0 else -1, r + base if r >= 0 else -1) for f, v, l, r in nodes)
+        if len(flat) > 32767:
+            raise ValueError(f"{len(flat)} nodes do not fit int16 indices; lower --trees or --max-depth")
+        lines += [
+            f"constexpr float PATH_NORM = {_cfloat(average_path_length(psi))}; // c(max_samples)",
+            f"constexpr uint16_t TREE_COUNT = {len(roots)};",
+            f"constexpr uint16_t TREE_ROOTS[] = {{{', '.join(str(r) for r in roots)}}};",
+            "constexpr EdgeNode NODES[] = {",
+        ]
+        lines += [f"    {{{f}, {l}, {r}, {_cfloat(v)}}}," for f, v, l, r in flat]
+        lines.append("};")
+    else:
+        lines += [
+            f"constexpr float CENTER[] = {{{_floats(centers)}}};",
+            f"constexpr float SCALE[] = {{{_floats(scales)}}};",
+        ]
+    lines += ["}  // namespace edge_model", ""]
+    return "\n".join(lines)
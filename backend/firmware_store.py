@@ -0,0 +1,179 @@
+from __future__ import annotations
+
+import hashlib
+import hmac
+import json
+import os
+import threading
+import zlib
+from typing import Dict, List, Optional, Tuple
+
+# Firmware images offered to nodes over the air. FIRMWARE_DIR holds the images
+# and a manifest.json mapping node ids, id prefixes ending in "*" (the longest
+# match wins) or "*" for every node to the image they should run:
+#
+#   {"ground_*": {"version": 7, "file": "air_node-7.bin.zz"},
+#    "water_*": {"version": 7, "file": "water_node-7.bin.zz", "encoding": "zlib"}}
+#
+# "encoding" is "identity" for a raw .bin or "zlib" for a zlib stream
+# (scripts/publish_firmware.py writes these); it defaults from the ".zz"
+# suffix. Nodes send the version they run in X-Firmware-Version and get an
+# offer when it differs. The offer is signed with the node's HMAC secret over
+# the size and SHA-256 of the decompressed image, which the node checks while
+# streaming it to flash.
+#
+# Nodes refuse versions older than the one they run unless the entry sets
+# "downgrade": true; such offers are flagged and their signature also covers
+# the nonce of the request they answer, so they cannot be replayed. Must
+# match firmware/esp32_env_node/src/ota_update.cpp.
+
+ENCODINGS = ("identity", "zlib")
+IMAGE_ROUTE = "/api/firmware/"
+
+
+def sign_offer(
+    secret: str, node_id: str, version: int, size: int, encoding: str, sha256: str, nonce: Optional[str] = None
+) -> str:
+    """`nonce` is given for a downgrade only."""
+    message = f"ota.{node_id}.{version}.{size}.{encoding}.{sha256}"
+    if nonce is not None:
+        message += f".downgrade.{nonce}"
+    return hmac.new(secret.encode("utf-8"), message.encode("utf-8"), hashlib.sha256).hexdigest()
+
+
+def image_digest(path: str, encoding: str) -> Tuple[int, str]:
+    """Size and SHA-256 of the image as it lands in flash."""
+    digest = hashlib.sha256()
+    size = 0
+    inflate = zlib.decompressobj() if encoding == "zlib" else None
+    with open(path, "rb") as handle:
+        for chunk in iter(lambda: handle.read(65536), b""):
+            if inflate:
+                chunk = inflate.decompress(chunk)
+            digest.update(chunk)
+            size += len(chunk)
+    if inflate:
+        if not inflate.eof:
+            raise ValueError("truncated zlib stream")
+        tail = inflate.flush()
+        digest.update(tail)
+        size += len(tail)
+    return size, digest.hexdigest()
+
+
+class FirmwareStore:
+    def __init__(self, directory: str) -> None:
+        self.directory = directory
+        self._mtime: Optional[float] = None
+        self._entries: Dict[str, dict] = {}
+        self._lock = threading.Lock()
+        self.errors: List[str] = []
+
+    def _read(self, path: str) -> Tuple[Dict[str, dict], List[str]]:
+        try:
+            with open(path, "r", encoding="utf-8") as handle:
+                data = json.load(handle)
+        except (OSError, ValueError) as exc:
+            return {}, [f"{path}: {exc}"]
+        if not isinstance(data, dict):
+            return {}, [f"{path}: expected an object of node ids"]
+        entries: Dict[str, dict] = {}
+        errors: List[str] = []
+        for key, raw in data.items():
+            entry, error = self._load_entry(raw)
+            if error:
+                errors.append(f"{key}: {error}")
+            else:
+                entries[str(key)] = entry
+        return entries, errors
+
+    def _reload(self) -> None:
+        # Re-read whenever the manifest changes so a release can be staged
+        # without a restart. Requests run on several threads: one of them
+        # digests the images while the others wait, and the new entries are
+        # swapped in whole before the mtime that marks them current.
+        path = os.path.join(self.directory, "manifest.json")
+        try:
+            mtime: Optional[float] = os.path.getmtime(path)
+        except OSError:
+            mtime = None
+        if mtime == self._mtime:
+            return
+        with self._lock:
+            if mtime == self._mtime:
+                return  # another thread reloaded meanwhile
+            entries, errors = self._read(path) if mtime is not None else ({}, [])
+            self._entries, self.errors = entries, errors
+            self._mtime = mtime
+
+    def _load_entry(self, raw: object) -> Tuple[Optional[dict], Optional[str]]:
+        if not isinstance(raw, dict):
+            return None, "expected an object"
+        version = raw.get("version")
+        name = raw.get("file")
+        if isinstance(version, bool) or not isinstance(version, int) or version <= 0:
+            return None, "version: expected a positive integer"
+        downgrade = raw.get("downgrade", False)
+        if not isinstance(downgrade, bool):
+            return None, "downgrade: expected true or false"
+        if not isinstance(name, str) or not name or os.path.basename(name) != name:
+            return None, "file: expected a file name inside FIRMWARE_DIR"
+        encoding = raw.get("encoding", "zlib" if name.endswith(".zz") else "identity")
+        if encoding not in ENCODINGS:
+            return None, f"encoding: expected one of {', '.join(ENCODINGS)}"
+        try:
+            size, sha256 = image_digest(os.path.join(self.directory, name), encoding)
+        except (OSError, ValueError, zlib.error) as exc:
+            return None, f"file: {exc}"
+        return {
+            "version": version, "file": name, "encoding": encoding, "size": size, "sha256": sha256,
+            "downgrade": downgrade,
+        }, None
+
+    def entry_for(self, node_id: str) -> Optional[dict]:
+        self._reload()
+        entries = self._entries  # replaced, never mutated, by _reload()
+        if node_id in entries:
+            return entries[node_id]
+        best = None
+        for key, entry in entries.items():
+            if key.endswith("*") and node_id.startswith(key[:-1]):
+                if best is None or len(key) > len(best[0]):
+                    best = (key, entry)
+        return best[1] if best else None
+
+    def has_image(self, name: str) -> bool:
+        self._reload()
+        return any(entry["file"] == name for entry in self._entries.values())
+
+    def offer(
+        self, node_id: str, reported_version: Optional[str], secret: Optional[str], nonce: Optional[str] = None
+    ) -> Optional[dict]:
+        """The signed update a node should install, or None if it already runs
+        it (or cannot verify one). `nonce` is the one the answered request was
+        signed with; downgrades need it."""
+        if reported_version is None or not secret:
+            return None
+        entry = self.entry_for(node_id)
+        if not entry or reported_version.strip() == str(entry["version"]):
+            return None
+        try:
+            downgrade = entry["version"] < int(reported_version)
+        except ValueError:
+            return None
+        if downgrade and (not entry["downgrade"] or not nonce):
+            return None
+        offer = {
+            "version": entry["version"],
+            "url": IMAGE_ROUTE + entry["file"],
+            "size": entry["size"],
+            "encoding": entry["encoding"],
+            "sha256": entry["sha256"],
+            "sig": sign_offer(
+                secret, node_id, entry["version"], entry["size"], entry["encoding"], entry["sha256"],
+                nonce if downgrade else None,
+            ),
+        }
+        if downgrade:
+            offer["downgrade"] = True
+        return offer
@@ -1,6 +1,6 @@
 from __future__ import annotations
 
-from typing import Dict, List, Tuple
+from typing import Dict, List, Optional, Tuple
 from datetime import datetime
 
 from config import AppConfig
@@ -27,3 +27,44 @@ def normalize_reading(
         reading["pm25"] = config.behavior.pm25_fallback
         flags[config.behavior.pm25_flag_name] = True
     return reading, flags
+
+
+def expand_telemetry(
+    payload: Dict,
+    fallback_ts: int,
+    max_batch: int,
+    max_future_ts: int,
+) -> Tuple[List[Tuple[int, Dict]], Optional[str]]:
+    """Split a telemetry body into (timestamp, data) pairs.
+
+    Accepts the single-reading form ({"data": {...}}) and the batch form
+    ({"readings": [{"timestamp": ..., "data": {...}}, ...]}) sent by nodes
+    that buffer samples. Batch items keep their own sample timestamp and fall
+    back to the signed request timestamp when it is missing or in the future.
+    """
+    items = payload.get("readings")
+    if items is None:
+        data = payload.get("data")
+        if not isinstance(data, dict):
+            data = payload
+        return [(fallback_ts, data)], None
+
+    if not isinstance(items, list) or not items:
+        return [], "readings must be a non-empty list"
+    if len(items) > max_batch:
+        return [], f"batch too large ({len(items)} > {max_batch})"
+
+    result: List[Tuple[int, Dict]] = []
+    for item in items:
+        if not isinstance(item, dict):
+            return [], "each reading must be an object"
+        data = item.get("data")
+        if not isinstance(data, dict):
+            return [], "each reading needs a data object"
+        ts = item.get("timestamp")
+        if isinstance(ts, (int, float)) and not isinstance(ts, bool) and 0 < ts <= max_future_ts:
+            item_ts = int(ts)
+        else:
+            item_ts = fallback_ts
+        result.append((item_ts, data))
+    return result, None
@@ -0,0 +1,148 @@
+from __future__ import annotations
+
+import hashlib
+import hmac
+import json
+import os
+import threading
+import time
+from typing import Dict, List, Optional, Tuple
+
+# Fleet tuning pushed to nodes in telemetry responses. The file maps node ids
+# (or "*" for every node) to parameter overrides, e.g.
+#
+#   {"*": {"interval_ms": 30000}, "ground_2": {"sensors": ["bme680", "geiger"]}}
+#
+# Each offer is a complete overlay on the firmware's compile-time defaults,
+# so applying one never depends on what the node had before; an empty overlay
+# puts a node back on its defaults. Nodes send the version they run in
+# X-Config-Version and only get an offer when it differs. Versions only ever
+# grow (the time a node's body last changed, see next_version()) and nodes
+# ignore offers that are not newer than what they run, so a captured older
+# offer cannot be replayed. Keys and ranges must match nodeConfigParse() in
+# firmware/esp32_env_node/src/node_config.cpp.
+
+INT_RANGES: Dict[str, Tuple[int, int]] = {
+    "interval_ms": (1000, 3600000),
+    "batch_max": (1, 1000),
+    "batch_max_age_ms": (1000, 3600000),
+    "geiger_window_ms": (1000, 3600000),
+}
+DEADBAND_CHANNELS = ("radiation", "pm25", "water_temp")
+SENSOR_NAMES = ("bme680", "sds011", "geiger", "ds18b20", "water_adc")
+
+
+def validate_params(raw: object) -> Tuple[dict, List[str]]:
+    """Keeps the recognised, in-range parameters; returns them with a list of
+    what was dropped and why."""
+    if not isinstance(raw, dict):
+        return {}, ["overrides must be an object"]
+    params: dict = {}
+    errors: List[str] = []
+    for key, value in raw.items():
+        if key in INT_RANGES:
+            lo, hi = INT_RANGES[key]
+            if isinstance(value, bool) or not isinstance(value, int) or not lo <= value <= hi:
+                errors.append(f"{key}: expected an integer in [{lo}, {hi}]")
+                continue
+            params[key] = value
+        elif key == "deadband":
+            bands = {}
+            for ch, band in (value.items() if isinstance(value, dict) else []):
+                if ch in DEADBAND_CHANNELS and isinstance(band, (int, float)) and not isinstance(band, bool) and band >= 0:
+                    bands[ch] = float(band)
+                else:
+                    errors.append(f"deadband.{ch}: expected a non-negative number")
+            if not isinstance(value, dict):
+                errors.append("deadband: expected an object")
+            if bands:
+                params[key] = bands
+        elif key == "sensors":
+            if not isinstance(value, list) or not all(s in SENSOR_NAMES for s in value):
+                errors.append(f"sensors: expected a list drawn from {', '.join(SENSOR_NAMES)}")
+                continue
+            params[key] = sorted(set(value), key=SENSOR_NAMES.index)
+        else:
+            errors.append(f"{key}: unknown parameter")
+    return params, errors
+
+
+def next_version(previous: int, now: Optional[float] = None) -> int:
+    """Version for a changed body: the current time in seconds, kept above the
+    previous version. A restart re-offers unchanged bodies under a newer
+    version, which nodes simply apply again."""
+    return max(int(time.time() if now is None else now), previous + 1)
+
+
+def sign_config(secret: str, node_id: str, version: int, body: str) -> str:
+    message = f"config.{node_id}.{version}.{body}".encode("utf-8")
+    return hmac.new(secret.encode("utf-8"), message, hashlib.sha256).hexdigest()
+
+
+class NodeConfigStore:
+    def __init__(self, path: str) -> None:
+        self._path = path
+        self._mtime: Optional[float] = None
+        self._overrides: Dict[str, dict] = {}
+        self._versions: Dict[str, Tuple[str, int]] = {}  # node id -> (body, version)
+        self._lock = threading.Lock()
+        self.errors: List[str] = []
+
+    def _read(self) -> Tuple[Dict[str, dict], List[str]]:
+        try:
+            with open(self._path, "r", encoding="utf-8") as handle:
+                data = json.load(handle)
+        except (OSError, ValueError) as exc:
+            return {}, [f"{self._path}: {exc}"]
+        if not isinstance(data, dict):
+            return {}, [f"{self._path}: expected an object of node ids"]
+        overrides: Dict[str, dict] = {}
+        errors: List[str] = []
+        for node_id, raw in data.items():
+            params, param_errors = validate_params(raw)
+            overrides[str(node_id)] = params
+            errors.extend(f"{node_id}.{e}" for e in param_errors)
+        return overrides, errors
+
+    def _reload(self) -> None:
+        # Re-read whenever the file changes so the fleet can be retuned
+        # without a restart. Requests run on several threads: the new state is
+        # built aside and swapped in whole, under the lock.
+        try:
+            mtime: Optional[float] = os.path.getmtime(self._path)
+        except OSError:
+            mtime = None
+        with self._lock:
+            if mtime == self._mtime:
+                return
+            overrides, errors = self._read() if mtime is not None else ({}, [])
+            self._overrides, self.errors, self._mtime = overrides, errors, mtime
+
+    def params_for(self, node_id: str) -> dict:
+        self._reload()
+        with self._lock:
+            merged = dict(self._overrides.get("*", {}))
+            merged.update(self._overrides.get(node_id, {}))
+        return merged
+
+    def version_for(self, node_id: str, body: str) -> int:
+        with self._lock:
+            known = self._versions.get(node_id)
+            if known is None or known[0] != body:
+                known = (body, next_version(known[1] if known else 0))
+                self._versions[node_id] = known
+            return known[1]
+
+    def offer(self, node_id: str, reported_version: Optional[str], secret: Optional[str]) -> Optional[dict]:
+        """The signed config a node should switch to, or None if it already
+        runs it (or cannot verify one)."""
+        if reported_version is None or not secret:
+            return None
+        body = json.dumps(self.params_for(node_id), sort_keys=True, separators=(",", ":"))
+        reported = reported_version.strip()
+        if body == "{}" and reported == "0":
+            return None  # never configured and nothing to push
+        version = self.version_for(node_id, body)
+        if reported == str(version):
+            return None
+        return {"version": version, "body": body, "sig": sign_config(secret, node_id, version, body)}
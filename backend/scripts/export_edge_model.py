@@ -0,0 +1,83 @@
+"""Export the anomaly models as firmware headers (see edge_model.py).
+
+    python scripts/export_edge_model.py                  # forests from ai/*.pkl
+    python scripts/export_edge_model.py --kind zscore    # median/MAD from readings.db
+
+Writes firmware/esp32_env_node/src/edge_model_ground.h and edge_model_water.h.
+"""
+import argparse
+import sys
+from pathlib import Path
+
+BASE_DIR = Path(__file__).resolve().parents[1]
+sys.path.insert(0, str(BASE_DIR))
+sys.path.insert(0, str(BASE_DIR / "scripts"))
+
+from edge_model import flatten_tree, render_header, robust_center_scale  # noqa: E402
+from train_isoforest import AI_DIR, DB_PATH, GROUND_FEATURES, WATER_FEATURES, fetch_rows  # noqa: E402
+
+FIRMWARE_SRC = BASE_DIR.parent / "firmware" / "esp32_env_node" / "src"
+
+PROFILES = {
+    "ground": (["ground_1", "ground_2", "ground_3"], GROUND_FEATURES),
+    "water": (["water_1"], WATER_FEATURES),
+}
+
+
+def export_forest(name, features, trees, max_depth):
+    import joblib
+
+    path = AI_DIR / f"isoforest_{name}.pkl"
+    if not path.exists():
+        print(f"{name}: no model at {path}; run scripts/train_isoforest.py first.")
+        return None
+    model = joblib.load(path)
+    flat = []
+    for est, feats in list(zip(model.estimators_, model.estimators_features_))[:trees]:
+        t = est.tree_
+        flat.append(
+            flatten_tree(t.children_left, t.children_right, t.feature, t.threshold, t.n_node_samples, feats, max_depth)
+        )
+    # sklearn flags x when score_samples(x) < offset_; the firmware score is -score_samples.
+    return render_header(
+        "forest", features, -float(model.offset_), path.name, trees=flat, psi=int(model.max_samples_)
+    )
+
+
+def export_zscore(name, node_ids, features, k):
+    if not DB_PATH.exists():
+        print(f"{name}: database not found at {DB_PATH}.")
+        return None
+    rows = fetch_rows(node_ids, features)
+    if len(rows) < 20:
+        print(f"{name}: not enough rows ({len(rows)}).")
+        return None
+    stats = [robust_center_scale([row[i] for row in rows]) for i in range(len(features))]
+    return render_header(
+        "zscore", features, k, DB_PATH.name, centers=[c for c, _ in stats], scales=[s for _, s in stats]
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--kind", choices=["forest", "zscore"], default="forest")
+    parser.add_argument("--trees", type=int, default=24, help="trees kept from the forest")
+    parser.add_argument("--max-depth", type=int, default=6, help="truncate trees below this depth")
+    parser.add_argument("--z", type=float, default=6.0, help="|z| threshold for --kind zscore")
+    parser.add_argument("--out", type=Path, default=FIRMWARE_SRC)
+    args = parser.parse_args()
+
+    for name, (node_ids, features) in PROFILES.items():
+        if args.kind == "forest":
+            header = export_forest(name, features, args.trees, args.max_depth)
+        else:
+            header = export_zscore(name, node_ids, features, args.z)
+        if header is None:
+            continue
+        out = args.out / f"edge_model_{name}.h"
+        out.write_text(header)
+        print(f"Wrote {out}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,58 @@
+"""Stage a firmware build for OTA (see firmware_store.py).
+
+    cd firmware/esp32_env_node && PLATFORMIO_BUILD_FLAGS=-DFIRMWARE_VERSION=7 pio run -e air_node
+    python scripts/publish_firmware.py ../firmware/esp32_env_node/.pio/build/air_node/firmware.bin \\
+        --version 7 --nodes "ground_*"
+
+Compresses the image into FIRMWARE_DIR (default: backend/firmware) and
+points the manifest entry for --nodes at it. The version must be the
+FIRMWARE_VERSION the image was built with, or nodes will keep being offered
+an update they already run. Rolling nodes back to an older version needs
+--downgrade.
+"""
+import argparse
+import json
+import os
+import sys
+import zlib
+from pathlib import Path
+
+BASE_DIR = Path(__file__).resolve().parents[1]
+sys.path.insert(0, str(BASE_DIR))
+
+from firmware_store import image_digest  # noqa: E402
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("image", type=Path, help="firmware.bin from a PlatformIO build")
+    parser.add_argument("--version", type=int, required=True, help="FIRMWARE_VERSION of the build")
+    parser.add_argument("--nodes", default="*", help='manifest key: a node id, a prefix like "ground_*", or "*"')
+    parser.add_argument("--dir", type=Path, default=Path(os.getenv("FIRMWARE_DIR", BASE_DIR / "firmware")))
+    parser.add_argument("--raw", action="store_true", help="store the image uncompressed")
+    parser.add_argument("--downgrade", action="store_true", help="also offer it to nodes on a newer version")
+    args = parser.parse_args()
+
+    data = args.image.read_bytes()
+    args.dir.mkdir(parents=True, exist_ok=True)
+    stem = args.image.parent.name if args.image.name == "firmware.bin" else args.image.stem
+    name = f"{stem}-{args.version}.bin" if args.raw else f"{stem}-{args.version}.bin.zz"
+    out = args.dir / name
+    out.write_bytes(data if args.raw else zlib.compress(data, 9))
+    size, sha256 = image_digest(str(out), "identity" if args.raw else "zlib")
+    assert size == len(data)
+
+    manifest_path = args.dir / "manifest.json"
+    manifest = json.loads(manifest_path.read_text()) if manifest_path.exists() else {}
+    manifest[args.nodes] = {"version": args.version, "file": name}
+    if args.downgrade:
+        manifest[args.nodes]["downgrade"] = True
+    # Write-then-rename so the backend never reads a half-written manifest.
+    tmp = manifest_path.with_suffix(".tmp")
+    tmp.write_text(json.dumps(manifest, indent=2, sort_keys=True) + "\n")
+    tmp.replace(manifest_path)
+    print(f"Wrote {out} ({out.stat().st_size} of {size} bytes, sha256 {sha256}) for {args.nodes}")
+
+
+if __name__ == "__main__":
+    main()
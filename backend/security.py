@@ -2,6 +2,7 @@ from __future__ import annotations
 
 import hmac
 import hashlib
+import threading
 import time
 from dataclasses import dataclass
 from typing import Dict, Tuple
@@ -22,17 +23,22 @@ class NonceCache:
     def __init__(self, ttl_sec: int) -> None:
         self._ttl = ttl_sec
         self._store: Dict[str, Dict[str, int]] = {}
+        # Requests are served on several threads: the purge must not race an
+        # insert, and check-then-insert must be atomic or a nonce replayed
+        # concurrently passes twice.
+        self._lock = threading.Lock()
 
     def seen(self, node_id: str, nonce: str, now: int) -> bool:
-        node_nonces = self._store.setdefault(node_id, {})
-        # purge old
-        expired = [n for n, ts in node_nonces.items() if now - ts > self._ttl]
-        for n in expired:
-            node_nonces.pop(n, None)
-        if nonce in node_nonces:
-            return True
-        node_nonces[nonce] = now
-        return False
+        with self._lock:
+            node_nonces = self._store.setdefault(node_id, {})
+            # purge old
+            expired = [n for n, ts in node_nonces.items() if now - ts > self._ttl]
+            for n in expired:
+                node_nonces.pop(n, None)
+            if nonce in node_nonces:
+                return True
+            node_nonces[nonce] = now
+            return False
 
 
 def _sign_message(secret: str, message: bytes) -> str:
@@ -82,3 +88,9 @@ def verify_signature(
         return SignatureResult(ok=False, error="Invalid signature")
 
     return SignatureResult(ok=True, node_id=node_id, timestamp=ts, nonce=nonce)
+
+
+def may_report_for(config: SecurityConfig, signer: str, device_id: str) -> bool:
+    """A node reports for itself; a gateway also for the leaves listed under it
+    in TELEMETRY_GATEWAYS (firmware espnow_link.h)."""
+    return signer == device_id or device_id in config.gateways.get(signer, ())
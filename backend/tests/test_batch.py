@@ -0,0 +1,31 @@
+from ingest_utils import expand_telemetry
+
+
+def test_single_reading_uses_signed_timestamp():
+    items, err = expand_telemetry({"device_id": "ground_1", "data": {"pm25": 3}}, 1700000000, 100, 1800000000)
+    assert err is None
+    assert items == [(1700000000, {"pm25": 3})]
+
+
+def test_batch_keeps_sample_timestamps():
+    payload = {
+        "device_id": "ground_1",
+        "readings": [
+            {"timestamp": 1700000010, "data": {"pm25": 1}},
+            {"timestamp": 1900000000, "data": {"pm25": 2}},
+            {"data": {"pm25": 3}},
+        ],
+    }
+    items, err = expand_telemetry(payload, 1700000099, 100, 1800000000)
+    assert err is None
+    # future and missing timestamps fall back to the signed request time
+    assert [ts for ts, _ in items] == [1700000010, 1700000099, 1700000099]
+    assert [d["pm25"] for _, d in items] == [1, 2, 3]
+
+
+def test_batch_limits():
+    too_many = {"readings": [{"data": {}}] * 3}
+    _, err = expand_telemetry(too_many, 1, 2, 10)
+    assert err
+    _, err = expand_telemetry({"readings": []}, 1, 2, 10)
+    assert err
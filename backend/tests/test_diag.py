@@ -0,0 +1,43 @@
+from diag import HealthStore, TimingStore, percentile
+
+EDGES = [100, 1000, 10000]
+
+
+def test_percentile_interpolates_within_bucket():
+    counts = [0, 10, 0, 0]
+    assert percentile(counts, EDGES, 0.5, 900) == 100 + 0.5 * 800
+    assert percentile([0, 0, 0, 0], EDGES, 0.5, 0) is None
+    # open last bucket is bounded by the reported maximum
+    assert percentile([0, 0, 0, 4], EDGES, 0.99, 50000) <= 50000
+
+
+def test_store_sums_deltas_and_builds_fleet_view():
+    store = TimingStore()
+    assert store.add("ground_1", {"edges_us": EDGES, "hist": {"post": [0, 0, 3, 1]}, "max_us": {"post": 20000}})
+    assert store.add("ground_1", {"edges_us": EDGES, "hist": {"post": [0, 0, 1, 0]}, "max_us": {"post": 5000}})
+    assert store.add("water_1", {"edges_us": EDGES, "hist": {"adc": [2, 0, 0, 0]}, "max_us": {"adc": 80}})
+    summary = store.summary()
+    post = summary["nodes"]["ground_1"]["stages"]["post"]
+    assert post["count"] == 5 and post["max_us"] == 20000
+    assert set(summary["fleet"]) == {"post", "adc"}
+    assert summary["fleet"]["adc"]["p99_us"] <= 80
+
+
+def test_store_rejects_malformed_blocks():
+    store = TimingStore()
+    assert not store.add("ground_1", None)
+    assert not store.add("ground_1", {"edges_us": EDGES, "hist": {"post": [1, 2]}})
+    assert not store.add("ground_1", {"edges_us": EDGES, "hist": {"post": [0, "1", 0, 0]}})
+    assert not store.add("ground_1", {"edges_us": EDGES, "hist": {"post": [0, True, 0, 0]}})
+    assert not store.add("ground_1", {"edges_us": EDGES, "hist": {"post": [0, 1, 0, 0]}, "max_us": {"post": "9"}})
+    assert store.summary()["nodes"] == {}
+
+
+def test_health_store_keeps_latest_block():
+    store = HealthStore()
+    assert store.add("ground_1", {"reset": "power_on", "uptime_s": 60, "wdt_resets": 0})
+    assert store.add("ground_1", {"reset": "task_wdt", "uptime_s": 5, "stuck": "net:tls", "wdt_resets": 1})
+    assert not store.add("ground_1", {"uptime_s": 5})
+    node = store.summary()["nodes"]["ground_1"]
+    assert node["stuck"] == "net:tls" and node["wdt_resets"] == 1
+    assert node["updated_utc"].endswith("Z")
@@ -0,0 +1,57 @@
+import math
+
+from edge_model import average_path_length, flatten_tree, forest_score, render_header
+
+# Root splits feature column 0 at 5.0; its left child splits column 1 at 2.0.
+TREE = dict(
+    children_left=[1, 3, -1, -1, -1],
+    children_right=[2, 4, -1, -1, -1],
+    feature=[0, 1, -2, -2, -2],
+    threshold=[5.0, 2.0, -2.0, -2.0, -2.0],
+    n_node_samples=[8, 6, 2, 1, 5],
+)
+
+
+def test_average_path_length():
+    assert average_path_length(1) == 0.0
+    assert average_path_length(2) == 1.0
+    assert math.isclose(average_path_length(256), 2 * (math.log(255) + 0.5772156649) - 2 * 255 / 256)
+
+
+def test_flatten_maps_features_and_leaf_depths():
+    nodes = flatten_tree(feature_index=[3, 1], max_depth=10, **TREE)
+    assert nodes[0][:2] == (3, 5.0)
+    left = nodes[nodes[0][2]]
+    assert left[:2] == (1, 2.0)
+    leaf = nodes[left[2]]
+    assert leaf[2] == -1 and leaf[1] == 2.0  # depth 2, one sample
+    right = nodes[nodes[0][3]]
+    assert right[1] == 1.0 + average_path_length(2)
+
+
+def test_truncation_keeps_sample_correction():
+    nodes = flatten_tree(feature_index=[0, 1], max_depth=1, **TREE)
+    assert len(nodes) == 3
+    assert nodes[1][1] == 1.0 + average_path_length(6)
+
+
+def test_forest_score_and_header():
+    nodes = flatten_tree(feature_index=[0, 1], max_depth=10, **TREE)
+    isolated = forest_score([nodes], 8, [9.0, 0.0])
+    crowded = forest_score([nodes], 8, [1.0, 3.0])
+    assert isolated > crowded
+    header = render_header("forest", ["pm25", "voc"], 0.55, "test.pkl", trees=[nodes], psi=8)
+    assert "#define EDGE_MODEL_KIND EDGE_MODEL_FOREST" in header
+    assert "FEATURES[] = {EDGE_PM25, EDGE_VOC}" in header
+    assert "TREE_COUNT = 1;" in header
+
+
+def test_zscore_header_rejects_unknown_features():
+    header = render_header("zscore", ["tds"], 6.0, "db", centers=[400.0], scales=[25.0])
+    assert "CENTER[] = {400.0f}" in header
+    try:
+        render_header("zscore", ["nope"], 6.0, "db", centers=[0.0], scales=[1.0])
+    except ValueError:
+        pass
+    else:
+        raise AssertionError("unknown feature accepted")
@@ -0,0 +1,89 @@
+import hashlib
+import hmac
+import json
+import os
+import zlib
+
+from firmware_store import FirmwareStore, image_digest
+
+IMAGE = bytes(range(256)) * 64
+
+
+def _store(tmp_path, manifest, files=None):
+    for name, data in (files or {}).items():
+        (tmp_path / name).write_bytes(data)
+    (tmp_path / "manifest.json").write_text(json.dumps(manifest))
+    return FirmwareStore(str(tmp_path))
+
+
+def test_digest_covers_the_decompressed_image(tmp_path):
+    (tmp_path / "a.bin.zz").write_bytes(zlib.compress(IMAGE, 9))
+    assert image_digest(str(tmp_path / "a.bin.zz"), "zlib") == (len(IMAGE), hashlib.sha256(IMAGE).hexdigest())
+    (tmp_path / "cut.zz").write_bytes(zlib.compress(IMAGE)[:100])
+    try:
+        image_digest(str(tmp_path / "cut.zz"), "zlib")
+        assert False, "truncated stream accepted"
+    except ValueError:
+        pass
+
+
+def test_offer_is_signed_and_skipped_when_current(tmp_path):
+    store = _store(tmp_path, {"ground_*": {"version": 7, "file": "air-7.bin.zz"}},
+                   {"air-7.bin.zz": zlib.compress(IMAGE)})
+    offer = store.offer("ground_1", "6", "s3cr3t")
+    sha = hashlib.sha256(IMAGE).hexdigest()
+    assert offer["url"] == "/api/firmware/air-7.bin.zz"
+    assert (offer["size"], offer["encoding"], offer["sha256"]) == (len(IMAGE), "zlib", sha)
+    message = f"ota.ground_1.7.{len(IMAGE)}.zlib.{sha}".encode()
+    assert offer["sig"] == hmac.new(b"s3cr3t", message, hashlib.sha256).hexdigest()
+    assert store.offer("ground_1", "7", "s3cr3t") is None
+    # older firmware does not report a version and cannot take an update
+    assert store.offer("ground_1", None, "s3cr3t") is None
+    assert store.offer("water_1", "6", "s3cr3t") is None
+
+
+def test_downgrades_need_the_flag_and_are_bound_to_the_nonce(tmp_path):
+    files = {"air-5.bin": IMAGE}
+    store = _store(tmp_path, {"ground_*": {"version": 5, "file": "air-5.bin"}}, files)
+    assert store.offer("ground_1", "7", "s3cr3t", "00ff") is None
+    store = _store(tmp_path, {"ground_*": {"version": 5, "file": "air-5.bin", "downgrade": True}}, files)
+    assert store.offer("ground_1", "7", "s3cr3t") is None
+    offer = store.offer("ground_1", "7", "s3cr3t", "00ff")
+    sha = hashlib.sha256(IMAGE).hexdigest()
+    message = f"ota.ground_1.5.{len(IMAGE)}.identity.{sha}.downgrade.00ff".encode()
+    assert offer["downgrade"] is True
+    assert offer["sig"] == hmac.new(b"s3cr3t", message, hashlib.sha256).hexdigest()
+    # upgrades keep the nonce-free signature
+    assert "downgrade" not in store.offer("ground_1", "4", "s3cr3t", "00ff")
+
+
+def test_exact_id_then_longest_prefix_wins(tmp_path):
+    files = {"a.bin": b"a", "b.bin": b"b", "c.bin": b"c"}
+    store = _store(tmp_path, {
+        "*": {"version": 1, "file": "a.bin"},
+        "ground_*": {"version": 2, "file": "b.bin"},
+        "ground_9": {"version": 3, "file": "c.bin"},
+    }, files)
+    assert store.entry_for("water_1")["version"] == 1
+    assert store.entry_for("ground_1")["version"] == 2
+    assert store.entry_for("ground_9")["version"] == 3
+    assert store.has_image("b.bin") and not store.has_image("manifest.json")
+
+
+def test_bad_entries_are_reported_and_skipped(tmp_path):
+    store = _store(tmp_path, {
+        "ground_1": {"version": 0, "file": "a.bin"},
+        "ground_2": {"version": 2, "file": "../a.bin"},
+        "ground_3": {"version": 2, "file": "missing.bin"},
+        "ground_4": {"version": 2, "file": "a.bin", "encoding": "bsdiff"},
+    }, {"a.bin": b"a"})
+    assert store.entry_for("ground_1") is None and len(store.errors) == 4
+
+
+def test_manifest_changes_are_picked_up(tmp_path):
+    store = _store(tmp_path, {"*": {"version": 1, "file": "a.bin"}}, {"a.bin": b"a"})
+    assert store.entry_for("ground_1")["version"] == 1
+    path = tmp_path / "manifest.json"
+    path.write_text(json.dumps({"*": {"version": 2, "file": "a.bin"}}))
+    os.utime(path, (1, 1))
+    assert store.entry_for("ground_1")["version"] == 2
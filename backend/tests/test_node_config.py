@@ -0,0 +1,71 @@
+import hashlib
+import hmac
+import json
+import os
+import time
+
+from node_config import NodeConfigStore, next_version, validate_params
+
+
+def _store(tmp_path, data):
+    path = tmp_path / "node_config.json"
+    path.write_text(json.dumps(data))
+    return NodeConfigStore(str(path)), path
+
+
+def test_validate_keeps_known_in_range_params():
+    params, errors = validate_params({
+        "interval_ms": 30000,
+        "batch_max": 0,
+        "deadband": {"pm25": 2, "humidity": 1},
+        "sensors": ["geiger", "bme680"],
+        "colour": "red",
+    })
+    assert params == {"interval_ms": 30000, "deadband": {"pm25": 2.0}, "sensors": ["bme680", "geiger"]}
+    assert len(errors) == 3
+
+
+def test_node_overrides_merge_over_fleet_defaults(tmp_path):
+    store, _ = _store(tmp_path, {"*": {"interval_ms": 30000, "batch_max": 6}, "ground_2": {"batch_max": 3}})
+    assert store.params_for("ground_1") == {"interval_ms": 30000, "batch_max": 6}
+    assert store.params_for("ground_2") == {"interval_ms": 30000, "batch_max": 3}
+
+
+def test_offer_is_signed_and_skipped_when_current(tmp_path):
+    store, _ = _store(tmp_path, {"ground_1": {"interval_ms": 5000}})
+    offer = store.offer("ground_1", "0", "s3cr3t")
+    assert offer["body"] == '{"interval_ms":5000}'
+    assert offer["version"] >= int(time.time()) - 5
+    message = f"config.ground_1.{offer['version']}.{offer['body']}".encode()
+    assert offer["sig"] == hmac.new(b"s3cr3t", message, hashlib.sha256).hexdigest()
+    assert store.offer("ground_1", str(offer["version"]), "s3cr3t") is None
+    # nodes that do not report a version (older firmware) are left alone
+    assert store.offer("ground_1", None, "s3cr3t") is None
+
+
+def test_removed_overrides_reset_nodes_to_defaults(tmp_path):
+    store, path = _store(tmp_path, {"ground_1": {"interval_ms": 5000}})
+    version = store.offer("ground_1", "0", "k")["version"]
+    path.write_text("{}")
+    os.utime(path, (1, 1))
+    offer = store.offer("ground_1", str(version), "k")
+    assert offer["version"] > version and offer["body"] == "{}"
+    assert store.offer("ground_1", str(offer["version"]), "k") is None
+    assert store.offer("ground_1", "0", "k") is None
+
+
+def test_versions_only_grow():
+    assert next_version(0, now=1000.5) == 1000
+    # a body changed twice within a second, or a clock that stepped back
+    assert next_version(1000, now=1000) == 1001
+    assert next_version(5000, now=1000) == 5001
+
+
+def test_missing_or_broken_file_offers_defaults(tmp_path):
+    store = NodeConfigStore(str(tmp_path / "absent.json"))
+    assert store.offer("ground_1", "0", "k") is None
+    bad = tmp_path / "bad.json"
+    bad.write_text("{not json")
+    store = NodeConfigStore(str(bad))
+    assert store.params_for("ground_1") == {}
+    assert store.errors
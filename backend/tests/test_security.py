@@ -49,3 +49,37 @@ def test_nonce_replay_detected():
     res2 = verify_signature(headers, body, cfg, cache)
     assert res1.ok
     assert not res2.ok
+
+
+def test_concurrent_replay_passes_once():
+    import threading
+    cache = NonceCache(600)
+    now = int(time.time())
+    for i in range(200):
+        cache.seen("ground_1", f"old{i}", now)  # gives the purge something to iterate
+    fresh = []
+    barrier = threading.Barrier(8)
+
+    def replay():
+        barrier.wait()
+        fresh.append(not cache.seen("ground_1", "dupnonce", now))
+
+    threads = [threading.Thread(target=replay) for _ in range(8)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    assert fresh.count(True) == 1
+
+
+def test_only_listed_gateways_report_for_other_nodes():
+    from config import _parse_gateways
+    from security import may_report_for
+
+    gateways = _parse_gateways("ground_1=water_1|water_2")
+    assert gateways == _parse_gateways('{"ground_1": ["water_1", "water_2"]}')
+    cfg = SecurityConfig(hmac_secrets={}, gateways=gateways)
+    assert may_report_for(cfg, "water_1", "water_1")
+    assert may_report_for(cfg, "ground_1", "water_2")
+    assert not may_report_for(cfg, "ground_2", "water_1")
+    assert not may_report_for(cfg, "water_1", "ground_1")
@@ -0,0 +1,29 @@
+from wire_format import expand_rows, is_msgpack
+
+
+def test_content_type_dispatch():
+    assert is_msgpack("application/msgpack")
+    assert is_msgpack("application/x-msgpack; charset=binary")
+    assert not is_msgpack("application/json")
+    assert not is_msgpack(None)
+
+
+def test_rows_expand_to_batch_shape():
+    row = [1700000000, 0.1, 12.5, 24.0, 55.0, 1010.0, 180.0, None, 100, 200, 300,
+           [10, 11, 9, 12], [20, 21, 19, 22], [30, 31, 29, 32], 18.5]
+    payload, err = expand_rows({"v": 1, "device_id": "ground_1", "readings": [row]})
+    assert err is None
+    assert payload["device_id"] == "ground_1"
+    item = payload["readings"][0]
+    assert item["timestamp"] == 1700000000
+    assert item["data"]["pm25"] == 12.5
+    assert item["data"]["water_temp_c"] is None
+    assert item["data"]["tds_mv"] == [20, 21, 19, 22]
+    assert item["data"]["water_temp_c_2"] == 18.5
+
+
+def test_unknown_schema_rejected():
+    _, err = expand_rows({"v": 99, "readings": []})
+    assert err
+    _, err = expand_rows({"v": 1, "readings": [[1, 2]]})
+    assert err
@@ -0,0 +1,39 @@
+from ws_uplink import format_reply, header, parse_frame, upgrade_headers
+
+
+def test_frame_splits_signature_from_body():
+    headers, body, err = parse_frame(b'1700000000 abcd ' + b'f' * 64 + b'\n{"a":1}\n')
+    assert err is None
+    assert headers == {"X-Timestamp": "1700000000", "X-Nonce": "abcd", "X-Signature": "f" * 64}
+    # only the first newline separates; the body is kept byte for byte
+    assert body == b'{"a":1}\n'
+
+
+def test_optional_config_version_field():
+    headers, _, err = parse_frame(b"1 n s 42\n{}")
+    assert err is None and headers["X-Config-Version"] == "42"
+
+
+def test_binary_body_and_text_frames():
+    _, body, err = parse_frame(b"1 n s\n\x93\x0a\x00")
+    assert err is None and body == b"\x93\x0a\x00"
+    _, body, err = parse_frame("1 n s\n{}")
+    assert err is None and body == b"{}"
+
+
+def test_malformed_frames_rejected():
+    for frame in (b"no newline", b"1 n\n{}", b"1  s\n{}", b"1 n s v x\n{}"):
+        headers, _, err = parse_frame(frame)
+        assert headers is None and err
+
+
+def test_upgrade_headers_are_case_insensitive():
+    base = upgrade_headers({"X-Api-Key": "k", "X-Node-Id": "ground_1", "Host": "x"})
+    assert base == {"X-API-Key": "k", "X-Node-Id": "ground_1", "Content-Type": "application/json"}
+    base = upgrade_headers({"x-content-type": "application/msgpack", "X-Firmware-Version": "7"})
+    assert base == {"Content-Type": "application/msgpack", "X-Firmware-Version": "7"}
+    assert header({"X-Timestamp": "1"}, "x-timestamp") == "1"
+
+
+def test_reply_format():
+    assert format_reply(401, {"error": "Unauthorized"}) == '401 {"error":"Unauthorized"}'
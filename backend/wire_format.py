@@ -0,0 +1,74 @@
+from __future__ import annotations
+
+from typing import Dict, List, Optional, Tuple
+
+MSGPACK_CONTENT_TYPES = ("application/msgpack", "application/x-msgpack")
+
+# Positional row layouts for compact (MessagePack) telemetry, keyed by the
+# body's "v". Must match fillRow() in firmware/esp32_env_node/lib/node_core/src/payload.cpp.
+SCHEMAS: Dict[int, List[str]] = {
+    1: [
+        "timestamp",
+        "radiation_cpm",
+        "pm25",
+        "air_temp_c",
+        "humidity",
+        "pressure_hpa",
+        "voc",
+        "water_temp_c",
+        "turbidity_raw",
+        "tds_raw",
+        "ph_raw",
+        "turbidity_mv",
+        "tds_mv",
+        "ph_mv",
+    ],
+}
+
+
+def is_msgpack(content_type: str | None) -> bool:
+    if not content_type:
+        return False
+    return content_type.split(";", 1)[0].strip().lower() in MSGPACK_CONTENT_TYPES
+
+
+def expand_rows(body: Dict) -> Tuple[Optional[Dict], Optional[str]]:
+    """Turn a positional (schema-versioned) body into the JSON batch shape.
+
+    Columns past the end of the schema are extra DS18B20 probes and become
+    water_temp_c_2, water_temp_c_3, ...
+    """
+    if not isinstance(body, dict):
+        return None, "Body must be a map"
+    columns = SCHEMAS.get(body.get("v"))
+    if columns is None:
+        return None, f"Unknown schema version {body.get('v')!r}"
+    rows = body.get("readings")
+    if not isinstance(rows, list):
+        return None, "readings must be a list"
+
+    readings = []
+    for row in rows:
+        if not isinstance(row, list) or len(row) < len(columns):
+            return None, "Row does not match schema"
+        data = {name: row[i] for i, name in enumerate(columns) if name != "timestamp"}
+        for extra, value in enumerate(row[len(columns):], start=2):
+            data[f"water_temp_c_{extra}"] = value
+        readings.append({"timestamp": row[0], "data": data})
+    expanded = {"device_id": body.get("device_id"), "node_id": body.get("node_id"), "readings": readings}
+    for block in ("diag", "health"):
+        if block in body:
+            expanded[block] = body[block]
+    return expanded, None
+
+
+def decode_msgpack(body_bytes: bytes) -> Tuple[Optional[Dict], Optional[str]]:
+    try:
+        import msgpack  # type: ignore
+    except ImportError:
+        return None, "MessagePack support not installed on server"
+    try:
+        body = msgpack.unpackb(body_bytes, raw=False)
+    except Exception:
+        return None, "Invalid MessagePack body"
+    return expand_rows(body)
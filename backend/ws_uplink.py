@@ -0,0 +1,49 @@
+from __future__ import annotations
+
+import json
+from typing import Dict, Optional, Tuple
+
+# Framing for the persistent WebSocket uplink (/api/telemetry/ws). The upgrade
+# request carries X-API-Key, X-Node-Id, X-Content-Type and X-Firmware-Version
+# once; every message after that is one signed telemetry body:
+#
+#   "<timestamp> <nonce> <signature> [<config version>]\n" + body
+#
+# signed exactly like the HTTP X-Timestamp/X-Nonce/X-Signature headers (the
+# optional fourth field stands in for X-Config-Version). Each
+# message is answered with "<status> <json>", the status and body the HTTP
+# endpoint would have returned. Must match firmware/esp32_env_node/src/ws_uplink.cpp.
+
+
+def parse_frame(frame: bytes | str) -> Tuple[Optional[Dict[str, str]], bytes, Optional[str]]:
+    if isinstance(frame, str):
+        frame = frame.encode("utf-8")
+    head, sep, body = frame.partition(b"\n")
+    parts = head.decode("ascii", "replace").split(" ")
+    if not sep or len(parts) not in (3, 4) or not all(parts):
+        return None, b"", "Malformed frame"
+    headers = {"X-Timestamp": parts[0], "X-Nonce": parts[1], "X-Signature": parts[2]}
+    if len(parts) == 4:
+        headers["X-Config-Version"] = parts[3]
+    return headers, body, None
+
+
+def format_reply(status: int, payload: dict) -> str:
+    return f"{status} {json.dumps(payload, separators=(',', ':'))}"
+
+
+def header(headers: Dict[str, str], name: str) -> Optional[str]:
+    """Case-insensitive lookup; dict(request.headers) title-cases names."""
+    name = name.lower()
+    for key, value in headers.items():
+        if key.lower() == name:
+            return value
+    return None
+
+
+def upgrade_headers(headers: Dict[str, str]) -> Dict[str, str]:
+    """Connection-level headers that apply to every frame on the socket."""
+    out = {k: header(headers, k) for k in ("X-API-Key", "X-Node-Id", "X-Firmware-Version")}
+    out = {k: v for k, v in out.items() if v is not None}
+    out["Content-Type"] = header(headers, "X-Content-Type") or "application/json"
+    return out
@@ -0,0 +1,580 @@
+#pragma once
+
+// Defaults for tunables introduced after the original config.h template.
+// Any of these can be overridden by defining them in include/config.h.
+// Host builds (env:native) point NODE_CONFIG_HEADER at a test fixture
+// instead, since include/config.h holds per-node secrets.
+#ifdef NODE_CONFIG_HEADER
+#include NODE_CONFIG_HEADER
+#else
+#include "config.h"
+#endif
+
+// Sensors fitted to this node, as a bitmask of SENSOR_* flags. Drivers and
+// payload fields for anything not listed are compiled out. platformio.ini
+// sets this per environment (env:air_node, env:water_node); builds without
+// it keep every driver.
+#define SENSOR_BME680 (1u << 0)
+#define SENSOR_SDS011 (1u << 1)
+#define SENSOR_GEIGER (1u << 2)
+#define SENSOR_DS18B20 (1u << 3)
+#define SENSOR_WATER_ADC (1u << 4)
+
+#define NODE_PROFILE_AIR (SENSOR_BME680 | SENSOR_SDS011 | SENSOR_GEIGER)
+#define NODE_PROFILE_WATER (SENSOR_DS18B20 | SENSOR_WATER_ADC)
+#define NODE_PROFILE_ALL (NODE_PROFILE_AIR | NODE_PROFILE_WATER)
+
+#ifndef NODE_SENSORS
+#define NODE_SENSORS NODE_PROFILE_ALL
+#endif
+
+#define NODE_HAS(sensor) ((NODE_SENSORS & (sensor)) != 0)
+
+// How long a resolved SERVER_URL address is trusted before re-resolving.
+#ifndef DNS_CACHE_TTL_MS
+#define DNS_CACHE_TTL_MS (30UL * 60UL * 1000UL)
+#endif
+
+// Readings held on-device between uploads. When full the oldest is dropped.
+#ifndef READING_BUFFER_CAPACITY
+#define READING_BUFFER_CAPACITY 64
+#endif
+
+// A batch is uploaded once this many readings are queued...
+#ifndef BATCH_MAX_READINGS
+#define BATCH_MAX_READINGS 12
+#endif
+
+// ...or once the oldest queued reading is this old. Keep this well under the
+// backend's OFFLINE_SECONDS so nodes do not flap to Offline between batches.
+#ifndef BATCH_MAX_AGE_MS
+#define BATCH_MAX_AGE_MS 60000UL
+#endif
+
+// Flash store-and-forward queue (LittleFS). Readings that cannot be uploaded
+// are appended to fixed-size segment files; the oldest segment is deleted
+// when the queue reaches FLASH_QUEUE_MAX_SEGMENTS.
+#ifndef FLASH_QUEUE_ENABLED
+#define FLASH_QUEUE_ENABLED 1
+#endif
+
+#ifndef FLASH_QUEUE_SEGMENT_RECORDS
+#define FLASH_QUEUE_SEGMENT_RECORDS 256
+#endif
+
+#ifndef FLASH_QUEUE_MAX_SEGMENTS
+#define FLASH_QUEUE_MAX_SEGMENTS 48
+#endif
+
+// Readings read back from flash per upload while draining a backlog.
+#ifndef FLASH_DRAIN_BATCH
+#define FLASH_DRAIN_BATCH 48
+#endif
+
+// Upper bound for the backoff between upload attempts while offline.
+#ifndef OFFLINE_RETRY_MAX_MS
+#define OFFLINE_RETRY_MAX_MS (5UL * 60UL * 1000UL)
+#endif
+
+// Sampling/upload pipeline. Sensors are sampled on one core at a fixed rate
+// and handed to the network task on the other core through a FreeRTOS queue.
+#ifndef READING_QUEUE_DEPTH
+#define READING_QUEUE_DEPTH 32
+#endif
+
+#ifndef SENSOR_TASK_CORE
+#define SENSOR_TASK_CORE 1
+#endif
+
+#ifndef SENSOR_TASK_PRIORITY
+#define SENSOR_TASK_PRIORITY 3
+#endif
+
+#ifndef SENSOR_TASK_STACK
+#define SENSOR_TASK_STACK 6144
+#endif
+
+#ifndef NETWORK_TASK_CORE
+#define NETWORK_TASK_CORE 0
+#endif
+
+#ifndef NETWORK_TASK_PRIORITY
+#define NETWORK_TASK_PRIORITY 1
+#endif
+
+#ifndef NETWORK_TASK_STACK
+#define NETWORK_TASK_STACK 12288
+#endif
+
+// Health supervision (health.h). A watched task that has not checked in for
+// HEALTH_WDT_TIMEOUT_S resets the node; this has to outlast the slowest
+// legitimate blocking call (a 15 s TLS handshake plus a 15 s response).
+#ifndef HEALTH_WDT_TIMEOUT_S
+#define HEALTH_WDT_TIMEOUT_S 60
+#endif
+
+// Samples in a row a sensor may fail before its driver is reinitialized.
+#ifndef HEALTH_SENSOR_FAILS
+#define HEALTH_SENSOR_FAILS 5
+#endif
+
+// Failed flushes in a row before Wi-Fi is restarted (every this many), and
+// before the node reboots. 0 disables a step. LOW_POWER_MODE brings Wi-Fi up
+// from scratch on every upload wake anyway and skips both.
+#ifndef HEALTH_WIFI_RESTART_FAILS
+#define HEALTH_WIFI_RESTART_FAILS 3
+#endif
+
+#ifndef HEALTH_REBOOT_FAILS
+#define HEALTH_REBOOT_FAILS 12
+#endif
+
+// DS18B20 resolution in bits (9-12). Conversion takes ~94/188/375/750 ms.
+#ifndef DS18B20_RESOLUTION
+#define DS18B20_RESOLUTION 12
+#endif
+
+// Probes on the DS18B20_PIN bus, addressed by ROM code. The first probe is
+// reported as water_temp_c, further ones as water_temp_c_2, _3, ...
+#ifndef DS18B20_MAX_PROBES
+#define DS18B20_MAX_PROBES 1
+#endif
+
+// Continuous (I2S/DMA) ADC acquisition for turbidity/TDS/pH. Pins must be on
+// ADC1 (GPIO32-39); otherwise the sampler falls back to oversampled
+// analogRead() bursts of ADC_FALLBACK_SAMPLES per channel.
+#ifndef ADC_DMA_ENABLED
+#define ADC_DMA_ENABLED 1
+#endif
+
+// Total conversion rate across all channels (ESP32 range 20 kHz - 2 MHz).
+#ifndef ADC_SAMPLE_RATE_HZ
+#define ADC_SAMPLE_RATE_HZ 20000
+#endif
+
+// Samples per channel kept (evenly spaced over a sample interval) for the median.
+#ifndef ADC_MEDIAN_SAMPLES
+#define ADC_MEDIAN_SAMPLES 64
+#endif
+
+#ifndef ADC_FALLBACK_SAMPLES
+#define ADC_FALLBACK_SAMPLES 16
+#endif
+
+// Static request/response buffers for uploads. A batch that does not fit is
+// split across requests.
+#ifndef UPLOAD_BODY_CAPACITY
+#define UPLOAD_BODY_CAPACITY 16384
+#endif
+
+#ifndef UPLOAD_RESPONSE_CAPACITY
+#define UPLOAD_RESPONSE_CAPACITY 1024
+#endif
+
+// Wire format for uploads: PAYLOAD_FORMAT_JSON or PAYLOAD_FORMAT_MSGPACK.
+#define PAYLOAD_FORMAT_JSON 0
+#define PAYLOAD_FORMAT_MSGPACK 1
+#ifndef PAYLOAD_FORMAT
+#define PAYLOAD_FORMAT PAYLOAD_FORMAT_JSON
+#endif
+
+// Transport for signed uploads: one HTTPS POST per batch
+// (UPLINK_TRANSPORT_HTTP), or frames on a single long-lived WebSocket to
+// UPLINK_WS_PATH on the SERVER_URL host (UPLINK_TRANSPORT_WS), which sends
+// the API key and node id once per connection instead of on every request.
+#define UPLINK_TRANSPORT_HTTP 0
+#define UPLINK_TRANSPORT_WS 1
+#ifndef UPLINK_TRANSPORT
+#define UPLINK_TRANSPORT UPLINK_TRANSPORT_HTTP
+#endif
+
+#ifndef UPLINK_WS_PATH
+#define UPLINK_WS_PATH "/api/telemetry/ws"
+#endif
+
+// How long to wait for the server to answer a WebSocket frame (or the
+// upgrade) before dropping the connection.
+#ifndef UPLINK_WS_REPLY_TIMEOUT_MS
+#define UPLINK_WS_REPLY_TIMEOUT_MS 10000
+#endif
+
+// Over-the-air updates (ota_update.h). FIRMWARE_VERSION must be a plain
+// integer; nodes report it as X-Firmware-Version and release builds set it
+// (backend/scripts/publish_firmware.py).
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION 1
+#endif
+#define FIRMWARE_VERSION_STR_(v) #v
+#define FIRMWARE_VERSION_STR(v) FIRMWARE_VERSION_STR_(v)
+#define FIRMWARE_VERSION_TEXT FIRMWARE_VERSION_STR(FIRMWARE_VERSION)
+
+#ifndef OTA_ENABLED
+#define OTA_ENABLED 1
+#endif
+
+// A new image that has not had an upload accepted within this many flush
+// cycles is rolled back. In LOW_POWER_MODE it must confirm on its first wake
+// when the bootloader supports rollback: deep sleep resets through it, and it
+// rolls back an unconfirmed image.
+#ifndef OTA_HEALTHY_WITHIN_CYCLES
+#define OTA_HEALTHY_WITHIN_CYCLES 5
+#endif
+
+// Boots, deep-sleep wakes included, an unconfirmed image may take before it
+// is rolled back. Catches an image that crashes before its health check,
+// which a bootloader without rollback support would otherwise boot forever.
+#ifndef OTA_UNCONFIRMED_BOOTS
+#define OTA_UNCONFIRMED_BOOTS 3
+#endif
+
+// Wait before retrying a download that failed.
+#ifndef OTA_RETRY_MS
+#define OTA_RETRY_MS 600000UL
+#endif
+
+// ESP-NOW aggregation (espnow_link.h). A NODE_ROLE_LEAF node never joins
+// Wi-Fi: each reading goes as one signed ESP-NOW frame to a mains-powered
+// NODE_ROLE_GATEWAY, which uploads it in per-node batches along with its own
+// readings (best with UPLINK_TRANSPORT_WS). Both need ESPNOW_SECRET in
+// config.h, and the backend must list the leaves under the gateway in
+// TELEMETRY_GATEWAYS.
+#define NODE_ROLE_STANDALONE 0
+#define NODE_ROLE_GATEWAY 1
+#define NODE_ROLE_LEAF 2
+#ifndef NODE_ROLE
+#define NODE_ROLE NODE_ROLE_STANDALONE
+#endif
+
+// Gateway: the leaf ids it relays for, comma-separated with no spaces. A
+// reading's source is its position in this list, also for readings already
+// in the flash queue, so only ever append to it.
+#ifndef ESPNOW_LEAVES
+#define ESPNOW_LEAVES ""
+#endif
+
+#ifndef ESPNOW_MAX_LEAVES
+#define ESPNOW_MAX_LEAVES 16
+#endif
+
+#ifndef ESPNOW_RX_QUEUE_DEPTH
+#define ESPNOW_RX_QUEUE_DEPTH 16
+#endif
+
+// Above the network task, so acks go out while an upload is in flight.
+#ifndef ESPNOW_TASK_PRIORITY
+#define ESPNOW_TASK_PRIORITY 2
+#endif
+
+#ifndef ESPNOW_TASK_CORE
+#define ESPNOW_TASK_CORE 0
+#endif
+
+#ifndef ESPNOW_TASK_STACK
+#define ESPNOW_TASK_STACK 4096
+#endif
+
+// Leaf: channel tried first; it has to be the gateway's AP channel. A leaf
+// that hears no ack sweeps channels 1-13 once per wake and keeps the one the
+// gateway answered on.
+#ifndef ESPNOW_CHANNEL
+#define ESPNOW_CHANNEL 1
+#endif
+
+#ifndef ESPNOW_ACK_TIMEOUT_MS
+#define ESPNOW_ACK_TIMEOUT_MS 30
+#endif
+
+#ifndef ESPNOW_SEND_ATTEMPTS
+#define ESPNOW_SEND_ATTEMPTS 3
+#endif
+
+// Sequence numbers reserved per NVS write: by a leaf for its own frames, by
+// the gateway for the floor it keeps per leaf.
+#ifndef ESPNOW_SEQ_BLOCK
+#define ESPNOW_SEQ_BLOCK 1024
+#endif
+
+// Deep-sleep duty cycling for battery/solar nodes. After each sample the node
+// deep-sleeps until the next SEND_INTERVAL_MS slot; readings wait in RTC
+// memory and Wi-Fi only comes up every DEEP_SLEEP_UPLOAD_EVERY wakes (or when
+// the RTC buffer fills). Geiger pulses are only counted while awake.
+#ifndef LOW_POWER_MODE
+#define LOW_POWER_MODE 0
+#endif
+
+#ifndef DEEP_SLEEP_UPLOAD_EVERY
+#define DEEP_SLEEP_UPLOAD_EVERY 6
+#endif
+
+// Readings held in RTC slow memory (8 KB total on the ESP32) between uploads.
+#ifndef SLEEP_BUFFER_CAPACITY
+#define SLEEP_BUFFER_CAPACITY 24
+#endif
+
+// Shortest sleep when a wake overran its slot (e.g. a slow upload).
+#ifndef DEEP_SLEEP_MIN_MS
+#define DEEP_SLEEP_MIN_MS 1000
+#endif
+
+// SDS011 duty cycle. The sensor runs in query mode and, when the sample
+// interval leaves at least SDS_DUTY_MIN_SLEEP_MS beyond its warm-up, sleeps
+// (fan and laser off) between samples and is woken SDS_WARMUP_MS before the
+// next one. Shorter intervals keep it running; 0 never sleeps it.
+#ifndef SDS_DUTY_CYCLE
+#define SDS_DUTY_CYCLE 1
+#endif
+
+// Fan run time before readings are trusted after a wake (datasheet: 30 s).
+#ifndef SDS_WARMUP_MS
+#define SDS_WARMUP_MS 30000UL
+#endif
+
+#ifndef SDS_DUTY_MIN_SLEEP_MS
+#define SDS_DUTY_MIN_SLEEP_MS 30000UL
+#endif
+
+// How long a sample waits for the reply to its query.
+#ifndef SDS_QUERY_TIMEOUT_MS
+#define SDS_QUERY_TIMEOUT_MS 1500
+#endif
+
+// Wi-Fi association. The first attempt goes straight to the cached BSSID and
+// channel; if that fails, later attempts fall back to a full scan.
+#ifndef WIFI_CONNECT_ATTEMPTS
+#define WIFI_CONNECT_ATTEMPTS 3
+#endif
+
+#ifndef WIFI_FAST_CONNECT_TIMEOUT_MS
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 2000
+#endif
+
+#ifndef WIFI_CONNECT_TIMEOUT_MS
+#define WIFI_CONNECT_TIMEOUT_MS 10000
+#endif
+
+// 1 = reuse the cached DHCP lease as a static IP on fast connects, which skips
+// DHCP. Only enable this when the router reserves the address for the node.
+#ifndef WIFI_REUSE_LEASE
+#define WIFI_REUSE_LEASE 0
+#endif
+
+// Geiger counting (PCNT + 1 s bins). The CPM window is GEIGER_WINDOW_MS long,
+// capped at GEIGER_MAX_BINS seconds.
+#ifndef GEIGER_MAX_BINS
+#define GEIGER_MAX_BINS 300
+#endif
+
+// Tube dead time for the CPM correction; 0 disables it. Take the value from
+// the tube datasheet (the M4011 on SEN0463 boards is in the 100-200 us range).
+#ifndef GEIGER_DEAD_TIME_US
+#define GEIGER_DEAD_TIME_US 190
+#endif
+
+// PCNT glitch filter in 12.5 ns APB cycles (max 1023).
+#ifndef GEIGER_FILTER_CYCLES
+#define GEIGER_FILTER_CYCLES 100
+#endif
+
+// Report-on-change (off by default: every sample is reported). Readings are
+// only queued when radiation, PM2.5 or water temperature moves past its
+// deadband, at least every REPORT_HEARTBEAT_MS, and always while escalated.
+// Reaching an alert level or rate of change escalates for
+// REPORT_ESCALATION_HOLD_MS: sampling speeds up and every reading is uploaded
+// right away.
+#ifndef ADAPTIVE_REPORTING
+#define ADAPTIVE_REPORTING 0
+#endif
+
+// Heartbeat plus BATCH_MAX_AGE_MS must stay under the backend's
+// OFFLINE_SECONDS (120 s), or a quiet node shows as Offline. Raise both
+// together for longer heartbeats.
+#ifndef REPORT_HEARTBEAT_MS
+#define REPORT_HEARTBEAT_MS 55000UL
+#endif
+
+#ifndef REPORT_ESCALATED_INTERVAL_MS
+#define REPORT_ESCALATED_INTERVAL_MS 10000
+#endif
+
+#ifndef REPORT_ESCALATION_HOLD_MS
+#define REPORT_ESCALATION_HOLD_MS 300000
+#endif
+
+#ifndef REPORT_RAD_DEADBAND_USVH
+#define REPORT_RAD_DEADBAND_USVH 0.05f
+#endif
+
+#ifndef REPORT_RAD_ALERT_USVH
+#define REPORT_RAD_ALERT_USVH 0.5f
+#endif
+
+#ifndef REPORT_RAD_RATE_PER_MIN
+#define REPORT_RAD_RATE_PER_MIN 0.2f
+#endif
+
+#ifndef REPORT_PM25_DEADBAND
+#define REPORT_PM25_DEADBAND 5.0f
+#endif
+
+#ifndef REPORT_PM25_ALERT
+#define REPORT_PM25_ALERT 35.5f
+#endif
+
+#ifndef REPORT_PM25_RATE_PER_MIN
+#define REPORT_PM25_RATE_PER_MIN 20.0f
+#endif
+
+#ifndef REPORT_WATER_TEMP_DEADBAND_C
+#define REPORT_WATER_TEMP_DEADBAND_C 0.5f
+#endif
+
+#ifndef REPORT_WATER_TEMP_ALERT_C
+#define REPORT_WATER_TEMP_ALERT_C 35.0f
+#endif
+
+#ifndef REPORT_WATER_TEMP_RATE_PER_MIN
+#define REPORT_WATER_TEMP_RATE_PER_MIN 2.0f
+#endif
+
+// BME680 measurement profile. Each measurement takes roughly the summed
+// oversampling time plus BME_HEATER_MS; it overlaps the rest of the sweep.
+#ifndef BME_TEMP_OVERSAMPLING
+#define BME_TEMP_OVERSAMPLING BME680_OS_8X
+#endif
+
+#ifndef BME_HUM_OVERSAMPLING
+#define BME_HUM_OVERSAMPLING BME680_OS_2X
+#endif
+
+#ifndef BME_PRESS_OVERSAMPLING
+#define BME_PRESS_OVERSAMPLING BME680_OS_4X
+#endif
+
+#ifndef BME_IIR_FILTER
+#define BME_IIR_FILTER BME680_FILTER_SIZE_3
+#endif
+
+// Gas heater target (degC) and duration (ms); 0 ms turns the heater off.
+#ifndef BME_HEATER_TEMP_C
+#define BME_HEATER_TEMP_C 320
+#endif
+
+#ifndef BME_HEATER_MS
+#define BME_HEATER_MS 150
+#endif
+
+// Edge filtering applied to each reading before it is reported, per channel:
+// FILTER_MODE_RAW, _MEDIAN (rolling), _EMA, _HAMPEL (outlier rejection) or
+// _HAMPEL_EMA. Radiation stays raw by default: the Geiger window already
+// averages, and a real excursion must never be mistaken for an outlier.
+#define FILTER_MODE_RAW 0
+#define FILTER_MODE_MEDIAN 1
+#define FILTER_MODE_EMA 2
+#define FILTER_MODE_HAMPEL 3
+#define FILTER_MODE_HAMPEL_EMA 4
+
+#ifndef FILTER_RADIATION
+#define FILTER_RADIATION FILTER_MODE_RAW
+#endif
+
+#ifndef FILTER_PM25
+#define FILTER_PM25 FILTER_MODE_HAMPEL
+#endif
+
+#ifndef FILTER_AIR
+#define FILTER_AIR FILTER_MODE_RAW
+#endif
+
+#ifndef FILTER_WATER_TEMP
+#define FILTER_WATER_TEMP FILTER_MODE_RAW
+#endif
+
+#ifndef FILTER_WATER_ADC
+#define FILTER_WATER_ADC FILTER_MODE_HAMPEL
+#endif
+
+// Samples in the median/Hampel window (odd keeps the median a real sample).
+#ifndef FILTER_WINDOW
+#define FILTER_WINDOW 7
+#endif
+
+#ifndef FILTER_EMA_ALPHA
+#define FILTER_EMA_ALPHA 0.3f
+#endif
+
+// Hampel threshold in scaled MADs, and the smallest deviation (in channel
+// units) ever treated as an outlier.
+#ifndef FILTER_HAMPEL_K
+#define FILTER_HAMPEL_K 3.0f
+#endif
+
+#ifndef FILTER_RADIATION_MIN_DEV
+#define FILTER_RADIATION_MIN_DEV 0.1f
+#endif
+
+#ifndef FILTER_PM25_MIN_DEV
+#define FILTER_PM25_MIN_DEV 5.0f
+#endif
+
+#ifndef FILTER_ADC_MIN_DEV
+#define FILTER_ADC_MIN_DEV 40.0f
+#endif
+
+// Score every sample with the exported anomaly model (edge_model_*.h) and
+// upload anomalous readings immediately. A no-op until a model is exported.
+// Define EDGE_SCORE_THRESHOLD to override the model's own threshold.
+#ifndef EDGE_SCORING_ENABLED
+#define EDGE_SCORING_ENABLED 1
+#endif
+
+// How often an upload carries the per-stage timing histograms ("diag");
+// 0 disables them.
+#ifndef DIAG_INTERVAL_MS
+#define DIAG_INTERVAL_MS 600000UL
+#endif
+
+// Serial log verbosity; calls above it compile to nothing.
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Log lines are queued in a RAM ring and written to Serial by a low-priority
+// task; lines that do not fit are dropped and counted rather than blocking.
+#ifndef LOG_BUFFER_BYTES
+#define LOG_BUFFER_BYTES 4096
+#endif
+
+#ifndef LOG_LINE_MAX
+#define LOG_LINE_MAX 192
+#endif
+
+#ifndef LOG_TASK_CORE
+#define LOG_TASK_CORE 0
+#endif
+
+#ifndef LOG_TASK_PRIORITY
+#define LOG_TASK_PRIORITY 1
+#endif
+
+// After this long without an SNTP or server sync the clock is refreshed
+// on the next connect; in between, readings are stamped from the cached
+// esp_timer offset (kept across deep sleep).
+#ifndef TIME_RESYNC_MS
+#define TIME_RESYNC_MS (6UL * 60UL * 60UL * 1000UL)
+#endif
+
+// Ask the backend's /api/time over the upload connection when a POST needs
+// a synced clock and SNTP has not answered yet.
+#ifndef TIME_FROM_SERVER
+#define TIME_FROM_SERVER 1
+#endif
+
+#ifndef TIME_SERVER_PATH
+#define TIME_SERVER_PATH "/api/time"
+#endif
@@ -0,0 +1,116 @@
+#include "espnow_frame.h"
+
+#include <string.h>
+
+static const uint8_t FRAME_MAGIC = 0xE5;
+static const uint8_t TYPE_READING = 0x03;
+static const uint8_t TYPE_ACK = 0x02;
+static const uint8_t TYPE_STALE = 0x04;
+static const size_t ACK_LEN = 2 + 4 + 8 + HmacSigner::MAC_LEN;
+static const size_t STALE_LEN = 2 + 4 + 4 + HmacSigner::MAC_LEN;
+
+static void putU32(uint8_t *p, uint32_t v) {
+  for (uint8_t i = 0; i < 4; i++) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+static uint32_t getU32(const uint8_t *p) {
+  uint32_t v = 0;
+  for (uint8_t i = 0; i < 4; i++) v |= static_cast<uint32_t>(p[i]) << (8 * i);
+  return v;
+}
+
+static void seal(HmacSigner &signer, const char *prefix, uint8_t *frame, size_t len) {
+  uint8_t mac[HmacSigner::MAC_LEN];
+  signer.start();
+  if (prefix) signer.update(prefix, strlen(prefix));
+  signer.update(frame, len);
+  signer.finish(mac);
+  memcpy(frame + len, mac, sizeof(mac));
+}
+
+// Constant-time check of the trailing MAC over the first len bytes.
+static bool sealed(HmacSigner &signer, const char *prefix, const uint8_t *frame, size_t len) {
+  uint8_t mac[HmacSigner::MAC_LEN];
+  signer.start();
+  if (prefix) signer.update(prefix, strlen(prefix));
+  signer.update(frame, len);
+  signer.finish(mac);
+  uint8_t diff = 0;
+  for (size_t i = 0; i < sizeof(mac); i++) diff |= mac[i] ^ frame[len + i];
+  return diff == 0;
+}
+
+size_t espnowEncodeReading(HmacSigner &signer, const char *nodeId, uint32_t seq, uint32_t sentAt,
+                           const Reading &r, uint8_t *out, size_t cap) {
+  const size_t idLen = strlen(nodeId);
+  if (idLen == 0 || idLen > ESPNOW_ID_MAX) return 0;
+  const size_t len = 2 + 4 + 4 + 1 + idLen + 1 + sizeof(Reading);
+  if (len + HmacSigner::MAC_LEN > cap) return 0;
+  uint8_t *p = out;
+  *p++ = FRAME_MAGIC;
+  *p++ = TYPE_READING;
+  putU32(p, seq);
+  putU32(p + 4, sentAt);
+  p += 8;
+  *p++ = static_cast<uint8_t>(idLen);
+  memcpy(p, nodeId, idLen);
+  p += idLen;
+  *p++ = static_cast<uint8_t>(sizeof(Reading));
+  memcpy(p, &r, sizeof(Reading));
+  seal(signer, nullptr, out, len);
+  return len + HmacSigner::MAC_LEN;
+}
+
+bool espnowDecodeReading(HmacSigner &signer, const uint8_t *frame, size_t len, EspNowReading &out) {
+  if (len < 11 || frame[0] != FRAME_MAGIC || frame[1] != TYPE_READING) return false;
+  const size_t idLen = frame[10];
+  if (idLen == 0 || idLen > ESPNOW_ID_MAX) return false;
+  const size_t body = 11 + idLen + 1 + sizeof(Reading);
+  if (len != body + HmacSigner::MAC_LEN || frame[11 + idLen] != sizeof(Reading)) return false;
+  if (!sealed(signer, nullptr, frame, body)) return false;
+  out.seq = getU32(frame + 2);
+  out.sentAt = getU32(frame + 6);
+  memcpy(out.nodeId, frame + 11, idLen);
+  out.nodeId[idLen] = '\0';
+  memcpy(&out.reading, frame + 12 + idLen, sizeof(Reading));
+  return true;
+}
+
+size_t espnowEncodeAck(HmacSigner &signer, const char *nodeId, const EspNowAck &ack, uint8_t *out, size_t cap) {
+  if (cap < ACK_LEN) return 0;
+  out[0] = FRAME_MAGIC;
+  out[1] = TYPE_ACK;
+  putU32(out + 2, ack.seq);
+  putU32(out + 6, static_cast<uint32_t>(ack.epochMs));
+  putU32(out + 10, static_cast<uint32_t>(ack.epochMs >> 32));
+  seal(signer, nodeId, out, ACK_LEN - HmacSigner::MAC_LEN);
+  return ACK_LEN;
+}
+
+bool espnowDecodeAck(HmacSigner &signer, const char *nodeId, const uint8_t *frame, size_t len, EspNowAck &out) {
+  if (len != ACK_LEN || frame[0] != FRAME_MAGIC || frame[1] != TYPE_ACK) return false;
+  if (!sealed(signer, nodeId, frame, ACK_LEN - HmacSigner::MAC_LEN)) return false;
+  out.seq = getU32(frame + 2);
+  out.epochMs = getU32(frame + 6) | static_cast<uint64_t>(getU32(frame + 10)) << 32;
+  return true;
+}
+
+size_t espnowEncodeStale(HmacSigner &signer, const char *nodeId, const EspNowStale &stale, uint8_t *out,
+                         size_t cap) {
+  if (cap < STALE_LEN) return 0;
+  out[0] = FRAME_MAGIC;
+  out[1] = TYPE_STALE;
+  putU32(out + 2, stale.seq);
+  putU32(out + 6, stale.floor);
+  seal(signer, nodeId, out, STALE_LEN - HmacSigner::MAC_LEN);
+  return STALE_LEN;
+}
+
+bool espnowDecodeStale(HmacSigner &signer, const char *nodeId, const uint8_t *frame, size_t len,
+                       EspNowStale &out) {
+  if (len != STALE_LEN || frame[0] != FRAME_MAGIC || frame[1] != TYPE_STALE) return false;
+  if (!sealed(signer, nodeId, frame, STALE_LEN - HmacSigner::MAC_LEN)) return false;
+  out.seq = getU32(frame + 2);
+  out.floor = getU32(frame + 6);
+  return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "reading.h"
+#include "signing.h"
+
+// ESP-NOW frames between leaf nodes and a gateway (src/espnow_link.h). All
+// integers are little-endian and every frame ends in an HMAC-SHA256 under
+// the shared ESPNOW_SECRET.
+//
+//   reading: E5 03 seq:u32 sentAt:u32 idLen:u8 id sizeof(Reading):u8 Reading mac[32]
+//   ack:     E5 02 seq:u32 epochMs:u64 mac[32]
+//   stale:   E5 04 seq:u32 floor:u32 mac[32]
+//
+// The reading is copied as raw bytes: leaves and gateway run this firmware
+// on the same chip, and the size byte rejects frames from a build whose
+// Reading differs in size. A change that keeps the size bumps the type
+// instead (03: Reading::sensors). `seq` only ever grows per leaf and is the
+// replay guard. `sentAt` is the leaf's clock at send time, so the gateway can
+// move sample times onto its own clock. Acks and stale replies are MACed
+// over the leaf id too, without carrying it, so each is only good for the
+// leaf and frame it answers. `epochMs` is the gateway's time, or 0 while it
+// has none. A stale reply refuses a frame whose seq is not above `floor`,
+// the bound a restarted gateway keeps for the leaf; the leaf renumbers the
+// reading past it and sends it again.
+
+// esp_now_send() payload limit (ESP_NOW_MAX_DATA_LEN).
+static const size_t ESPNOW_FRAME_MAX = 250;
+static const size_t ESPNOW_ID_MAX = 31;
+
+struct EspNowReading {
+  uint32_t seq;
+  uint32_t sentAt;
+  char nodeId[ESPNOW_ID_MAX + 1];
+  Reading reading;
+};
+
+struct EspNowAck {
+  uint32_t seq;
+  uint64_t epochMs;
+};
+
+struct EspNowStale {
+  uint32_t seq;
+  uint32_t floor;
+};
+
+// Return the frame length, or 0 if nodeId is too long or `cap` too small.
+size_t espnowEncodeReading(HmacSigner &signer, const char *nodeId, uint32_t seq, uint32_t sentAt,
+                           const Reading &r, uint8_t *out, size_t cap);
+size_t espnowEncodeAck(HmacSigner &signer, const char *nodeId, const EspNowAck &ack, uint8_t *out, size_t cap);
+size_t espnowEncodeStale(HmacSigner &signer, const char *nodeId, const EspNowStale &stale, uint8_t *out,
+                         size_t cap);
+
+// False for anything malformed or not signed with the signer's key.
+bool espnowDecodeReading(HmacSigner &signer, const uint8_t *frame, size_t len, EspNowReading &out);
+bool espnowDecodeAck(HmacSigner &signer, const char *nodeId, const uint8_t *frame, size_t len, EspNowAck &out);
+bool espnowDecodeStale(HmacSigner &signer, const char *nodeId, const uint8_t *frame, size_t len,
+                       EspNowStale &out);
+
+static_assert(2 + 4 + 4 + 1 + ESPNOW_ID_MAX + 1 + sizeof(Reading) + HmacSigner::MAC_LEN <= ESPNOW_FRAME_MAX,
+              "Reading no longer fits an ESP-NOW frame");
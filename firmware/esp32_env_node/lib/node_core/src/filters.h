@@ -0,0 +1,85 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+// Fixed-size, heap-free per-channel filters. State is plain data with no
+// constructors so it can sit in RTC memory across deep sleep; call reset()
+// before first use. Parameters are passed per call for the same reason.
+// NAN inputs pass straight through and leave the state untouched.
+
+// The last N samples, oldest evicted first; median() is the rolling median.
+template <size_t N>
+struct RollingWindow {
+  static_assert(N > 0 && N < 256, "RollingWindow size must be 1..255");
+
+  float values[N];
+  uint8_t count;
+  uint8_t head;
+
+  void reset() {
+    count = 0;
+    head = 0;
+  }
+
+  void push(float v) {
+    values[head] = v;
+    head = (head + 1) % N;
+    if (count < N) count++;
+  }
+
+  float median() const {
+    float tmp[N];
+    std::copy(values, values + count, tmp);
+    return medianOf(tmp, count);
+  }
+
+  // Sorts buf[0..n) in place.
+  static float medianOf(float *buf, size_t n) {
+    if (n == 0) return NAN;
+    std::sort(buf, buf + n);
+    return n % 2 ? buf[n / 2] : 0.5f * (buf[n / 2 - 1] + buf[n / 2]);
+  }
+};
+
+struct Ema {
+  float value;
+  bool primed;
+
+  void reset() { primed = false; }
+
+  // alpha in (0, 1]; larger follows the input more closely.
+  float apply(float x, float alpha) {
+    if (isnan(x)) return x;
+    value = primed ? value + alpha * (x - value) : x;
+    primed = true;
+    return value;
+  }
+};
+
+// Causal Hampel identifier: a sample further than k scaled MADs from the
+// median of the window (itself included) is replaced by that median. The
+// raw sample still enters the window, so a genuine level shift is accepted
+// once it holds for half the window. minDeviation keeps a flat window (MAD 0)
+// from rejecting every small change.
+template <size_t N>
+struct HampelFilter {
+  RollingWindow<N> window;
+
+  void reset() { window.reset(); }
+
+  float apply(float x, float k, float minDeviation) {
+    if (isnan(x)) return x;
+    window.push(x);
+    if (window.count < 3) return x;
+    const float m = window.median();
+    float dev[N];
+    for (uint8_t i = 0; i < window.count; i++) dev[i] = fabsf(window.values[i] - m);
+    const float mad = 1.4826f * RollingWindow<N>::medianOf(dev, window.count);
+    const float limit = std::max(k * mad, minDeviation);
+    return fabsf(x - m) > limit ? m : x;
+  }
+};
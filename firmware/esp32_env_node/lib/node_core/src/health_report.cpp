@@ -0,0 +1,6 @@
+#include "health_report.h"
+
+const char *const NodeHealth::RESET_NAMES[HEALTH_RESET_COUNT] = {"unknown",  "power_on", "external",
+                                                                 "software", "panic",    "int_wdt",
+                                                                 "task_wdt", "wdt",      "brownout"};
+const char *const NodeHealth::TASK_NAMES[HEALTH_TASK_COUNT] = {"sensors", "net"};
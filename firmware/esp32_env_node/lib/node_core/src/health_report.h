@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "stage_histograms.h"
+
+// Node health as attached to uploads next to "diag" (src/health.h keeps it).
+// Plain data so the payload code can serialize it on any host:
+//   {"reset": "task_wdt", "uptime_s": 86400, "stuck": "net:tls",
+//    "wdt_resets": 1, "fails": {"bme": 0, "sds": 2, "upload": 0}, "recoveries": 3}
+// "stuck" names the watched task that stopped checking in before the last
+// watchdog reset and the timing stage it was in; it is left out otherwise.
+enum HealthTask : uint8_t {
+  HEALTH_TASK_SENSORS,
+  HEALTH_TASK_NETWORK,
+  HEALTH_TASK_COUNT
+};
+
+enum HealthReset : uint8_t {
+  HEALTH_RESET_UNKNOWN,
+  HEALTH_RESET_POWER_ON,
+  HEALTH_RESET_EXTERNAL,
+  HEALTH_RESET_SOFTWARE,
+  HEALTH_RESET_PANIC,
+  HEALTH_RESET_INT_WDT,
+  HEALTH_RESET_TASK_WDT,
+  HEALTH_RESET_OTHER_WDT,
+  HEALTH_RESET_BROWNOUT,
+  HEALTH_RESET_COUNT
+};
+
+struct NodeHealth {
+  static const char *const RESET_NAMES[HEALTH_RESET_COUNT];
+  static const char *const TASK_NAMES[HEALTH_TASK_COUNT];
+
+  uint8_t reset;      // HealthReset of the last reset; deep-sleep wakes do not count
+  uint32_t uptimeS;   // since that reset, deep sleep included
+  uint8_t stuckTask;  // HEALTH_TASK_COUNT if the last reset was not a watchdog's
+  uint8_t stuckStage; // STAGE_COUNT if the stuck task was outside any stage
+  uint16_t wdtResets; // watchdog resets since power-on
+  uint16_t bmeFails;  // consecutive, as of the upload
+  uint16_t sdsFails;
+  uint16_t uploadFails;
+  uint16_t recoveries; // sensor reinits, Wi-Fi restarts and reboots since power-on
+};
@@ -0,0 +1,274 @@
+#include "payload.h"
+
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <string.h>
+
+// Per-reading JSON cost: the wrapper object plus the data fields.
+static const size_t READING_JSON_SIZE =
+    JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(12 + DS18B20_MAX_PROBES) + 3 * JSON_ARRAY_SIZE(4);
+
+// Keys for the second and later DS18B20 probes.
+static const char *const PROBE_KEYS[] = {"water_temp_c_2", "water_temp_c_3", "water_temp_c_4"};
+static_assert(DS18B20_MAX_PROBES <= 1 + sizeof(PROBE_KEYS) / sizeof(PROBE_KEYS[0]), "add PROBE_KEYS entries");
+
+// [mean, median, min, max] in millivolts.
+static void fillStats(JsonObject data, const char *key, const AnalogStats &mv) {
+  JsonArray arr = data.createNestedArray(key);
+  arr.add(mv.mean);
+  arr.add(mv.median);
+  arr.add(mv.min);
+  arr.add(mv.max);
+}
+
+// Only the fields of sensors in r.sensors are written; the backend treats a
+// missing field as null. Sensors switched off at runtime read NAN, which is
+// written as null (the ADC channels are not in r.sensors then).
+static void fillData(JsonObject data, const Reading &r) {
+  if (r.sensors & SENSOR_GEIGER) data["radiation_cpm"] = r.radiationUsvh;
+  if (r.sensors & SENSOR_SDS011) data["pm25"] = r.pm25;
+  if (r.sensors & SENSOR_BME680) {
+    data["air_temp_c"] = r.tempC;
+    data["humidity"] = r.hum;
+    data["pressure_hpa"] = r.pressHpa;
+    data["voc"] = r.voc;
+  }
+  if (r.sensors & SENSOR_DS18B20) {
+    if (!isnan(r.waterTempC[0])) {
+      data["water_temp_c"] = r.waterTempC[0];
+    } else {
+      data["water_temp_c"] = nullptr;
+    }
+    for (uint8_t i = 1; i < DS18B20_MAX_PROBES; i++) {
+      if (isnan(r.waterTempC[i])) continue;
+      data[PROBE_KEYS[i - 1]] = r.waterTempC[i];
+    }
+  }
+  if (r.sensors & SENSOR_WATER_ADC) {
+    data["turbidity_raw"] = r.turbidityRaw;
+    data["tds_raw"] = r.tdsRaw;
+    data["ph_raw"] = r.phRaw;
+    fillStats(data, "turbidity_mv", r.turbidityMv);
+    fillStats(data, "tds_mv", r.tdsMv);
+    fillStats(data, "ph_mv", r.phMv);
+  }
+}
+
+static void addColumn(JsonArray row, bool measured, float value) {
+  if (measured && !isnan(value)) {
+    row.add(value);
+  } else {
+    row.add(nullptr);
+  }
+}
+
+// Schema v1 row for the MessagePack format; the column order is mirrored by
+// SCHEMAS in backend/wire_format.py. Columns outside r.sensors are nil.
+static void fillRow(JsonArray row, const Reading &r) {
+  const bool bme = (r.sensors & SENSOR_BME680) != 0;
+  const bool adc = (r.sensors & SENSOR_WATER_ADC) != 0;
+  const bool probes = (r.sensors & SENSOR_DS18B20) != 0;
+  row.add(static_cast<long>(r.epoch));
+  addColumn(row, (r.sensors & SENSOR_GEIGER) != 0, r.radiationUsvh);
+  addColumn(row, (r.sensors & SENSOR_SDS011) != 0, r.pm25);
+  addColumn(row, bme, r.tempC);
+  addColumn(row, bme, r.hum);
+  addColumn(row, bme, r.pressHpa);
+  addColumn(row, bme, r.voc);
+  addColumn(row, probes, r.waterTempC[0]);
+  const uint16_t raws[3] = {r.turbidityRaw, r.tdsRaw, r.phRaw};
+  for (uint16_t raw : raws) {
+    if (adc) {
+      row.add(raw);
+    } else {
+      row.add(nullptr);
+    }
+  }
+  const AnalogStats *stats[3] = {&r.turbidityMv, &r.tdsMv, &r.phMv};
+  for (const AnalogStats *mv : stats) {
+    if (!adc) {
+      row.add(nullptr);
+      continue;
+    }
+    JsonArray arr = row.createNestedArray();
+    arr.add(mv->mean);
+    arr.add(mv->median);
+    arr.add(mv->min);
+    arr.add(mv->max);
+  }
+  for (uint8_t i = 1; i < DS18B20_MAX_PROBES; i++) {
+    addColumn(row, probes, r.waterTempC[i]);
+  }
+}
+
+// Diag block: bucket edges plus, per stage that has samples, its bucket
+// counts and maximum.
+static const size_t DIAG_JSON_SIZE = JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(StageHistograms::EDGES) +
+                                     2 * JSON_OBJECT_SIZE(STAGE_COUNT) +
+                                     STAGE_COUNT * JSON_ARRAY_SIZE(StageHistograms::BUCKETS);
+using DiagDocument = StaticJsonDocument<DIAG_JSON_SIZE>;
+
+static bool fillDiag(DiagDocument &doc, const StageHistograms &h) {
+  JsonArray edges = doc.createNestedArray("edges_us");
+  for (uint32_t e : StageHistograms::EDGES_US) edges.add(e);
+  JsonObject hist = doc.createNestedObject("hist");
+  JsonObject maxUs = doc.createNestedObject("max_us");
+  bool any = false;
+  for (uint8_t s = 0; s < STAGE_COUNT; s++) {
+    if (h.total(static_cast<Stage>(s)) == 0) continue;
+    JsonArray counts = hist.createNestedArray(StageHistograms::NAMES[s]);
+    for (uint16_t c : h.counts[s]) counts.add(c);
+    maxUs[StageHistograms::NAMES[s]] = h.maxUs[s];
+    any = true;
+  }
+  return any && !doc.overflowed();
+}
+
+// Health block; "stuck" only after a watchdog reset.
+using HealthDocument = StaticJsonDocument<JSON_OBJECT_SIZE(7) + JSON_OBJECT_SIZE(3) + 32>;
+
+static void fillHealth(HealthDocument &doc, const NodeHealth &h) {
+  doc["reset"] = NodeHealth::RESET_NAMES[h.reset < HEALTH_RESET_COUNT ? h.reset : HEALTH_RESET_UNKNOWN];
+  doc["uptime_s"] = h.uptimeS;
+  if (h.stuckTask < HEALTH_TASK_COUNT) {
+    char stuck[32];
+    snprintf(stuck, sizeof(stuck), "%s:%s", NodeHealth::TASK_NAMES[h.stuckTask],
+             h.stuckStage < STAGE_COUNT ? StageHistograms::NAMES[h.stuckStage] : "none");
+    doc["stuck"] = stuck; // copied into the document's pool
+  }
+  doc["wdt_resets"] = h.wdtResets;
+  JsonObject fails = doc.createNestedObject("fails");
+  fails["bme"] = h.bmeFails;
+  fails["sds"] = h.sdsFails;
+  fails["upload"] = h.uploadFails;
+  doc["recoveries"] = h.recoveries;
+}
+
+// Appends raw bytes; false if they do not fit.
+static bool appendBytes(char *out, size_t cap, size_t &pos, const void *data, size_t n) {
+  if (pos + n >= cap) return false;
+  memcpy(out + pos, data, n);
+  pos += n;
+  out[pos] = '\0';
+  return true;
+}
+
+// Appends a NUL-terminated literal; false if it does not fit.
+static bool append(char *out, size_t cap, size_t &pos, const char *text) {
+  return appendBytes(out, cap, pos, text, strlen(text));
+}
+
+// MessagePack str header + bytes (fixstr or str8).
+static bool appendMsgPackStr(char *out, size_t cap, size_t &pos, const char *text) {
+  const size_t n = strlen(text);
+  if (n > 0xFF) return false;
+  uint8_t hdr[2];
+  size_t hdrLen = 1;
+  if (n < 32) {
+    hdr[0] = static_cast<uint8_t>(0xA0 | n);
+  } else {
+    hdr[0] = 0xD9;
+    hdr[1] = static_cast<uint8_t>(n);
+    hdrLen = 2;
+  }
+  return appendBytes(out, cap, pos, hdr, hdrLen) && appendBytes(out, cap, pos, text, n);
+}
+
+static size_t buildJson(const Reading *items, size_t count, const DiagDocument *diag,
+                        const HealthDocument *health, const char *deviceId, char *out, size_t cap, size_t &len) {
+  // The envelope is written by hand and each reading is serialized from a
+  // stack document straight into `out`, so nothing touches the heap.
+  size_t pos = 0;
+  if (!append(out, cap, pos, "{\"device_id\":\"") || !append(out, cap, pos, deviceId) ||
+      !append(out, cap, pos, "\",\"readings\":[")) {
+    return 0;
+  }
+  // "]}", plus ',"diag":{...}' and ',"health":{...}' when attached.
+  const size_t tailLen = 2 + (diag ? strlen(",\"diag\":") + measureJson(*diag) : 0) +
+                         (health ? strlen(",\"health\":") + measureJson(*health) : 0);
+  size_t written = 0;
+  for (; written < count; written++) {
+    StaticJsonDocument<READING_JSON_SIZE> doc;
+    const Reading &r = items[written];
+    doc["timestamp"] = static_cast<long>(r.epoch);
+    fillData(doc.createNestedObject("data"), r);
+    const size_t sep = written > 0 ? 1 : 0;
+    const size_t need = measureJson(doc) + sep;
+    if (doc.overflowed() || pos + need + tailLen >= cap) break;
+    if (sep) out[pos++] = ',';
+    pos += serializeJson(doc, out + pos, cap - pos);
+  }
+  if (written == 0) return 0;
+  append(out, cap, pos, "]");
+  if (diag) {
+    append(out, cap, pos, ",\"diag\":");
+    pos += serializeJson(*diag, out + pos, cap - pos);
+  }
+  if (health) {
+    append(out, cap, pos, ",\"health\":");
+    pos += serializeJson(*health, out + pos, cap - pos);
+  }
+  append(out, cap, pos, "}");
+  len = pos;
+  return written;
+}
+
+static size_t buildMsgPack(const Reading *items, size_t count, const DiagDocument *diag,
+                           const HealthDocument *health, const char *deviceId, char *out, size_t cap,
+                           size_t &len) {
+  // {"v": 1, "device_id": deviceId, "readings": [row, ...], "diag": {...}, "health": {...}}
+  // with the array length patched in once we know how many rows fit.
+  const uint8_t mapHeader = static_cast<uint8_t>(0x83 + (diag ? 1 : 0) + (health ? 1 : 0));
+  static const uint8_t SCHEMA_V1 = 0x01;
+  // fixstr "diag" / "health" + map
+  const size_t tailLen = (diag ? 5 + measureMsgPack(*diag) : 0) + (health ? 7 + measureMsgPack(*health) : 0);
+  size_t pos = 0;
+  if (!appendBytes(out, cap, pos, &mapHeader, 1) || !appendMsgPackStr(out, cap, pos, "v") ||
+      !appendBytes(out, cap, pos, &SCHEMA_V1, 1) || !appendMsgPackStr(out, cap, pos, "device_id") ||
+      !appendMsgPackStr(out, cap, pos, deviceId) || !appendMsgPackStr(out, cap, pos, "readings")) {
+    return 0;
+  }
+  const size_t countPos = pos;
+  static const uint8_t ARRAY16[3] = {0xDC, 0, 0};
+  if (!appendBytes(out, cap, pos, ARRAY16, sizeof(ARRAY16))) return 0;
+
+  size_t written = 0;
+  for (; written < count && written < 0xFFFF; written++) {
+    StaticJsonDocument<READING_JSON_SIZE> doc;
+    fillRow(doc.to<JsonArray>(), items[written]);
+    if (doc.overflowed() || pos + measureMsgPack(doc) + tailLen >= cap) break;
+    pos += serializeMsgPack(doc, out + pos, cap - pos);
+  }
+  if (written == 0) return 0;
+  if (diag) {
+    appendMsgPackStr(out, cap, pos, "diag");
+    pos += serializeMsgPack(*diag, out + pos, cap - pos);
+  }
+  if (health) {
+    appendMsgPackStr(out, cap, pos, "health");
+    pos += serializeMsgPack(*health, out + pos, cap - pos);
+  }
+  out[countPos + 1] = static_cast<char>((written >> 8) & 0xFF);
+  out[countPos + 2] = static_cast<char>(written & 0xFF);
+  len = pos;
+  return written;
+}
+
+size_t buildBatchBody(const Reading *items, size_t count, char *out, size_t cap, size_t &len,
+                      const StageHistograms *diag, const char *deviceId, const NodeHealth *health) {
+  len = 0;
+  if (count == 0 || cap == 0) return 0;
+  DiagDocument diagDoc;
+  const DiagDocument *attach = diag && fillDiag(diagDoc, *diag) ? &diagDoc : nullptr;
+  HealthDocument healthDoc;
+  if (health) fillHealth(healthDoc, *health);
+  const HealthDocument *attachHealth = health && !healthDoc.overflowed() ? &healthDoc : nullptr;
+  if (PAYLOAD_FORMAT == PAYLOAD_FORMAT_MSGPACK) {
+    return buildMsgPack(items, count, attach, attachHealth, deviceId, out, cap, len);
+  }
+  return buildJson(items, count, attach, attachHealth, deviceId, out, cap, len);
+}
+
+const char *payloadContentType() {
+  return PAYLOAD_FORMAT == PAYLOAD_FORMAT_MSGPACK ? "application/msgpack" : "application/json";
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "health_report.h"
+#include "reading.h"
+#include "stage_histograms.h"
+
+// Serializes readings (oldest first) as one batch body into `out`. With
+// PAYLOAD_FORMAT_JSON:
+//   {"device_id": NODE_ID, "readings": [{"timestamp": ..., "data": {...}}, ...]}
+// With PAYLOAD_FORMAT_MSGPACK, a MessagePack map with positional rows
+// (schema "v": 1) instead of per-field keys:
+//   {"v": 1, "device_id": NODE_ID, "readings": [[ts, radiation, pm25, ...], ...]}
+// The whole body is covered by a single request signature. Writes as many
+// readings as fit in `cap` bytes, stores the body length in `len` and
+// returns the number of readings written (0 if not even one fits). When
+// `diag` is given and has samples it is added as a top-level "diag" object:
+//   {"edges_us": [...], "hist": {"<stage>": [counts...]}, "max_us": {"<stage>": us}}
+// and `health`, when given, as a top-level "health" object (health_report.h).
+// `deviceId` only differs from NODE_ID when one process speaks for many
+// nodes (tools/loadgen, an ESP-NOW gateway).
+size_t buildBatchBody(const Reading *items, size_t count, char *out, size_t cap, size_t &len,
+                      const StageHistograms *diag = nullptr, const char *deviceId = NODE_ID,
+                      const NodeHealth *health = nullptr);
+
+const char *payloadContentType();
+
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include "config_defaults.h"
+#include "ring_buffer.h"
+
+// Calibrated millivolt statistics of one analog channel over a sample interval.
+struct AnalogStats {
+  uint16_t mean;
+  uint16_t median;
+  uint16_t min;
+  uint16_t max;
+};
+
+// One sample as queued on the node. Kept flat and fixed-size so it can live
+// in ring buffers (and later flash/RTC memory) without any allocation.
+struct Reading {
+  uint32_t epoch;       // UTC seconds at sample time
+  float radiationUsvh;
+  float pm25;
+  float tempC;
+  float hum;
+  float pressHpa;
+  float voc;
+  float waterTempC[DS18B20_MAX_PROBES]; // NAN when a probe gave no reading
+  uint16_t turbidityRaw; // per-interval median of the raw ADC counts
+  uint16_t tdsRaw;
+  uint16_t phRaw;
+  AnalogStats turbidityMv;
+  AnalogStats tdsMv;
+  AnalogStats phMv;
+  // Whose reading this is: 0 for this node, n for ESPNOW_LEAVES entry n-1
+  // on a gateway (espnow_link.h).
+  uint8_t source;
+  // SENSOR_* bits whose fields the payload writes: the NODE_SENSORS of the
+  // node that took the reading, without SENSOR_WATER_ADC while its node
+  // config has the ADC switched off. A gateway relays readings of leaves
+  // built for other profiles than its own.
+  uint8_t sensors;
+};
+
+using ReadingBuffer = RingBuffer<Reading, READING_BUFFER_CAPACITY>;
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+
+// Fixed-capacity FIFO with no heap use. push() on a full buffer evicts the
+// oldest element so the most recent samples are always kept.
+template <typename T, size_t N>
+class RingBuffer {
+ public:
+  static_assert(N > 0, "RingBuffer capacity must be non-zero");
+
+  // Returns false if an old element had to be evicted to make room.
+  bool push(const T &item) {
+    bool evicted = false;
+    if (_count == N) {
+      _head = (_head + 1) % N;
+      _count--;
+      evicted = true;
+    }
+    _items[(_head + _count) % N] = item;
+    _count++;
+    return !evicted;
+  }
+
+  // i = 0 is the oldest element.
+  const T &at(size_t i) const { return _items[(_head + i) % N]; }
+  T &at(size_t i) { return _items[(_head + i) % N]; }
+  const T &front() const { return at(0); }
+
+  // Copies up to n of the oldest elements into dst; returns how many.
+  size_t copyOut(T *dst, size_t n) const {
+    if (n > _count) n = _count;
+    for (size_t i = 0; i < n; i++) dst[i] = at(i);
+    return n;
+  }
+
+  void pop(size_t n = 1) {
+    if (n > _count) n = _count;
+    _head = (_head + n) % N;
+    _count -= n;
+  }
+
+  void clear() {
+    _head = 0;
+    _count = 0;
+  }
+
+  size_t size() const { return _count; }
+  bool empty() const { return _count == 0; }
+  bool full() const { return _count == N; }
+  static constexpr size_t capacity() { return N; }
+
+ private:
+  T _items[N];
+  size_t _head = 0;
+  size_t _count = 0;
+};
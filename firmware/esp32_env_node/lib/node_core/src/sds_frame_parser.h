@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+
+// Incremental SDS011 frame parser. Bytes are fed one at a time as they
+// arrive; the header, command, checksum and tail are validated as they come
+// in, so a corrupt or truncated frame is rejected (and the parser
+// resynchronises on the next 0xAA) without buffering or waiting.
+//
+// Measurement: AA C0 pm25_lo pm25_hi pm10_lo pm10_hi id_lo id_hi checksum AB
+// Reply:       AA C5 cmd arg1 arg2 arg3 id_lo id_hi checksum AB
+class SdsFrameParser {
+ public:
+  static const uint8_t FRAME_LEN = 10;
+  static const uint8_t HEADER = 0xAA;
+  static const uint8_t CMD_DATA = 0xC0;
+  static const uint8_t CMD_REPLY = 0xC5;
+  static const uint8_t TAIL = 0xAB;
+
+  enum Frame : uint8_t { NONE, DATA, REPLY };
+
+  // Returns what kind of valid frame `b` completes, or NONE.
+  Frame feed(uint8_t b) {
+    switch (_pos) {
+      case 0:
+        if (b == HEADER) _buf[_pos++] = b;
+        return NONE;
+      case 1:
+        if (b == CMD_DATA || b == CMD_REPLY) {
+          _buf[_pos++] = b;
+        } else {
+          _framingErrors++;
+          _pos = (b == HEADER) ? 1 : 0;
+        }
+        return NONE;
+      case 8: {
+        uint8_t sum = 0;
+        for (uint8_t i = 2; i < 8; i++) sum += _buf[i];
+        if (sum != b) {
+          _checksumErrors++;
+          _pos = (b == HEADER) ? 1 : 0;
+          return NONE;
+        }
+        _buf[_pos++] = b;
+        return NONE;
+      }
+      case 9:
+        _pos = 0;
+        if (b != TAIL) {
+          _framingErrors++;
+          if (b == HEADER) _pos = 1;
+          return NONE;
+        }
+        if (_buf[1] == CMD_REPLY) {
+          _replyCmd = _buf[2];
+          _replyArgs[0] = _buf[3];
+          _replyArgs[1] = _buf[4];
+          _replyArgs[2] = _buf[5];
+          _replies++;
+          return REPLY;
+        }
+        _pm25Raw = static_cast<uint16_t>(_buf[2] | (_buf[3] << 8));
+        _pm10Raw = static_cast<uint16_t>(_buf[4] | (_buf[5] << 8));
+        _frames++;
+        return DATA;
+      default:
+        _buf[_pos++] = b;
+        return NONE;
+    }
+  }
+
+  void reset() { _pos = 0; }
+
+  // Values are in units of 0.1 ug/m3.
+  uint16_t pm25Raw() const { return _pm25Raw; }
+  uint16_t pm10Raw() const { return _pm10Raw; }
+  // Last command reply: the command it answers and its first three data bytes.
+  uint8_t replyCommand() const { return _replyCmd; }
+  uint8_t replyArg(uint8_t i) const { return i < 3 ? _replyArgs[i] : 0; }
+
+  uint32_t frames() const { return _frames; }
+  uint32_t replies() const { return _replies; }
+  uint32_t checksumErrors() const { return _checksumErrors; }
+  uint32_t framingErrors() const { return _framingErrors; }
+
+ private:
+  uint8_t _buf[FRAME_LEN] = {};
+  uint8_t _pos = 0;
+  uint16_t _pm25Raw = 0;
+  uint16_t _pm10Raw = 0;
+  uint8_t _replyCmd = 0;
+  uint8_t _replyArgs[3] = {};
+  uint32_t _frames = 0;
+  uint32_t _replies = 0;
+  uint32_t _checksumErrors = 0;
+  uint32_t _framingErrors = 0;
+};
+
+// Host-to-sensor command: AA B4 cmd data[1..12] FF FF checksum AB, where the
+// checksum is the low byte of the sum of bytes 2..16. FF FF addresses every
+// sensor on the line.
+struct SdsCommand {
+  static const uint8_t LEN = 19;
+  static const uint8_t CMD_HOST = 0xB4;
+
+  enum Id : uint8_t {
+    REPORTING_MODE = 0x02,  // arg1: 1 = set; arg2: 0 = active, 1 = query
+    QUERY = 0x04,           // answered with a measurement frame
+    SLEEP_WORK = 0x06,      // arg1: 1 = set; arg2: 0 = sleep, 1 = work
+    WORKING_PERIOD = 0x08,  // arg1: 1 = set; arg2: minutes, 0 = continuous
+  };
+
+  static void build(Id id, uint8_t arg1, uint8_t arg2, uint8_t (&out)[LEN]) {
+    for (uint8_t i = 0; i < LEN; i++) out[i] = 0;
+    out[0] = SdsFrameParser::HEADER;
+    out[1] = CMD_HOST;
+    out[2] = id;
+    out[3] = arg1;
+    out[4] = arg2;
+    out[15] = 0xFF;
+    out[16] = 0xFF;
+    uint8_t sum = 0;
+    for (uint8_t i = 2; i < 17; i++) sum += out[i];
+    out[17] = sum;
+    out[18] = SdsFrameParser::TAIL;
+  }
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <math.h>
+
+// Simple monotonic mapping from gas resistance to pseudo-VOC (placeholder)
+inline float gasToVoc(float gasOhms) {
+  // Typical clean air ~100k-500k Ohms; map to ~100-300 ppb-like scale.
+  if (gasOhms <= 0) return 150.0f;
+  float logVal = log10f(gasOhms);
+  float voc = 50.0f + (logVal * 80.0f); // tweak to ~100-300 range
+  if (voc < 50.0f) voc = 50.0f;
+  if (voc > 800.0f) voc = 800.0f; // cap
+  return voc;
+}
@@ -0,0 +1,111 @@
+#include "signing.h"
+
+#include <mbedtls/version.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <esp_system.h>
+#else
+#include <random>
+#endif
+
+#if MBEDTLS_VERSION_MAJOR >= 3
+// Host builds may link mbedTLS 3, which dropped the _ret names (IDF 4.4 ships 2.28).
+#define mbedtls_sha256_ret mbedtls_sha256
+#define mbedtls_sha256_starts_ret mbedtls_sha256_starts
+#define mbedtls_sha256_update_ret mbedtls_sha256_update
+#define mbedtls_sha256_finish_ret mbedtls_sha256_finish
+#endif
+
+void toHex(const uint8_t *data, size_t len, char *out) {
+  static const char hexChars[] = "0123456789abcdef";
+  for (size_t i = 0; i < len; i++) {
+    out[i * 2] = hexChars[(data[i] >> 4) & 0x0F];
+    out[i * 2 + 1] = hexChars[data[i] & 0x0F];
+  }
+  out[len * 2] = '\0';
+}
+
+void makeNonce(char (&out)[NONCE_HEX_LEN + 1]) {
+  uint8_t buf[NONCE_HEX_LEN / 2];
+#ifdef ARDUINO
+  esp_fill_random(buf, sizeof(buf));
+#else
+  static thread_local std::random_device rng; // tools/loadgen signs from several threads
+  for (uint8_t &b : buf) b = static_cast<uint8_t>(rng());
+#endif
+  toHex(buf, sizeof(buf), out);
+}
+
+bool signatureEquals(const char (&expected)[SIGNATURE_HEX_LEN + 1], const char *sigHex) {
+  if (!sigHex || strlen(sigHex) != SIGNATURE_HEX_LEN) return false;
+  uint8_t diff = 0;
+  for (size_t i = 0; i < SIGNATURE_HEX_LEN; i++) diff |= expected[i] ^ sigHex[i];
+  return diff == 0;
+}
+
+void HmacSigner::begin(const char *secret) {
+  uint8_t key[BLOCK_LEN] = {};
+  const size_t keyLen = strlen(secret);
+  if (keyLen > BLOCK_LEN) {
+    mbedtls_sha256_ret(reinterpret_cast<const unsigned char *>(secret), keyLen, key, 0);
+  } else {
+    memcpy(key, secret, keyLen);
+  }
+  uint8_t opad[BLOCK_LEN];
+  for (size_t i = 0; i < BLOCK_LEN; i++) {
+    _ipad[i] = key[i] ^ 0x36;
+    opad[i] = key[i] ^ 0x5c;
+  }
+
+  // Clone out of a scratch context: the clone is a plain software state, and
+  // freeing the scratch one hands the SHA engine back to TLS.
+  mbedtls_sha256_context scratch;
+  mbedtls_sha256_init(&scratch);
+  mbedtls_sha256_starts_ret(&scratch, 0);
+  mbedtls_sha256_update_ret(&scratch, opad, sizeof(opad));
+  mbedtls_sha256_init(&_outerMid);
+  mbedtls_sha256_clone(&_outerMid, &scratch);
+  mbedtls_sha256_free(&scratch);
+  memset(key, 0, sizeof(key));
+  memset(opad, 0, sizeof(opad));
+}
+
+void HmacSigner::start() {
+  mbedtls_sha256_init(&_inner);
+  mbedtls_sha256_starts_ret(&_inner, 0);
+  mbedtls_sha256_update_ret(&_inner, _ipad, sizeof(_ipad));
+}
+
+void HmacSigner::update(const void *data, size_t len) {
+  mbedtls_sha256_update_ret(&_inner, static_cast<const unsigned char *>(data), len);
+}
+
+void HmacSigner::finish(uint8_t (&mac)[MAC_LEN]) {
+  uint8_t innerHash[MAC_LEN];
+  mbedtls_sha256_finish_ret(&_inner, innerHash);
+  mbedtls_sha256_free(&_inner);
+
+  mbedtls_sha256_context outer;
+  mbedtls_sha256_init(&outer);
+  mbedtls_sha256_clone(&outer, &_outerMid);
+  mbedtls_sha256_update_ret(&outer, innerHash, sizeof(innerHash));
+  mbedtls_sha256_finish_ret(&outer, mac);
+  mbedtls_sha256_free(&outer);
+}
+
+void signRequest(HmacSigner &signer, const char *nodeId, const char *ts, const char *nonce,
+                 const uint8_t *body, size_t len, char (&out)[SIGNATURE_HEX_LEN + 1]) {
+  static const char dot = '.';
+  uint8_t mac[HmacSigner::MAC_LEN];
+  signer.start();
+  signer.update(nodeId, strlen(nodeId));
+  signer.update(&dot, 1);
+  signer.update(ts, strlen(ts));
+  signer.update(&dot, 1);
+  signer.update(nonce, strlen(nonce));
+  signer.update(&dot, 1);
+  signer.update(body, len);
+  signer.finish(mac);
+  toHex(mac, sizeof(mac), out);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <mbedtls/sha256.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static const size_t NONCE_HEX_LEN = 16;
+static const size_t SIGNATURE_HEX_LEN = 64;
+
+// Writes 2*len lowercase hex digits plus a terminating NUL to out.
+void toHex(const uint8_t *data, size_t len, char *out);
+
+void makeNonce(char (&out)[NONCE_HEX_LEN + 1]);
+
+// Constant-time check of a received hex signature against the expected one,
+// like hmac.compare_digest() on the backend. False if `sigHex` is missing or
+// has the wrong length.
+bool signatureEquals(const char (&expected)[SIGNATURE_HEX_LEN + 1], const char *sigHex);
+
+// HMAC-SHA256 keyed once at boot. begin() derives the ipad block and hashes
+// the opad block into a saved midstate, so a message costs the inner hash
+// plus one compression for the outer one. The inner hash always starts from
+// a fresh context because the original ESP32's SHA engine cannot resume a
+// saved state; starting fresh lets the long pass over the body run on the
+// hardware accelerator (CONFIG_MBEDTLS_HARDWARE_SHA), while the short outer
+// pass resumes from the midstate in software.
+class HmacSigner {
+ public:
+  static const size_t MAC_LEN = 32;
+
+  void begin(const char *secret);
+  // Streams one message: start(), any number of update() calls, finish().
+  void start();
+  void update(const void *data, size_t len);
+  void finish(uint8_t (&mac)[MAC_LEN]);
+
+ private:
+  static const size_t BLOCK_LEN = 64;
+
+  uint8_t _ipad[BLOCK_LEN];
+  mbedtls_sha256_context _outerMid;
+  mbedtls_sha256_context _inner;
+};
+
+// HMAC-SHA256 over "<nodeId>.<ts>.<nonce>.<body>", the message the backend's
+// verify_signature() rebuilds. The pieces are fed to the HMAC one by one, so
+// the body is hashed straight from the serialization buffer and never copied.
+void signRequest(HmacSigner &signer, const char *nodeId, const char *ts, const char *nonce,
+                 const uint8_t *body, size_t len, char (&out)[SIGNATURE_HEX_LEN + 1]);
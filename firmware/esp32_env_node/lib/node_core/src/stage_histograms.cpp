@@ -0,0 +1,12 @@
+#include "stage_histograms.h"
+
+const uint32_t StageHistograms::EDGES_US[EDGES] = {100,    300,    1000,    3000,    10000,   30000,
+                                                   100000, 300000, 1000000, 3000000, 10000000};
+const char *const StageHistograms::NAMES[STAGE_COUNT] = {"bme", "sds", "ds18b20", "adc", "serialize",
+                                                         "hmac", "dns", "tls", "post"};
+
+uint32_t StageHistograms::total(Stage s) const {
+  uint32_t n = 0;
+  for (uint8_t b = 0; b < BUCKETS; b++) n += counts[s][b];
+  return n;
+}
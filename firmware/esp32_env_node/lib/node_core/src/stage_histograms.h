@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+// Timing stages and the half-decade latency histograms kept per stage.
+// Recording lives in src/stage_timing.h; this part is plain data so the
+// payload code can serialize it on any host.
+enum Stage : uint8_t {
+  STAGE_BME,
+  STAGE_SDS,
+  STAGE_DS18B20,
+  STAGE_ADC,
+  STAGE_SERIALIZE,
+  STAGE_HMAC,
+  STAGE_DNS,
+  STAGE_TLS,
+  STAGE_POST,
+  STAGE_COUNT
+};
+
+struct StageHistograms {
+  // Upper bucket edges in microseconds; the last bucket is open-ended.
+  static const uint8_t EDGES = 11;
+  static const uint8_t BUCKETS = EDGES + 1;
+  static const uint32_t EDGES_US[EDGES];
+  static const char *const NAMES[STAGE_COUNT];
+
+  uint16_t counts[STAGE_COUNT][BUCKETS];
+  uint32_t maxUs[STAGE_COUNT];
+
+  uint32_t total(Stage s) const;
+};
@@ -0,0 +1,165 @@
+#include "adc_sampler.h"
+
+#include <algorithm>
+#include <driver/adc.h>
+
+#include "logger.h"
+
+static const uint32_t DMA_FRAME_BYTES = 256;
+
+void AdcSampler::clear(Accum &a) {
+  a.sum = 0;
+  a.count = 0;
+  a.minRaw = 0xFFFF;
+  a.maxRaw = 0;
+  a.kept = 0;
+  a.sinceKept = 0;
+}
+
+bool AdcSampler::begin(const uint8_t (&pins)[CHANNELS], bool continuous) {
+  for (uint8_t i = 0; i < CHANNELS; i++) {
+    _pins[i] = pins[i];
+    clear(_live[i]);
+  }
+  const esp_adc_cal_value_t calSource =
+      esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &_cal);
+  LOG_INFO("ADC calibration: %s", calSource == ESP_ADC_CAL_VAL_EFUSE_TP     ? "eFuse two-point"
+                                    : calSource == ESP_ADC_CAL_VAL_EFUSE_VREF ? "eFuse Vref"
+                                                                              : "default Vref");
+  if (!ADC_DMA_ENABLED || !continuous) return false;
+
+  uint32_t mask = 0;
+  adc_digi_pattern_config_t pattern[CHANNELS] = {};
+  for (uint8_t i = 0; i < CHANNELS; i++) {
+    const int8_t ch = digitalPinToAnalogChannel(pins[i]);
+    if (ch < 0 || ch > 7) {
+      LOG_WARN("ADC pin %u is not on ADC1; using analogRead bursts", pins[i]);
+      return false;
+    }
+    mask |= BIT(ch);
+    _channelIndex[ch] = i;
+    pattern[i].atten = ADC_ATTEN_DB_11;
+    pattern[i].channel = ch;
+    pattern[i].unit = 0; // ADC1
+    pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  }
+
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = DMA_FRAME_BYTES * 4;
+  init.conv_num_each_intr = DMA_FRAME_BYTES;
+  init.adc1_chan_mask = mask;
+  init.adc2_chan_mask = 0;
+  if (adc_digi_initialize(&init) != ESP_OK) {
+    LOG_ERROR("ADC DMA init failed; using analogRead bursts");
+    return false;
+  }
+
+  adc_digi_configuration_t cfg = {};
+  cfg.conv_limit_en = true;
+  cfg.conv_limit_num = 250;
+  cfg.pattern_num = CHANNELS;
+  cfg.adc_pattern = pattern;
+  cfg.sample_freq_hz = ADC_SAMPLE_RATE_HZ;
+  cfg.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  cfg.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  if (adc_digi_controller_configure(&cfg) != ESP_OK || adc_digi_start() != ESP_OK) {
+    LOG_WARN("ADC DMA configure failed; using analogRead bursts");
+    adc_digi_deinitialize();
+    return false;
+  }
+
+  setIntervalMs(SEND_INTERVAL_MS);
+  _dma = true;
+  xTaskCreatePinnedToCore(readerTask, "adc", 3072, this, 1, nullptr, SENSOR_TASK_CORE);
+  LOG_INFO("ADC DMA running at %u Hz over %u channels", ADC_SAMPLE_RATE_HZ, CHANNELS);
+  return true;
+}
+
+void AdcSampler::setIntervalMs(uint32_t intervalMs) {
+  // Spread the median samples evenly over one sample interval.
+  const uint32_t perInterval = (static_cast<uint64_t>(ADC_SAMPLE_RATE_HZ) / CHANNELS) * intervalMs / 1000;
+  const uint32_t decimation = std::max<uint32_t>(1, perInterval / ADC_MEDIAN_SAMPLES);
+  portENTER_CRITICAL(&_mux);
+  _decimation = decimation;
+  portEXIT_CRITICAL(&_mux);
+}
+
+void AdcSampler::readerTask(void *arg) {
+  static_cast<AdcSampler *>(arg)->readLoop();
+}
+
+void AdcSampler::readLoop() {
+  uint8_t buf[DMA_FRAME_BYTES];
+  for (;;) {
+    uint32_t len = 0;
+    const esp_err_t err = adc_digi_read_bytes(buf, sizeof(buf), &len, 1000);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) continue; // INVALID_STATE: pool overflowed, data still valid
+    portENTER_CRITICAL(&_mux);
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+      const adc_digi_output_data_t *p = reinterpret_cast<const adc_digi_output_data_t *>(&buf[i]);
+      if (p->type1.channel >= 8) continue;
+      const int8_t idx = _channelIndex[p->type1.channel];
+      if (idx < 0) continue;
+      add(_live[idx], p->type1.data);
+    }
+    portEXIT_CRITICAL(&_mux);
+  }
+}
+
+void AdcSampler::add(Accum &a, uint16_t raw) {
+  a.sum += raw;
+  a.count++;
+  if (raw < a.minRaw) a.minRaw = raw;
+  if (raw > a.maxRaw) a.maxRaw = raw;
+  if (a.sinceKept++ % _decimation == 0) {
+    a.median[a.kept % ADC_MEDIAN_SAMPLES] = raw;
+    if (a.kept < 0xFFFF) a.kept++;
+  }
+}
+
+void AdcSampler::reduce(const Accum &a, AdcSummary &out) {
+  out = {};
+  out.samples = a.count;
+  if (a.count == 0) return;
+  uint16_t sorted[ADC_MEDIAN_SAMPLES];
+  const uint16_t n = std::min<uint16_t>(a.kept, ADC_MEDIAN_SAMPLES);
+  std::copy(a.median, a.median + n, sorted);
+  std::nth_element(sorted, sorted + n / 2, sorted + n);
+  const uint16_t medianRaw = sorted[n / 2];
+  const uint16_t meanRaw = static_cast<uint16_t>(a.sum / a.count);
+  out.medianRaw = medianRaw;
+  out.mv.mean = esp_adc_cal_raw_to_voltage(meanRaw, &_cal);
+  out.mv.median = esp_adc_cal_raw_to_voltage(medianRaw, &_cal);
+  out.mv.min = esp_adc_cal_raw_to_voltage(a.minRaw, &_cal);
+  out.mv.max = esp_adc_cal_raw_to_voltage(a.maxRaw, &_cal);
+}
+
+void AdcSampler::summarize(AdcSummary (&out)[CHANNELS]) {
+  if (!_dma) {
+    burstRead(out);
+    return;
+  }
+  portENTER_CRITICAL(&_mux);
+  for (uint8_t i = 0; i < CHANNELS; i++) {
+    _snapshot[i] = _live[i];
+    clear(_live[i]);
+  }
+  portEXIT_CRITICAL(&_mux);
+  for (uint8_t i = 0; i < CHANNELS; i++) reduce(_snapshot[i], out[i]);
+}
+
+void AdcSampler::burstRead(AdcSummary (&out)[CHANNELS]) {
+  for (uint8_t i = 0; i < CHANNELS; i++) {
+    Accum &a = _snapshot[i];
+    clear(a);
+    for (uint16_t s = 0; s < ADC_FALLBACK_SAMPLES; s++) {
+      const uint16_t raw = analogRead(_pins[i]);
+      a.sum += raw;
+      a.count++;
+      if (raw < a.minRaw) a.minRaw = raw;
+      if (raw > a.maxRaw) a.maxRaw = raw;
+      if (a.kept < ADC_MEDIAN_SAMPLES) a.median[a.kept++] = raw;
+    }
+    reduce(a, out[i]);
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_adc_cal.h>
+
+#include "config_defaults.h"
+#include "reading.h"
+
+// Calibrated per-interval statistics for one analog channel.
+struct AdcSummary {
+  uint16_t medianRaw;
+  AnalogStats mv;
+  uint32_t samples;
+};
+
+// Samples the water-quality channels continuously through the ADC DMA
+// controller and reduces everything captured between two summarize() calls
+// to mean/median/min/max, with the eFuse calibration applied.
+class AdcSampler {
+ public:
+  static const uint8_t CHANNELS = 3;
+
+  // continuous=false skips DMA and reads a burst per summarize(), for wakes
+  // that are too short to fill an interval.
+  bool begin(const uint8_t (&pins)[CHANNELS], bool continuous = true);
+  // Closes the current interval and returns its statistics per channel.
+  void summarize(AdcSummary (&out)[CHANNELS]);
+  // Spreads the median samples over an interval of this length from now on;
+  // begin() assumes SEND_INTERVAL_MS.
+  void setIntervalMs(uint32_t intervalMs);
+  bool continuous() const { return _dma; }
+
+ private:
+  struct Accum {
+    uint64_t sum;
+    uint32_t count;
+    uint16_t minRaw;
+    uint16_t maxRaw;
+    uint16_t kept;
+    uint32_t sinceKept;
+    uint16_t median[ADC_MEDIAN_SAMPLES];
+  };
+
+  static void clear(Accum &a);
+  static void readerTask(void *arg);
+  void readLoop();
+  void add(Accum &a, uint16_t raw);
+  void reduce(const Accum &a, AdcSummary &out);
+  void burstRead(AdcSummary (&out)[CHANNELS]);
+
+  uint8_t _pins[CHANNELS] = {};
+  int8_t _channelIndex[8] = {-1, -1, -1, -1, -1, -1, -1, -1}; // ADC1 channel -> our index
+  bool _dma = false;
+  uint32_t _decimation = 1;
+  esp_adc_cal_characteristics_t _cal;
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  Accum _live[CHANNELS];
+  Accum _snapshot[CHANNELS];
+};
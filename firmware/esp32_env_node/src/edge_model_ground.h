@@ -0,0 +1,8 @@
+// Placeholder until a model is exported: run
+//   python backend/scripts/export_edge_model.py
+// to replace this file with the trained ground model.
+#pragma once
+
+#include "edge_scorer.h"
+
+#define EDGE_MODEL_KIND EDGE_MODEL_NONE
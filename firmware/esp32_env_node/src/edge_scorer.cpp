@@ -0,0 +1,78 @@
+#include "edge_scorer.h"
+
+// Air profiles use the ground model; water-only nodes the water model.
+#if NODE_HAS(SENSOR_BME680) || NODE_HAS(SENSOR_SDS011) || NODE_HAS(SENSOR_GEIGER)
+#include "edge_model_ground.h"
+#else
+#include "edge_model_water.h"
+#endif
+
+#if EDGE_MODEL_KIND != EDGE_MODEL_NONE
+static float featureValue(const Reading &r, EdgeFeature f) {
+  switch (f) {
+    case EDGE_RADIATION:
+      return r.radiationUsvh; // sent as radiation_cpm
+    case EDGE_PM25:
+      return r.pm25;
+    case EDGE_AIR_TEMP:
+      return r.tempC;
+    case EDGE_HUMIDITY:
+      return r.hum;
+    case EDGE_PRESSURE:
+      return r.pressHpa;
+    case EDGE_VOC:
+      return r.voc;
+    case EDGE_TDS:
+      return r.tdsRaw; // the server falls back to *_raw
+    case EDGE_PH:
+      return r.phRaw;
+    case EDGE_TURBIDITY:
+      return r.turbidityRaw;
+    case EDGE_WATER_TEMP:
+      return r.waterTempC[0];
+    default:
+      return NAN;
+  }
+}
+#endif
+
+float edgeAnomalyScore(const Reading &r) {
+#if EDGE_MODEL_KIND == EDGE_MODEL_NONE
+  (void)r;
+  return NAN;
+#else
+  float x[edge_model::FEATURE_COUNT];
+  for (uint8_t i = 0; i < edge_model::FEATURE_COUNT; i++) {
+    x[i] = featureValue(r, edge_model::FEATURES[i]);
+    if (isnan(x[i])) return NAN; // the server model skips incomplete rows too
+  }
+#if EDGE_MODEL_KIND == EDGE_MODEL_FOREST
+  float pathSum = 0.0f;
+  for (uint16_t t = 0; t < edge_model::TREE_COUNT; t++) {
+    const EdgeNode *n = &edge_model::NODES[edge_model::TREE_ROOTS[t]];
+    while (n->left >= 0) n = &edge_model::NODES[x[n->feature] <= n->value ? n->left : n->right];
+    pathSum += n->value;
+  }
+  return exp2f(-(pathSum / edge_model::TREE_COUNT) / edge_model::PATH_NORM);
+#else
+  float worst = 0.0f;
+  for (uint8_t i = 0; i < edge_model::FEATURE_COUNT; i++) {
+    worst = fmaxf(worst, fabsf(x[i] - edge_model::CENTER[i]) / edge_model::SCALE[i]);
+  }
+  return worst;
+#endif
+#endif
+}
+
+bool edgeAnomalous(const Reading &r, float &score) {
+  score = NAN;
+  if (!EDGE_SCORING_ENABLED) return false;
+  score = edgeAnomalyScore(r);
+#if EDGE_MODEL_KIND == EDGE_MODEL_NONE
+  return false;
+#elif defined(EDGE_SCORE_THRESHOLD)
+  return !isnan(score) && score > EDGE_SCORE_THRESHOLD;
+#else
+  return !isnan(score) && score > edge_model::THRESHOLD;
+#endif
+}
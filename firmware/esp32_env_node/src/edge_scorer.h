@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config_defaults.h"
+#include "reading.h"
+
+// On-device anomaly pre-scoring with the model the server uses, compiled into
+// edge_model_ground.h / edge_model_water.h by
+// backend/scripts/export_edge_model.py. A reading scoring above the model's
+// threshold is uploaded immediately rather than waiting for its batch.
+#define EDGE_MODEL_NONE 0
+#define EDGE_MODEL_FOREST 1
+#define EDGE_MODEL_ZSCORE 2
+
+// Reading fields under the server's feature names.
+enum EdgeFeature : uint8_t {
+  EDGE_RADIATION,
+  EDGE_PM25,
+  EDGE_AIR_TEMP,
+  EDGE_HUMIDITY,
+  EDGE_PRESSURE,
+  EDGE_VOC,
+  EDGE_TDS,
+  EDGE_PH,
+  EDGE_TURBIDITY,
+  EDGE_WATER_TEMP,
+};
+
+// Flattened IsolationForest node. Leaves have left < 0 and hold the path
+// length in value; internal nodes go left when x[feature] <= value.
+struct EdgeNode {
+  uint8_t feature;
+  int16_t left;
+  int16_t right;
+  float value;
+};
+
+// Forest: 2^(-E[h(x)]/c(psi)), as -score_samples() in sklearn.
+// Z-score: the largest |x - median| / scale over the features.
+// NAN when no model is compiled in or a feature is missing from the reading.
+float edgeAnomalyScore(const Reading &r);
+// True when the score exceeds the threshold; score is set either way.
+bool edgeAnomalous(const Reading &r, float &score);
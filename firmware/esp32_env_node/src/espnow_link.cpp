@@ -0,0 +1,348 @@
+#include "espnow_link.h"
+
+#include <Preferences.h>
+#include <WiFi.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+
+#include "espnow_frame.h"
+#include "logger.h"
+#include "signing.h"
+#include "time_service.h"
+
+#if NODE_ROLE != NODE_ROLE_STANDALONE && !defined(ESPNOW_SECRET)
+#error "NODE_ROLE needs ESPNOW_SECRET in config.h, the same on the gateway and its leaves"
+#endif
+#ifndef ESPNOW_SECRET
+#define ESPNOW_SECRET ""
+#endif
+#if NODE_ROLE == NODE_ROLE_GATEWAY && LOW_POWER_MODE
+#error "A gateway has to stay awake for its leaves; it cannot use LOW_POWER_MODE"
+#endif
+
+static_assert(ESPNOW_MAX_LEAVES < ESP_NOW_MAX_TOTAL_PEER_NUM, "the broadcast peer needs a slot too");
+
+static const uint8_t BROADCAST[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const char *NVS_NAMESPACE = "espnow";
+static const char *NVS_KEY_SEQ = "seq";         // upper bound on any sequence number used
+static const char *NVS_KEY_CHANNEL = "channel"; // where the gateway last answered
+
+struct RxFrame {
+  uint8_t mac[6];
+  uint8_t len;
+  uint8_t data[ESPNOW_FRAME_MAX];
+};
+
+static HmacSigner linkSigner;
+static QueueHandle_t rxQueue = nullptr;
+
+// Runs on the Wi-Fi task: copy the frame out and let the caller verify it.
+static void onReceive(const uint8_t *mac, const uint8_t *data, int len) {
+  if (len <= 0 || len > static_cast<int>(ESPNOW_FRAME_MAX)) return;
+  RxFrame f;
+  memcpy(f.mac, mac, sizeof(f.mac));
+  f.len = static_cast<uint8_t>(len);
+  memcpy(f.data, data, len);
+  xQueueSend(rxQueue, &f, 0);
+}
+
+static bool ensurePeer(const uint8_t *mac) {
+  if (esp_now_is_peer_exist(mac)) return true;
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, mac, sizeof(peer.peer_addr));
+  peer.channel = 0; // whatever channel the radio is on
+  peer.ifidx = WIFI_IF_STA;
+  peer.encrypt = false; // frames carry their own MAC
+  return esp_now_add_peer(&peer) == ESP_OK;
+}
+
+static bool startEspNow(UBaseType_t queueDepth) {
+  if (rxQueue) return true;
+  linkSigner.begin(ESPNOW_SECRET);
+  if (esp_now_init() != ESP_OK) {
+    LOG_ERROR("ESP-NOW init failed");
+    return false;
+  }
+  rxQueue = xQueueCreate(queueDepth, sizeof(RxFrame));
+  esp_now_register_recv_cb(onReceive);
+  return ensurePeer(BROADCAST);
+}
+
+// ---- Leaf ----
+
+// Kept in RTC memory across deep sleep; the sequence number is also
+// reserved in NVS blocks so it keeps growing across power loss without a
+// flash write per frame.
+struct LeafState {
+  uint32_t magic;
+  uint32_t seq;
+  uint32_t reserved;
+  uint8_t channel;
+  bool haveGateway;
+  uint8_t gateway[6];
+};
+
+static const uint32_t LEAF_STATE_MAGIC = 0x4C454146u; // "LEAF"
+RTC_DATA_ATTR static LeafState leaf;
+static bool swept = false;
+
+static void loadLeafState() {
+  if (leaf.magic == LEAF_STATE_MAGIC) return;
+  leaf = {};
+  leaf.magic = LEAF_STATE_MAGIC;
+  leaf.channel = ESPNOW_CHANNEL;
+  Preferences prefs;
+  if (prefs.begin(NVS_NAMESPACE, true)) {
+    leaf.seq = prefs.getUInt(NVS_KEY_SEQ, 0);
+    leaf.channel = prefs.getUChar(NVS_KEY_CHANNEL, ESPNOW_CHANNEL);
+    prefs.end();
+  }
+  leaf.reserved = leaf.seq; // the first frame reserves a block
+}
+
+static uint32_t nextSeq() {
+  if (++leaf.seq > leaf.reserved) {
+    leaf.reserved = leaf.seq + ESPNOW_SEQ_BLOCK;
+    Preferences prefs;
+    if (prefs.begin(NVS_NAMESPACE, false)) {
+      prefs.putUInt(NVS_KEY_SEQ, leaf.reserved);
+      prefs.end();
+    }
+  }
+  return leaf.seq;
+}
+
+static void rememberChannel(uint8_t channel) {
+  leaf.channel = channel;
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, false)) return;
+  prefs.putUChar(NVS_KEY_CHANNEL, channel);
+  prefs.end();
+}
+
+static bool setChannel(uint8_t channel) {
+  return esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE) == ESP_OK;
+}
+
+// Sends one frame and waits up to ESPNOW_ACK_TIMEOUT_MS for its ack. A
+// stale reply ends the wait too, leaving the gateway's floor in `floor`.
+static bool exchange(const uint8_t *peer, const uint8_t *frame, size_t len, uint32_t seq, uint32_t &floor) {
+  xQueueReset(rxQueue);
+  const unsigned long sent = millis();
+  if (esp_now_send(peer, frame, len) != ESP_OK) return false;
+  RxFrame rx;
+  for (;;) {
+    const unsigned long waited = millis() - sent;
+    if (waited >= ESPNOW_ACK_TIMEOUT_MS) return false;
+    if (xQueueReceive(rxQueue, &rx, pdMS_TO_TICKS(ESPNOW_ACK_TIMEOUT_MS - waited)) != pdTRUE) return false;
+    EspNowStale stale;
+    if (espnowDecodeStale(linkSigner, NODE_ID, rx.data, rx.len, stale) && stale.seq == seq) {
+      floor = stale.floor;
+      return false;
+    }
+    EspNowAck ack;
+    if (!espnowDecodeAck(linkSigner, NODE_ID, rx.data, rx.len, ack) || ack.seq != seq) continue;
+    if (!leaf.haveGateway || memcmp(leaf.gateway, rx.mac, sizeof(leaf.gateway)) != 0) {
+      memcpy(leaf.gateway, rx.mac, sizeof(leaf.gateway));
+      leaf.haveGateway = ensurePeer(leaf.gateway); // unicast from now on: MAC-level retries
+    }
+    if (ack.epochMs > 0 && timeNeedsSync()) timeSetFromServer(ack.epochMs, millis() - sent);
+    return true;
+  }
+}
+
+struct Outgoing {
+  uint8_t frame[ESPNOW_FRAME_MAX];
+  size_t len;
+  uint32_t seq;
+};
+
+static bool encode(Outgoing &o, const Reading &r) {
+  o.seq = nextSeq();
+  o.len = espnowEncodeReading(linkSigner, NODE_ID, o.seq, timeNow(), r, o.frame, sizeof(o.frame));
+  return o.len > 0;
+}
+
+// A restarted gateway refuses sequence numbers up to the floor it kept for
+// this leaf; renumber past it and try once more.
+static bool sendReading(const uint8_t *peer, Outgoing &o, const Reading &r) {
+  uint32_t floor = 0;
+  if (exchange(peer, o.frame, o.len, o.seq, floor)) return true;
+  if (floor == 0) return false;
+  LOG_INFO("ESP-NOW: gateway wants seq > %lu, was at %lu", static_cast<unsigned long>(floor),
+           static_cast<unsigned long>(o.seq));
+  if (floor > leaf.seq) leaf.seq = floor;
+  return encode(o, r) && exchange(peer, o.frame, o.len, o.seq, floor);
+}
+
+static bool deliver(const Reading &r) {
+  Outgoing o;
+  if (!encode(o, r)) return false;
+  const uint8_t *peer = leaf.haveGateway ? leaf.gateway : BROADCAST;
+  for (int attempt = 0; attempt < ESPNOW_SEND_ATTEMPTS; attempt++) {
+    if (sendReading(peer, o, r)) return true;
+  }
+  if (swept) return false;
+  // Nothing on the remembered channel: the AP, and with it the gateway, may
+  // have moved. Look once per wake.
+  swept = true;
+  for (uint8_t channel = 1; channel <= 13; channel++) {
+    if (!setChannel(channel) || !sendReading(BROADCAST, o, r)) continue;
+    LOG_INFO("ESP-NOW gateway found on channel %u", channel);
+    if (channel != leaf.channel) rememberChannel(channel);
+    return true;
+  }
+  setChannel(leaf.channel);
+  return false;
+}
+
+bool espnowLeafBegin() {
+  loadLeafState();
+  swept = false;
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_STA);
+  WiFi.disconnect(); // never associates; this also leaves the channel free to set
+  if (!startEspNow(4)) return false;
+  setChannel(leaf.channel);
+  if (leaf.haveGateway) ensurePeer(leaf.gateway);
+  return true;
+}
+
+size_t espnowLeafSend(const Reading *items, size_t count) {
+  if (!rxQueue) return 0;
+  size_t sent = 0;
+  while (sent < count && deliver(items[sent])) sent++;
+  if (sent < count) {
+    LOG_WARN("ESP-NOW: no ack from gateway (%u/%u reading(s) delivered)", static_cast<unsigned>(sent),
+             static_cast<unsigned>(count));
+  } else {
+    LOG_DEBUG("ESP-NOW: %u reading(s) acked", static_cast<unsigned>(sent));
+  }
+  return sent;
+}
+
+// ---- Gateway ----
+
+// Each leaf's floor is reserved in NVS in blocks, as the leaf reserves its
+// own sequence numbers: nothing at or below `reserved` was ever accepted
+// from it before a restart, so a frame from then is never relayed twice.
+struct LeafSlot {
+  char id[ESPNOW_ID_MAX + 1];
+  char key[10]; // NVS key, from a hash of the id: ids can outgrow NVS's 15 characters
+  uint32_t lastSeq;
+  uint32_t reserved;
+  bool seen; // lastSeq was accepted since boot, rather than loaded as the floor
+};
+
+static LeafSlot leaves[ESPNOW_MAX_LEAVES];
+static uint8_t leafCount = 0;
+static bool (*relayReading)(const Reading &r) = nullptr;
+
+static void parseLeaves() {
+  const char *p = ESPNOW_LEAVES;
+  while (*p && leafCount < ESPNOW_MAX_LEAVES) {
+    const char *end = strchr(p, ',');
+    const size_t n = end ? static_cast<size_t>(end - p) : strlen(p);
+    // A bad entry still takes its slot so the sources after it keep their numbers.
+    if (n > 0 && n <= ESPNOW_ID_MAX) {
+      memcpy(leaves[leafCount].id, p, n);
+      leaves[leafCount].id[n] = '\0';
+    } else {
+      LOG_WARN("ESPNOW_LEAVES entry %u is not a valid node id", leafCount + 1);
+    }
+    leafCount++;
+    if (!end) break;
+    p = end + 1;
+  }
+}
+
+// Keys hash the id (FNV-1a), so a floor stays with its leaf when ESPNOW_LEAVES
+// is reordered.
+static void loadFloors() {
+  Preferences prefs;
+  const bool open = prefs.begin(NVS_NAMESPACE, true);
+  for (uint8_t i = 0; i < leafCount; i++) {
+    LeafSlot &slot = leaves[i];
+    if (!slot.id[0]) continue;
+    uint32_t h = 2166136261u;
+    for (const char *c = slot.id; *c; c++) h = (h ^ static_cast<uint8_t>(*c)) * 16777619u;
+    snprintf(slot.key, sizeof(slot.key), "g%08lx", static_cast<unsigned long>(h));
+    slot.reserved = open ? prefs.getUInt(slot.key, 0) : 0;
+    slot.lastSeq = slot.reserved;
+  }
+  if (open) prefs.end();
+}
+
+static void reserveFloor(LeafSlot &slot, uint32_t seq) {
+  if (seq <= slot.reserved) return;
+  slot.reserved = seq + ESPNOW_SEQ_BLOCK;
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, false)) return;
+  prefs.putUInt(slot.key, slot.reserved);
+  prefs.end();
+}
+
+static int findLeaf(const char *id) {
+  for (uint8_t i = 0; i < leafCount; i++) {
+    if (leaves[i].id[0] && strcmp(leaves[i].id, id) == 0) return i;
+  }
+  return -1;
+}
+
+static void gatewayLoop(void *) {
+  RxFrame rx;
+  EspNowReading in;
+  uint8_t ackFrame[ESPNOW_FRAME_MAX];
+  for (;;) {
+    if (xQueueReceive(rxQueue, &rx, portMAX_DELAY) != pdTRUE) continue;
+    if (!espnowDecodeReading(linkSigner, rx.data, rx.len, in)) continue;
+    const int i = findLeaf(in.nodeId);
+    if (i < 0) {
+      LOG_WARN("ESP-NOW: ignoring %s, not in ESPNOW_LEAVES", in.nodeId);
+      continue;
+    }
+    LeafSlot &slot = leaves[i];
+    if (!slot.seen && in.seq <= slot.lastSeq) {
+      // At or below the floor: maybe relayed before the restart, maybe a
+      // replay. Either way the leaf renumbers it past the floor.
+      const EspNowStale stale = {in.seq, slot.lastSeq};
+      const size_t len = espnowEncodeStale(linkSigner, in.nodeId, stale, ackFrame, sizeof(ackFrame));
+      if (ensurePeer(rx.mac)) esp_now_send(rx.mac, ackFrame, len);
+      continue;
+    }
+    if (in.seq < slot.lastSeq) continue; // replayed
+    if (!slot.seen || in.seq > slot.lastSeq) {
+      Reading &r = in.reading;
+      // Sample and send time come from the same leaf clock, so the reading's
+      // age carries over onto ours whatever that clock says.
+      if (timeSynced() && in.sentAt >= r.epoch) r.epoch = timeNow() - (in.sentAt - r.epoch);
+      r.source = static_cast<uint8_t>(i + 1);
+      reserveFloor(slot, in.seq); // before relaying, so a crash can only lose the frame, not repeat it
+      if (!relayReading(r)) continue; // unacked: the leaf keeps it and retries
+      slot.lastSeq = in.seq;
+      slot.seen = true;
+    } // else a retransmission whose ack got lost: ack it again
+    const EspNowAck ack = {in.seq, timeSynced() ? static_cast<uint64_t>(timeNow()) * 1000ULL : 0};
+    const size_t len = espnowEncodeAck(linkSigner, in.nodeId, ack, ackFrame, sizeof(ackFrame));
+    if (ensurePeer(rx.mac)) esp_now_send(rx.mac, ackFrame, len);
+  }
+}
+
+bool espnowGatewayBegin(bool (*relay)(const Reading &r)) {
+  if (rxQueue) return true;
+  parseLeaves();
+  loadFloors();
+  if (leafCount == 0) LOG_WARN("NODE_ROLE_GATEWAY without ESPNOW_LEAVES; nothing will be relayed");
+  relayReading = relay;
+  WiFi.setSleep(false); // modem sleep would miss frames between beacons
+  if (!startEspNow(ESPNOW_RX_QUEUE_DEPTH)) return false;
+  xTaskCreatePinnedToCore(gatewayLoop, "espnow", ESPNOW_TASK_STACK, nullptr, ESPNOW_TASK_PRIORITY, nullptr,
+                          ESPNOW_TASK_CORE);
+  LOG_INFO("ESP-NOW gateway for %u leaf node(s) on channel %u", leafCount, WiFi.channel());
+  return true;
+}
+
+const char *espnowSourceId(uint8_t source) {
+  if (source == 0) return NODE_ID;
+  return source <= leafCount && leaves[source - 1].id[0] ? leaves[source - 1].id : nullptr;
+}
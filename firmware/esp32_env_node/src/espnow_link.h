@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config_defaults.h"
+#include "reading.h"
+
+// ESP-NOW aggregation (NODE_ROLE). A leaf never associates to Wi-Fi or opens
+// TLS: each reading goes out as one signed frame (espnow_frame.h) and counts
+// as delivered once the gateway's signed ack comes back, typically within a
+// few milliseconds. A gateway is a normal node that also listens for leaves;
+// verified readings join its own upload buffers tagged with Reading::source
+// and leave in per-node batches over its single uplink connection.
+
+// Leaf. Brings up the radio on the remembered (or ESPNOW_CHANNEL) channel.
+bool espnowLeafBegin();
+// Sends readings oldest first and returns how many the gateway acked; stops
+// at the first one that goes unanswered.
+size_t espnowLeafSend(const Reading *items, size_t count);
+
+// Gateway. Call once Wi-Fi is up: leaves have to be on the AP's channel.
+// `relay` gets each new reading with its source set and returns false if it
+// has no room, in which case the leaf is not acked and sends it again.
+bool espnowGatewayBegin(bool (*relay)(const Reading &r));
+// Node id for a Reading::source (NODE_ID for 0), or nullptr if unknown.
+const char *espnowSourceId(uint8_t source);
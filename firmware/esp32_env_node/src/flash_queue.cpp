@@ -0,0 +1,272 @@
+#include "flash_queue.h"
+
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+
+#include "logger.h"
+
+static const char *QUEUE_DIR = "/q";
+static const char *CURSOR_PATH = "/q/cursor";
+// Bumped whenever the Reading layout changes ("QUE2": Reading::sensors).
+static const uint32_t SEGMENT_MAGIC = 0x51554532; // "QUE2"
+static const uint32_t CURSOR_MAGIC = 0x43555231;  // "CUR1"
+
+struct SegmentHeader {
+  uint32_t magic;
+  uint16_t recordSize;
+  uint16_t reserved;
+};
+
+struct FlashRecord {
+  Reading reading;
+  uint32_t crc;
+};
+
+struct CursorRecord {
+  uint32_t magic;
+  uint32_t seq;
+  uint32_t offset;
+  uint32_t check;
+};
+
+static const size_t HEADER_SIZE = sizeof(SegmentHeader);
+static const size_t RECORD_SIZE = sizeof(FlashRecord);
+
+static uint32_t recordCrc(const Reading &r) {
+  return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&r), sizeof(r));
+}
+
+static uint32_t recordsInFile(File &f) {
+  if (f.size() < HEADER_SIZE) return 0;
+  return (f.size() - HEADER_SIZE) / RECORD_SIZE;
+}
+
+static bool headerValid(File &f) {
+  SegmentHeader hdr;
+  if (!f.seek(0) || f.read(reinterpret_cast<uint8_t *>(&hdr), sizeof(hdr)) != sizeof(hdr)) return false;
+  return hdr.magic == SEGMENT_MAGIC && hdr.recordSize == RECORD_SIZE;
+}
+
+bool FlashQueue::begin() {
+  if (!LittleFS.begin(true)) {
+    LOG_ERROR("Flash queue: LittleFS mount failed");
+    return false;
+  }
+  if (!LittleFS.exists(QUEUE_DIR)) LittleFS.mkdir(QUEUE_DIR);
+
+  // Find the contiguous range of valid segments; anything unreadable or with
+  // a different record layout is removed.
+  bool any = false;
+  uint32_t minSeq = 0, maxSeq = 0;
+  File dir = LittleFS.open(QUEUE_DIR);
+  File f = dir.openNextFile();
+  while (f) {
+    String name = f.name();
+    int slash = name.lastIndexOf('/');
+    if (slash >= 0) name = name.substring(slash + 1);
+    const bool isSegment = name.endsWith(".bin");
+    const uint32_t seq = strtoul(name.c_str(), nullptr, 16);
+    const bool valid = isSegment && headerValid(f);
+    f.close();
+    if (isSegment && !valid) {
+      LittleFS.remove(String(QUEUE_DIR) + "/" + name);
+    } else if (valid) {
+      if (!any || seq < minSeq) minSeq = seq;
+      if (!any || seq > maxSeq) maxSeq = seq;
+      any = true;
+    }
+    f = dir.openNextFile();
+  }
+  dir.close();
+
+  _ready = true;
+  if (!any) {
+    reset();
+    LittleFS.remove(CURSOR_PATH);
+    LOG_INFO("Flash queue: empty");
+    return true;
+  }
+
+  _hasSegments = true;
+  _headSeq = minSeq;
+  _tailSeq = maxSeq;
+  _headOffset = 0;
+  loadCursor();
+
+  _count = 0;
+  for (uint32_t seq = _headSeq; seq <= _tailSeq; seq++) {
+    File seg = LittleFS.open(segmentPath(seq), "r");
+    if (!seg) continue;
+    const uint32_t records = recordsInFile(seg);
+    seg.close();
+    if (seq == _tailSeq) _tailRecords = records;
+    _count += records;
+    if (seq == _headSeq) _count -= min(records, _headOffset);
+  }
+  LOG_INFO("Flash queue: %u reading(s) pending in segments %08X..%08X",
+           static_cast<unsigned>(_count), _headSeq, _tailSeq);
+  return true;
+}
+
+size_t FlashQueue::append(const Reading *items, size_t n) {
+  if (!_ready) return 0;
+  size_t written = 0;
+  while (written < n) {
+    if (!_hasSegments || _tailRecords >= FLASH_QUEUE_SEGMENT_RECORDS) {
+      if (!startTailSegment()) break;
+    }
+    File seg = LittleFS.open(segmentPath(_tailSeq), "a");
+    if (!seg) break;
+    while (written < n && _tailRecords < FLASH_QUEUE_SEGMENT_RECORDS) {
+      FlashRecord rec;
+      rec.reading = items[written];
+      rec.crc = recordCrc(rec.reading);
+      if (seg.write(reinterpret_cast<const uint8_t *>(&rec), sizeof(rec)) != sizeof(rec)) {
+        seg.close();
+        LOG_WARN("Flash queue: write failed (flash full?)");
+        return written;
+      }
+      _tailRecords++;
+      _count++;
+      written++;
+    }
+    seg.close();
+  }
+  return written;
+}
+
+size_t FlashQueue::peek(Reading *out, size_t max) {
+  _peekEnd = {_headSeq, _headOffset};
+  _peekPositions = 0;
+  if (!_ready || _count == 0) return 0;
+
+  size_t valid = 0;
+  Position pos = {_headSeq, _headOffset};
+  while (valid < max && pos.seq <= _tailSeq) {
+    File seg = LittleFS.open(segmentPath(pos.seq), "r");
+    const uint32_t records = seg ? recordsInFile(seg) : 0;
+    if (seg && pos.offset < records && seg.seek(HEADER_SIZE + pos.offset * RECORD_SIZE)) {
+      while (valid < max && pos.offset < records) {
+        FlashRecord rec;
+        if (seg.read(reinterpret_cast<uint8_t *>(&rec), sizeof(rec)) != sizeof(rec)) break;
+        pos.offset++;
+        _peekPositions++;
+        if (rec.crc != recordCrc(rec.reading)) continue; // torn write; skip
+        out[valid++] = rec.reading;
+      }
+    }
+    if (seg) seg.close();
+    if (pos.offset >= records && pos.seq < _tailSeq) {
+      pos.seq++;
+      pos.offset = 0;
+    } else {
+      break;
+    }
+  }
+  _peekEnd = pos;
+  return valid;
+}
+
+void FlashQueue::commitPeek() {
+  if (!_ready || _peekPositions == 0) return;
+  if (_peekEnd.seq < _headSeq) {
+    // The peeked segment was evicted meanwhile; those readings are gone anyway.
+    _peekPositions = 0;
+    return;
+  }
+  for (uint32_t seq = _headSeq; seq < _peekEnd.seq; seq++) {
+    LittleFS.remove(segmentPath(seq));
+  }
+  _headSeq = _peekEnd.seq;
+  _headOffset = _peekEnd.offset;
+  _count -= min(_count, _peekPositions);
+  _peekPositions = 0;
+
+  if (_count == 0) {
+    // Fully drained: drop the last segment so the next outage starts fresh.
+    LittleFS.remove(segmentPath(_headSeq));
+    const uint32_t next = _tailSeq + 1;
+    reset();
+    _tailSeq = next;
+    _headSeq = next;
+  }
+  saveCursor();
+}
+
+String FlashQueue::segmentPath(uint32_t seq) const {
+  char path[24];
+  snprintf(path, sizeof(path), "%s/%08X.bin", QUEUE_DIR, seq);
+  return String(path);
+}
+
+bool FlashQueue::startTailSegment() {
+  const uint32_t seq = _hasSegments ? _tailSeq + 1 : _tailSeq;
+  if (_hasSegments && seq - _headSeq >= FLASH_QUEUE_MAX_SEGMENTS) evictHead();
+
+  File seg = LittleFS.open(segmentPath(seq), "w");
+  if (!seg) {
+    LOG_ERROR("Flash queue: cannot create segment");
+    return false;
+  }
+  SegmentHeader hdr = {SEGMENT_MAGIC, static_cast<uint16_t>(RECORD_SIZE), 0};
+  const bool ok = seg.write(reinterpret_cast<const uint8_t *>(&hdr), sizeof(hdr)) == sizeof(hdr);
+  seg.close();
+  if (!ok) {
+    LittleFS.remove(segmentPath(seq));
+    return false;
+  }
+  if (!_hasSegments) {
+    _headSeq = seq;
+    _headOffset = 0;
+    _hasSegments = true;
+  }
+  _tailSeq = seq;
+  _tailRecords = 0;
+  return true;
+}
+
+void FlashQueue::evictHead() {
+  File seg = LittleFS.open(segmentPath(_headSeq), "r");
+  const uint32_t records = seg ? recordsInFile(seg) : 0;
+  if (seg) seg.close();
+  const uint32_t dropped = records > _headOffset ? records - _headOffset : 0;
+  LittleFS.remove(segmentPath(_headSeq));
+  _count -= min(_count, static_cast<size_t>(dropped));
+  _evicted += dropped;
+  _headSeq++;
+  _headOffset = 0;
+  saveCursor();
+  LOG_WARN("Flash queue full; evicted %u oldest reading(s)", dropped);
+}
+
+void FlashQueue::loadCursor() {
+  File f = LittleFS.open(CURSOR_PATH, "r");
+  if (!f) return;
+  CursorRecord cur;
+  const bool ok = f.read(reinterpret_cast<uint8_t *>(&cur), sizeof(cur)) == sizeof(cur);
+  f.close();
+  if (!ok || cur.magic != CURSOR_MAGIC || cur.check != (cur.seq ^ cur.offset ^ CURSOR_MAGIC)) return;
+  // A cursor pointing at an evicted segment means the head moved past it.
+  if (cur.seq < _headSeq || cur.seq > _tailSeq) return;
+  // Segments before the cursor were drained but not yet deleted (reset mid-commit).
+  for (uint32_t seq = _headSeq; seq < cur.seq; seq++) LittleFS.remove(segmentPath(seq));
+  _headSeq = cur.seq;
+  _headOffset = cur.offset;
+}
+
+void FlashQueue::saveCursor() {
+  File f = LittleFS.open(CURSOR_PATH, "w");
+  if (!f) return;
+  CursorRecord cur = {CURSOR_MAGIC, _headSeq, _headOffset, _headSeq ^ _headOffset ^ CURSOR_MAGIC};
+  f.write(reinterpret_cast<const uint8_t *>(&cur), sizeof(cur));
+  f.close();
+}
+
+void FlashQueue::reset() {
+  _hasSegments = false;
+  _headSeq = 0;
+  _headOffset = 0;
+  _tailSeq = 0;
+  _tailRecords = 0;
+  _count = 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "reading.h"
+
+// Persistent FIFO of readings on LittleFS for riding out offline periods.
+//
+// Readings are appended sequentially to numbered segment files under /q;
+// each segment starts with a small header recording the record layout so a
+// firmware change that alters Reading simply discards old segments. A cursor
+// file tracks how far the head segment has been uploaded. Nothing is ever
+// loaded wholesale: peek() streams at most `max` records into the caller's
+// array, and commitPeek() advances the cursor and deletes drained segments.
+class FlashQueue {
+ public:
+  bool begin();
+  bool ready() const { return _ready; }
+
+  // Returns the number of readings written.
+  size_t append(const Reading *items, size_t n);
+
+  size_t peek(Reading *out, size_t max);
+  void commitPeek();
+
+  size_t size() const { return _count; }
+  uint32_t evicted() const { return _evicted; }
+
+ private:
+  struct Position {
+    uint32_t seq;
+    uint32_t offset;
+  };
+
+  String segmentPath(uint32_t seq) const;
+  bool startTailSegment();
+  void evictHead();
+  void loadCursor();
+  void saveCursor();
+  void reset();
+
+  bool _ready = false;
+  bool _hasSegments = false;
+  uint32_t _headSeq = 0;
+  uint32_t _headOffset = 0;
+  uint32_t _tailSeq = 0;
+  uint32_t _tailRecords = 0;
+  size_t _count = 0;
+  uint32_t _evicted = 0;
+  Position _peekEnd = {0, 0};
+  size_t _peekPositions = 0;
+};
@@ -0,0 +1,111 @@
+#include "geiger_counter.h"
+
+#include "logger.h"
+
+bool GeigerCounter::begin(uint8_t pin, bool pullup, uint32_t windowMs) {
+  _binCount = constrain(windowMs / 1000, 1u, static_cast<uint32_t>(GEIGER_MAX_BINS));
+  if (windowMs / 1000 > GEIGER_MAX_BINS) {
+    LOG_WARN("Geiger window capped at %u s (GEIGER_MAX_BINS)", GEIGER_MAX_BINS);
+  }
+
+  pcnt_config_t cfg = {};
+  cfg.pulse_gpio_num = pin;
+  cfg.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  cfg.channel = PCNT_CHANNEL_0;
+  cfg.unit = _unit;
+  cfg.pos_mode = PCNT_COUNT_INC; // rising edge, as the old ISR
+  cfg.neg_mode = PCNT_COUNT_DIS;
+  cfg.lctrl_mode = PCNT_MODE_KEEP;
+  cfg.hctrl_mode = PCNT_MODE_KEEP;
+  cfg.counter_h_lim = PCNT_LIMIT;
+  cfg.counter_l_lim = 0;
+  if (pcnt_unit_config(&cfg) != ESP_OK) {
+    LOG_ERROR("Geiger PCNT config failed");
+    return false;
+  }
+  gpio_set_pull_mode(static_cast<gpio_num_t>(pin), pullup ? GPIO_PULLUP_ONLY : GPIO_FLOATING);
+
+  // Glitch filter in APB cycles (80 MHz, max 1023), well below the tube's pulse width.
+  pcnt_set_filter_value(_unit, GEIGER_FILTER_CYCLES);
+  pcnt_filter_enable(_unit);
+  pcnt_event_enable(_unit, PCNT_EVT_H_LIM);
+  pcnt_isr_service_install(0);
+  pcnt_isr_handler_add(_unit, overflowIsr, this);
+  pcnt_counter_pause(_unit);
+  pcnt_counter_clear(_unit);
+  pcnt_counter_resume(_unit);
+  _startedUs = esp_timer_get_time();
+
+  esp_timer_create_args_t args = {};
+  args.callback = tickCallback;
+  args.arg = this;
+  args.name = "geiger";
+  if (esp_timer_create(&args, &_timer) != ESP_OK || esp_timer_start_periodic(_timer, 1000000ULL) != ESP_OK) {
+    LOG_ERROR("Geiger timer start failed");
+    return false;
+  }
+  return true;
+}
+
+void IRAM_ATTR GeigerCounter::overflowIsr(void *arg) {
+  // The counter resets to 0 on reaching the high limit.
+  static_cast<GeigerCounter *>(arg)->_overflows++;
+}
+
+void GeigerCounter::tickCallback(void *arg) {
+  static_cast<GeigerCounter *>(arg)->tick();
+}
+
+uint32_t GeigerCounter::readHardware() {
+  // Re-read if an overflow lands between the two reads.
+  for (;;) {
+    const uint32_t before = _overflows;
+    int16_t count = 0;
+    pcnt_get_counter_value(_unit, &count);
+    if (_overflows == before) return before * static_cast<uint32_t>(PCNT_LIMIT) + static_cast<uint16_t>(count);
+  }
+}
+
+void GeigerCounter::tick() {
+  const uint32_t total = readHardware();
+  const uint32_t delta = total - _lastTotal;
+  _lastTotal = total;
+
+  portENTER_CRITICAL(&_mux);
+  if (_filled == _binCount) {
+    _windowSum -= _bins[_head];
+  } else {
+    _filled++;
+  }
+  _bins[_head] = delta > 0xFFFF ? 0xFFFF : delta;
+  _windowSum += _bins[_head];
+  _head = (_head + 1) % _binCount;
+  portEXIT_CRITICAL(&_mux);
+}
+
+bool GeigerCounter::cpm(float &out) {
+  portENTER_CRITICAL(&_mux);
+  const uint32_t sum = _windowSum;
+  const uint16_t filled = _filled;
+  portEXIT_CRITICAL(&_mux);
+  if (filled == 0) return false;
+  out = correctDeadTime(sum * 60.0f / filled);
+  return true;
+}
+
+uint32_t GeigerCounter::totalPulses() {
+  return readHardware();
+}
+
+uint32_t GeigerCounter::countedMs() const {
+  return static_cast<uint32_t>((esp_timer_get_time() - _startedUs) / 1000);
+}
+
+// Non-paralyzable model: true rate n = m / (1 - m * tau).
+float GeigerCounter::correctDeadTime(float cpm) {
+  if (GEIGER_DEAD_TIME_US <= 0) return cpm;
+  const float measuredPerSec = cpm / 60.0f;
+  const float busy = measuredPerSec * GEIGER_DEAD_TIME_US * 1e-6f;
+  if (busy >= 0.95f) return cpm / 0.05f; // tube saturated; clamp rather than blow up
+  return cpm / (1.0f - busy);
+}
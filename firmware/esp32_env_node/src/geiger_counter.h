@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Arduino.h>
+#include <driver/pcnt.h>
+#include <esp_timer.h>
+
+#include "config_defaults.h"
+
+// Geiger tube pulses counted by the PCNT peripheral instead of a per-pulse
+// GPIO ISR. A 1 s esp_timer folds the hardware count into per-second bins, so
+// the CPM window is exact and independent of sampling or upload latency. The
+// only interrupt is the PCNT high-limit event, once every 32767 pulses.
+class GeigerCounter {
+ public:
+  bool begin(uint8_t pin, bool pullup, uint32_t windowMs);
+  // Dead-time corrected CPM over the filled part of the window. Returns false
+  // until at least one full second has been counted.
+  bool cpm(float &out);
+  // Raw pulses and counting time since begin(), for callers that carry a
+  // window across deep sleep.
+  uint32_t totalPulses();
+  uint32_t countedMs() const;
+
+  static float correctDeadTime(float cpm);
+
+ private:
+  static const int16_t PCNT_LIMIT = 32767;
+
+  static void IRAM_ATTR overflowIsr(void *arg);
+  static void tickCallback(void *arg);
+  uint32_t readHardware();
+  void tick();
+
+  pcnt_unit_t _unit = PCNT_UNIT_0;
+  esp_timer_handle_t _timer = nullptr;
+  volatile uint32_t _overflows = 0;
+  uint32_t _lastTotal = 0;
+  uint64_t _startedUs = 0;
+  uint16_t _bins[GEIGER_MAX_BINS] = {};
+  uint16_t _binCount = 0; // bins in the window
+  uint16_t _filled = 0;
+  uint16_t _head = 0;
+  uint32_t _windowSum = 0;
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+};
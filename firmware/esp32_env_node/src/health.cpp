@@ -0,0 +1,188 @@
+#include "health.h"
+
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+
+#include "logger.h"
+
+// Survives every reset but power-on (and brownout), deep sleep included.
+struct HealthRecord {
+  uint32_t magic;
+  uint8_t reset;
+  uint8_t stuckTask;
+  uint8_t stuckStage;
+  uint8_t watched; // bit per HealthTask
+  uint16_t wdtResets;
+  uint16_t recoveries;
+  uint16_t sensorFails[HEALTH_SENSOR_COUNT];
+  uint16_t uploadFails;
+  int64_t uptimeBaseUs; // run time before this boot, deep sleep included
+  uint8_t openStage[HEALTH_TASK_COUNT];
+  uint32_t lastBeatMs[HEALTH_TASK_COUNT];
+};
+
+static const uint32_t HEALTH_MAGIC = 0x484C0000u ^ sizeof(HealthRecord);
+RTC_NOINIT_ATTR static HealthRecord record;
+static TaskHandle_t watchedTasks[HEALTH_TASK_COUNT] = {};
+
+static uint8_t resetFrom(esp_reset_reason_t why) {
+  switch (why) {
+    case ESP_RST_POWERON: return HEALTH_RESET_POWER_ON;
+    case ESP_RST_EXT: return HEALTH_RESET_EXTERNAL;
+    case ESP_RST_SW: return HEALTH_RESET_SOFTWARE;
+    case ESP_RST_PANIC: return HEALTH_RESET_PANIC;
+    case ESP_RST_INT_WDT: return HEALTH_RESET_INT_WDT;
+    case ESP_RST_TASK_WDT: return HEALTH_RESET_TASK_WDT;
+    case ESP_RST_WDT: return HEALTH_RESET_OTHER_WDT;
+    case ESP_RST_BROWNOUT: return HEALTH_RESET_BROWNOUT;
+    default: return HEALTH_RESET_UNKNOWN;
+  }
+}
+
+// The watched task that checked in least recently is the one that hung.
+static void findStuckTask() {
+  record.stuckTask = HEALTH_TASK_COUNT;
+  record.stuckStage = STAGE_COUNT;
+  uint32_t oldestAge = 0;
+  for (uint8_t t = 0; t < HEALTH_TASK_COUNT; t++) {
+    if (!(record.watched & (1u << t))) continue;
+    uint32_t newest = 0;
+    for (uint8_t o = 0; o < HEALTH_TASK_COUNT; o++) {
+      if (record.watched & (1u << o)) newest = max(newest, record.lastBeatMs[o]);
+    }
+    const uint32_t age = newest - record.lastBeatMs[t];
+    if (record.stuckTask == HEALTH_TASK_COUNT || age > oldestAge) {
+      record.stuckTask = t;
+      record.stuckStage = record.openStage[t];
+      oldestAge = age;
+    }
+  }
+}
+
+void healthBegin() {
+  const esp_reset_reason_t why = esp_reset_reason();
+  if (record.magic != HEALTH_MAGIC || why == ESP_RST_POWERON) {
+    memset(&record, 0, sizeof(record));
+    record.magic = HEALTH_MAGIC;
+    record.stuckTask = HEALTH_TASK_COUNT;
+    record.stuckStage = STAGE_COUNT;
+  }
+  if (why != ESP_RST_DEEPSLEEP) {
+    record.reset = resetFrom(why);
+    record.uptimeBaseUs = 0;
+    record.stuckTask = HEALTH_TASK_COUNT;
+    record.stuckStage = STAGE_COUNT;
+    if (why == ESP_RST_TASK_WDT || why == ESP_RST_INT_WDT || why == ESP_RST_WDT) {
+      record.wdtResets++;
+      findStuckTask();
+      LOG_WARN("Watchdog reset (%s): %s task stuck in stage %s", NodeHealth::RESET_NAMES[record.reset],
+               record.stuckTask < HEALTH_TASK_COUNT ? NodeHealth::TASK_NAMES[record.stuckTask] : "?",
+               record.stuckStage < STAGE_COUNT ? StageHistograms::NAMES[record.stuckStage] : "none");
+    }
+  }
+  record.watched = 0;
+  for (uint8_t t = 0; t < HEALTH_TASK_COUNT; t++) record.openStage[t] = STAGE_COUNT;
+  // Reconfigures the watchdog the Arduino core already started for the idle
+  // tasks; a stuck watched task panics, which resets the node.
+  esp_task_wdt_init(HEALTH_WDT_TIMEOUT_S, true);
+}
+
+static int slotOf(TaskHandle_t task) {
+  for (uint8_t t = 0; t < HEALTH_TASK_COUNT; t++) {
+    if (watchedTasks[t] == task) return t;
+  }
+  return -1;
+}
+
+void healthWatch(HealthTask t) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  const int old = slotOf(self);
+  if (old >= 0) {
+    watchedTasks[old] = nullptr;
+    record.watched &= ~(1u << old);
+  } else {
+    esp_task_wdt_add(self);
+  }
+  watchedTasks[t] = self;
+  record.openStage[t] = STAGE_COUNT;
+  record.watched |= 1u << t;
+  healthBeat();
+}
+
+void healthBeat() {
+  const int t = slotOf(xTaskGetCurrentTaskHandle());
+  if (t < 0) return;
+  esp_task_wdt_reset();
+  record.lastBeatMs[t] = millis();
+}
+
+void healthDelayUntil(TickType_t &lastWake, uint32_t ms) {
+  const TickType_t step = pdMS_TO_TICKS(1000);
+  TickType_t left = pdMS_TO_TICKS(ms);
+  while (left > 0) {
+    const TickType_t d = min(left, step);
+    vTaskDelayUntil(&lastWake, d);
+    left -= d;
+    healthBeat();
+  }
+}
+
+uint8_t healthEnterStage(Stage s) {
+  const int t = slotOf(xTaskGetCurrentTaskHandle());
+  if (t < 0) return STAGE_COUNT;
+  const uint8_t previous = record.openStage[t];
+  record.openStage[t] = s;
+  return previous;
+}
+
+void healthLeaveStage(uint8_t previous) {
+  const int t = slotOf(xTaskGetCurrentTaskHandle());
+  if (t >= 0) record.openStage[t] = previous;
+}
+
+bool healthSensorResult(HealthSensor s, bool ok) {
+  uint16_t &fails = record.sensorFails[s];
+  if (ok) {
+    fails = 0;
+    return false;
+  }
+  if (fails < 0xFFFF) fails++;
+  if (HEALTH_SENSOR_FAILS == 0 || fails % HEALTH_SENSOR_FAILS != 0) return false;
+  record.recoveries++;
+  return true;
+}
+
+HealthAction healthUploadResult(bool ok) {
+  if (ok) {
+    record.uploadFails = 0;
+    return HEALTH_ACTION_NONE;
+  }
+  if (record.uploadFails < 0xFFFF) record.uploadFails++;
+  if (HEALTH_REBOOT_FAILS > 0 && record.uploadFails >= HEALTH_REBOOT_FAILS) {
+    record.uploadFails = 0; // the ladder starts over after the reboot
+    record.recoveries++;
+    return HEALTH_ACTION_REBOOT;
+  }
+  if (HEALTH_WIFI_RESTART_FAILS > 0 && record.uploadFails % HEALTH_WIFI_RESTART_FAILS == 0) {
+    record.recoveries++;
+    return HEALTH_ACTION_RESTART_WIFI;
+  }
+  return HEALTH_ACTION_NONE;
+}
+
+void healthBeforeSleep(uint32_t sleepMs) {
+  record.uptimeBaseUs += esp_timer_get_time() + static_cast<int64_t>(sleepMs) * 1000;
+}
+
+void healthSnapshot(NodeHealth &out) {
+  out.reset = record.reset;
+  out.uptimeS = static_cast<uint32_t>((record.uptimeBaseUs + esp_timer_get_time()) / 1000000);
+  out.stuckTask = record.stuckTask;
+  out.stuckStage = record.stuckStage;
+  out.wdtResets = record.wdtResets;
+  out.bmeFails = record.sensorFails[HEALTH_SENSOR_BME];
+  out.sdsFails = record.sensorFails[HEALTH_SENSOR_SDS];
+  out.uploadFails = record.uploadFails;
+  out.recoveries = record.recoveries;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config_defaults.h"
+#include "health_report.h"
+#include "stage_histograms.h"
+
+// Health supervision. The pipeline tasks subscribe to the ESP32 task
+// watchdog and check in through healthBeat(); one that stops for
+// HEALTH_WDT_TIMEOUT_S resets the node. StageSpan records which timing stage
+// each watched task is in. That record and the failure counters live in RTC
+// memory, so the boot after a watchdog reset can still report where the node
+// hung. The counters drive graded recovery in main.cpp: reinitialize the
+// sensor, then restart Wi-Fi, then reboot.
+
+// Reads what the previous run left behind and arms the watchdog. Call first
+// thing in setup().
+void healthBegin();
+// Subscribes the calling task to the watchdog as `t`. A task that is already
+// watched just changes slot (LOW_POWER_MODE runs everything in one task).
+void healthWatch(HealthTask t);
+// Feeds the watchdog for the calling task; no-op for unwatched tasks.
+void healthBeat();
+// vTaskDelayUntil() in steps short enough to keep feeding the watchdog.
+void healthDelayUntil(TickType_t &lastWake, uint32_t ms);
+
+// StageSpan bookkeeping: returns the stage the caller was in before.
+uint8_t healthEnterStage(Stage s);
+void healthLeaveStage(uint8_t previous);
+
+enum HealthSensor : uint8_t {
+  HEALTH_SENSOR_BME,
+  HEALTH_SENSOR_SDS,
+  HEALTH_SENSOR_COUNT
+};
+
+// Counts one sample's outcome. True after every HEALTH_SENSOR_FAILS failures
+// in a row: time to reinitialize the driver.
+bool healthSensorResult(HealthSensor s, bool ok);
+
+enum HealthAction : uint8_t {
+  HEALTH_ACTION_NONE,
+  HEALTH_ACTION_RESTART_WIFI,
+  HEALTH_ACTION_REBOOT
+};
+
+// Counts one flush's outcome and says which recovery step is due.
+HealthAction healthUploadResult(bool ok);
+
+// Keeps uptime counting through deep sleep; called by enterDeepSleep().
+void healthBeforeSleep(uint32_t sleepMs);
+
+void healthSnapshot(NodeHealth &out);
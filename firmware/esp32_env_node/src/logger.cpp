@@ -0,0 +1,105 @@
+#include "logger.h"
+
+#include <stdarg.h>
+
+static char ring[LOG_BUFFER_BYTES];
+static size_t ringHead = 0; // next byte to write out
+static size_t ringUsed = 0;
+static uint32_t droppedBytes = 0;
+static uint32_t droppedReported = 0;
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t writerTask = nullptr;
+
+static void push(const char *data, size_t len) {
+  if (!writerTask) {
+    Serial.write(reinterpret_cast<const uint8_t *>(data), len);
+    return;
+  }
+  portENTER_CRITICAL(&ringMux);
+  if (ringUsed + len > LOG_BUFFER_BYTES) {
+    droppedBytes += len;
+    portEXIT_CRITICAL(&ringMux);
+    return;
+  }
+  const size_t tail = (ringHead + ringUsed) % LOG_BUFFER_BYTES;
+  const size_t first = min(len, static_cast<size_t>(LOG_BUFFER_BYTES - tail));
+  memcpy(ring + tail, data, first);
+  memcpy(ring, data + first, len - first);
+  ringUsed += len;
+  portEXIT_CRITICAL(&ringMux);
+  xTaskNotifyGive(writerTask);
+}
+
+// Copies out up to max contiguous bytes; the caller releases them afterwards
+// so logFlush() only sees an empty ring once they have reached the UART.
+static size_t peek(char *out, size_t max) {
+  portENTER_CRITICAL(&ringMux);
+  const size_t n = min(min(ringUsed, max), static_cast<size_t>(LOG_BUFFER_BYTES - ringHead));
+  memcpy(out, ring + ringHead, n);
+  portEXIT_CRITICAL(&ringMux);
+  return n;
+}
+
+static void release(size_t n) {
+  portENTER_CRITICAL(&ringMux);
+  ringHead = (ringHead + n) % LOG_BUFFER_BYTES;
+  ringUsed -= n;
+  portEXIT_CRITICAL(&ringMux);
+}
+
+static void writerLoop(void *) {
+  char chunk[128];
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    size_t n;
+    while ((n = peek(chunk, sizeof(chunk))) > 0) {
+      Serial.write(reinterpret_cast<const uint8_t *>(chunk), n);
+      release(n);
+    }
+    const uint32_t dropped = droppedBytes;
+    if (dropped != droppedReported) {
+      Serial.printf("W log: dropped %u byte(s)\n", static_cast<unsigned>(dropped - droppedReported));
+      droppedReported = dropped;
+    }
+  }
+}
+
+void logBegin() {
+  if (writerTask) return;
+  xTaskCreatePinnedToCore(writerLoop, "log", 2048, nullptr, LOG_TASK_PRIORITY, &writerTask, LOG_TASK_CORE);
+}
+
+void logPrintf(const char *fmt, ...) {
+  char line[LOG_LINE_MAX];
+  va_list args;
+  va_start(args, fmt);
+  const int n = vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  if (n <= 0) return;
+  size_t len = static_cast<size_t>(n);
+  if (len >= sizeof(line)) {
+    len = sizeof(line) - 1;
+    line[len - 1] = '\n'; // keep truncated lines terminated
+  }
+  push(line, len);
+}
+
+void logWrite(const char *data, size_t len) {
+  push(data, len);
+}
+
+void logFlush(uint32_t timeoutMs) {
+  const unsigned long start = millis();
+  for (;;) {
+    portENTER_CRITICAL(&ringMux);
+    const size_t used = ringUsed;
+    portEXIT_CRITICAL(&ringMux);
+    if (used == 0 || millis() - start >= timeoutMs) break;
+    delay(5);
+  }
+  Serial.flush();
+}
+
+uint32_t logDropped() {
+  return droppedBytes;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config_defaults.h"
+
+// Leveled serial logging. LOG_ERROR..LOG_DEBUG take printf arguments, append
+// the newline themselves and compile out above LOG_LEVEL, so their arguments
+// are never evaluated. Lines are formatted into a RAM ring and written out by
+// a low-priority task; callers never wait on the UART. Not ISR-safe.
+
+// Disabled levels keep their arguments type-checked (and "used") but the
+// dead branch, format string included, is compiled out.
+#define LOG_DISCARD(fmt, ...)           \
+  do {                                  \
+    if (0) logPrintf(fmt, ##__VA_ARGS__); \
+  } while (0)
+
+// Starts the writer task. Until then lines go straight to Serial.
+void logBegin();
+void logPrintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+// Queues bytes verbatim (no formatting, no line limit).
+void logWrite(const char *data, size_t len);
+// Waits up to timeoutMs for the ring to drain, e.g. before deep sleep.
+void logFlush(uint32_t timeoutMs = 500);
+// Bytes dropped because the ring was full.
+uint32_t logDropped();
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(fmt, ...) logPrintf("E " fmt "\n", ##__VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...) LOG_DISCARD(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(fmt, ...) logPrintf("W " fmt "\n", ##__VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...) LOG_DISCARD(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(fmt, ...) logPrintf("I " fmt "\n", ##__VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...) LOG_DISCARD(fmt, ##__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(fmt, ...) logPrintf("D " fmt "\n", ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...) LOG_DISCARD(fmt, ##__VA_ARGS__)
+#endif
@@ -3,8 +3,8 @@
 #include <HTTPClient.h>
 #include <WiFiClientSecure.h>
 #include <time.h>
+#include <esp_heap_caps.h>
 #include <esp_system.h>
-#include <mbedtls/md.h>
 #include <OneWire.h>
 #include <DallasTemperature.h>
 #include <ArduinoJson.h>
@@ -12,17 +12,48 @@
 #include <Wire.h>
 
 #include "config.h"
-
-// SDS011 constants
-static const uint8_t SDS_FRAME_LEN = 10;
-static const uint8_t SDS_HEADER1 = 0xAA;
-static const uint8_t SDS_HEADER2 = 0xC0;
-static const uint8_t SDS_TAIL = 0xAB;
-
+#include "config_defaults.h"
+#include "adc_sampler.h"
+#include "edge_scorer.h"
+#include "espnow_link.h"
+#include "flash_queue.h"
+#include "geiger_counter.h"
+#include "health.h"
+#include "logger.h"
+#include "node_config.h"
+#include "ota_update.h"
+#include "payload.h"
+#include "reading.h"
+#include "reading_filter.h"
+#include "report_policy.h"
+#include "sds011.h"
+#include "sensor_math.h"
+#include "signing.h"
+#include "sleep_state.h"
+#include "stage_timing.h"
+#include "time_service.h"
+#include "upload_session.h"
+#include "uplink.h"
+#include "water_temp.h"
+#include "wifi_cache.h"
+#include "ws_uplink.h"
+
+// Drivers exist only for the sensors in NODE_SENSORS.
+#if NODE_HAS(SENSOR_SDS011)
 HardwareSerial sdsSerial(2); // UART2
+Sds011 sds;
+#endif
+#if NODE_HAS(SENSOR_BME680)
 Adafruit_BME680 bme;
+#endif
+#if NODE_HAS(SENSOR_DS18B20)
 OneWire oneWire(DS18B20_PIN);
 DallasTemperature ds18b20(&oneWire);
+WaterTempProbes waterProbes;
+#endif
+#if NODE_HAS(SENSOR_WATER_ADC)
+AdcSampler waterAdc;
+#endif
 
 float lastPm25 = 12.0f;
 float lastPm10 = 0.0f;
@@ -31,11 +62,7 @@ float lastHum = 55.0f;
 float lastPress = 1010.0f;
 float lastGas = 100000.0f;
 float lastRadiationUsvh = 0.0f;
-float lastWaterTempC = NAN;
-int lastTurbidityRaw = 0;
-int lastTdsRaw = 0;
-int lastPhRaw = 0;
-bool waterTempValid = false;
+float lastWaterTempC[DS18B20_MAX_PROBES];
 unsigned long bmeRetryAt = 0;
 unsigned long bmeWarmupUntil = 0;
 bool bmeReady = false;
@@ -44,198 +71,120 @@ unsigned long bootMs = 0;
 unsigned long sdsWarmupUntil = 0;
 unsigned long sdsDebugWindowEnd = 0;
 unsigned long sdsNoFrameHintAt = 0;
-unsigned long sdsLastGoodFrameMs = 0;
 bool sdsHintShown = false;
-volatile uint32_t geigerPulses = 0;
-unsigned long geigerWindowStart = 0;
-portMUX_TYPE geigerMux = portMUX_INITIALIZER_UNLOCKED;
-
-void rawSdsDebugWindow();
-bool bootstrapTimeIfNeeded();
-bool trySyncTimeNtp();
-String makeNonce();
-String hmacSha256Hex(const String &message, const char* secret);
-
-String toHex(const uint8_t *data, size_t len) {
-  static const char hexChars[] = "0123456789abcdef";
-  String out;
-  out.reserve(len * 2);
-  for (size_t i = 0; i < len; i++) {
-    out += hexChars[(data[i] >> 4) & 0x0F];
-    out += hexChars[data[i] & 0x0F];
-  }
-  return out;
-}
-
-String makeNonce() {
-  uint8_t buf[8];
-  for (int i = 0; i < 8; i++) {
-    buf[i] = (uint8_t)esp_random();
+#if NODE_HAS(SENSOR_GEIGER)
+GeigerCounter geiger;
+#endif
+// LOW_POWER_MODE only: pulses/time counted on earlier wakes of the current window.
+uint32_t geigerCarryPulses = 0;
+uint32_t geigerCarryMs = 0;
+UploadSession uploader; // also serves /api/time
+#if UPLINK_TRANSPORT == UPLINK_TRANSPORT_WS
+WsUplink wsUplink;
+Uplink &uplink = wsUplink;
+#else
+Uplink &uplink = uploader;
+#endif
+HmacSigner signer;
+ReadingBuffer pendingReadings;
+unsigned long pendingOldestMs = 0;
+uint32_t readingsDropped = 0;
+FlashQueue flashQueue;
+unsigned long nextFlushAttemptMs = 0; // 0: no backoff pending
+unsigned long offlineBackoffMs = 0;
+QueueHandle_t readingQueue = nullptr;
+uint32_t readingQueueOverflows = 0;
+ReportPolicy reportPolicy;
+ReadingFilter readingFilter;
+volatile bool urgentFlush = false; // set by the sensor task while escalated
+// Upload buffers are static so a cycle performs no heap allocation of its own.
+static char uploadBody[UPLOAD_BODY_CAPACITY];
+static char uploadResponse[UPLOAD_RESPONSE_CAPACITY];
+static Reading uploadScratch[FLASH_DRAIN_BATCH > BATCH_MAX_READINGS ? FLASH_DRAIN_BATCH : BATCH_MAX_READINGS];
+
+Reading sampleSensors();
+void sensorTask(void *);
+void networkTask(void *);
+void drainReadingQueue();
+// Waits for association; returns false after timeoutMs.
+bool waitForWiFi(unsigned long timeoutMs) {
+  const unsigned long start = millis();
+  while (WiFi.status() != WL_CONNECTED) {
+    if (millis() - start >= timeoutMs) return false;
+    healthBeat();
+    delay(50);
   }
-  return toHex(buf, sizeof(buf));
-}
-
-String hmacSha256Hex(const String &message, const char* secret) {
-  uint8_t hmac[32];
-  mbedtls_md_context_t ctx;
-  mbedtls_md_init(&ctx);
-  mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
-  mbedtls_md_hmac_starts(&ctx, (const unsigned char*)secret, strlen(secret));
-  mbedtls_md_hmac_update(&ctx, (const unsigned char*)message.c_str(), message.length());
-  mbedtls_md_hmac_finish(&ctx, hmac);
-  mbedtls_md_free(&ctx);
-  return toHex(hmac, sizeof(hmac));
-}
-
-void IRAM_ATTR onGeigerPulse() {
-  portENTER_CRITICAL_ISR(&geigerMux);
-  geigerPulses++;
-  portEXIT_CRITICAL_ISR(&geigerMux);
+  return true;
 }
 
-void connectWiFi() {
+bool connectWiFi() {
+  const IPAddress dns1(1, 1, 1, 1);
+  const IPAddress dns2(8, 8, 8, 8);
+  WiFi.persistent(false); // credentials come from config.h; don't rewrite flash on every begin
   WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASS);
-  Serial.printf("Connecting to WiFi SSID=%s\n", WIFI_SSID);
-  int retries = 0;
-  while (WiFi.status() != WL_CONNECTED && retries < 40) {
-    delay(250);
-    Serial.print(".");
-    retries++;
-  }
-  Serial.println();
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.printf("WiFi connected. IP: %s\n", WiFi.localIP().toString().c_str());
-    IPAddress dns1(1, 1, 1, 1);
-    IPAddress dns2(8, 8, 8, 8);
-    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, dns1, dns2);
-    Serial.println("DNS set to 1.1.1.1 and 8.8.8.8");
-    bootstrapTimeIfNeeded();
-    trySyncTimeNtp();
-  } else {
-    Serial.println("WiFi connection failed; retrying in 3 seconds");
-    delay(3000);
-    connectWiFi();
-  }
-}
-
-void setupTime() {
-  configTime(0, 0, "pool.ntp.org", "time.nist.gov", "time.google.com");
-}
-
-int monthFromString(const char *mon) {
-  static const char *months[] = {"Jan","Feb","Mar","Apr","May","Jun","Jul","Aug","Sep","Oct","Nov","Dec"};
-  for (int i = 0; i < 12; i++) {
-    if (strncmp(mon, months[i], 3) == 0) return i;
-  }
-  return -1;
-}
-
-bool bootstrapTimeIfNeeded() {
-  time_t now = time(nullptr);
-  if (now >= 1700000000) return true;
 
-  char mon[4] = {0};
-  int day = 0;
-  int year = 0;
-  int hour = 0, minute = 0, second = 0;
-  if (sscanf(__DATE__, "%3s %d %d", mon, &day, &year) != 3) return false;
-  if (sscanf(__TIME__, "%d:%d:%d", &hour, &minute, &second) != 3) return false;
-  int month = monthFromString(mon);
-  if (month < 0) return false;
-
-  struct tm tm_time = {};
-  tm_time.tm_year = year - 1900;
-  tm_time.tm_mon = month;
-  tm_time.tm_mday = day;
-  tm_time.tm_hour = hour;
-  tm_time.tm_min = minute;
-  tm_time.tm_sec = second;
-  time_t compileTime = mktime(&tm_time);
-  if (compileTime < 1700000000) return false;
-
-  struct timeval tv;
-  tv.tv_sec = compileTime;
-  tv.tv_usec = 0;
-  settimeofday(&tv, nullptr);
-  Serial.printf("Bootstrap time set from compile time, epoch=%ld\n", static_cast<long>(compileTime));
-  return true;
-}
-
-bool trySyncTimeNtp() {
-  setupTime();
-  struct tm timeinfo;
-  unsigned long start = millis();
-  while (millis() - start < 10000) {
-    if (getLocalTime(&timeinfo, 1000)) {
-      time_t now = time(nullptr);
-      Serial.printf("NTP check epoch=%ld\n", static_cast<long>(now));
-      if (now >= 1700000000) {
-        Serial.printf("Time synced via NTP, epoch=%ld\n", static_cast<long>(now));
-        return true;
-      }
+  WifiCache cache;
+  const bool haveCache = wifiCacheLoad(cache);
+  const unsigned long started = millis();
+  bool fast = false;
+  bool staticIp = false;
+  for (int attempt = 1; attempt <= WIFI_CONNECT_ATTEMPTS; attempt++) {
+    fast = haveCache && attempt == 1;
+    staticIp = fast && WIFI_REUSE_LEASE && cache.ip != 0;
+    if (staticIp) {
+      WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), dns1, dns2);
+    } else {
+      WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE); // back to DHCP
+    }
+    if (fast) {
+      LOG_DEBUG("Connecting to WiFi SSID=%s (cached BSSID, ch %u)", WIFI_SSID, cache.channel);
+      WiFi.begin(WIFI_SSID, WIFI_PASS, cache.channel, cache.bssid);
+    } else {
+      LOG_DEBUG("Connecting to WiFi SSID=%s (attempt %d/%d)", WIFI_SSID, attempt, WIFI_CONNECT_ATTEMPTS);
+      WiFi.begin(WIFI_SSID, WIFI_PASS);
     }
+    if (waitForWiFi(fast ? WIFI_FAST_CONNECT_TIMEOUT_MS : WIFI_CONNECT_TIMEOUT_MS)) break;
+    WiFi.disconnect();
   }
-  Serial.println("NTP sync failed; time not set yet");
-  return false;
-}
-
-bool ensureTimeSynced() {
-  time_t now = time(nullptr);
-  if (now >= 1700000000) return true;
-  if (bootstrapTimeIfNeeded()) return true;
-  return trySyncTimeNtp();
-}
 
-bool checkInternetReachable(IPAddress &resolvedIp) {
-  Serial.println("Resolving host: turkey-point-ai-monitor.onrender.com");
-  if (WiFi.hostByName("turkey-point-ai-monitor.onrender.com", resolvedIp)) {
-    Serial.printf("DNS resolved to %s\n", resolvedIp.toString().c_str());
-  } else {
-    Serial.println("DNS resolution failed");
+  if (WiFi.status() != WL_CONNECTED) {
+    // No unbounded retry here: callers keep sampling into the buffers and try
+    // again on the next flush.
+    LOG_WARN("WiFi connection failed");
     return false;
   }
 
-  WiFiClient tcp;
-  Serial.println("Checking TCP 443 reachability...");
-  if (!tcp.connect(resolvedIp, 443)) {
-    Serial.println("TCP 443 connection failed");
-    tcp.stop();
-    return false;
+  LOG_INFO("WiFi connected in %lu ms (%s). IP: %s", millis() - started, fast ? "fast" : "scan",
+           WiFi.localIP().toString().c_str());
+  if (!staticIp) {
+    // Capture the lease before overriding DNS, then keep it for the next connect.
+    WifiCache fresh = {};
+    memcpy(fresh.bssid, WiFi.BSSID(), sizeof(fresh.bssid));
+    fresh.channel = WiFi.channel();
+    fresh.ip = static_cast<uint32_t>(WiFi.localIP());
+    fresh.gateway = static_cast<uint32_t>(WiFi.gatewayIP());
+    fresh.subnet = static_cast<uint32_t>(WiFi.subnetMask());
+    wifiCacheStore(fresh);
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, dns1, dns2);
   }
-  tcp.stop();
-  Serial.println("TCP 443 reachable");
+  LOG_INFO("DNS set to 1.1.1.1 and 8.8.8.8");
+  timeStartSntp();
   return true;
 }
 
-bool beginHttps(HTTPClient &http, WiFiClientSecure &client) {
-  const String url = String(SERVER_URL);
-  int schemePos = url.indexOf("://");
-  int hostStart = schemePos >= 0 ? schemePos + 3 : 0;
-  int pathStart = url.indexOf('/', hostStart);
-  String host = pathStart >= 0 ? url.substring(hostStart, pathStart) : url.substring(hostStart);
-  String path = pathStart >= 0 ? url.substring(pathStart) : "/";
-  if (host.length() == 0) {
-    Serial.println("HTTPS begin failed: host empty");
-    return false;
-  }
-  client.setHandshakeTimeout(15000);
-  Serial.printf("HTTPS host=%s path=%s\n", host.c_str(), path.c_str());
-  return http.begin(client, host.c_str(), 443, path.c_str(), true);
-}
-
+#if NODE_HAS(SENSOR_BME680)
 void i2cScan() {
-  Serial.println("I2C scan...");
+  LOG_DEBUG("I2C scan...");
   byte count = 0;
   for (byte addr = 1; addr < 127; addr++) {
     Wire.beginTransmission(addr);
     byte err = Wire.endTransmission();
     if (err == 0) {
-      Serial.printf(" - Found device at 0x%02X\n", addr);
+      LOG_DEBUG(" - Found device at 0x%02X", addr);
       count++;
     }
   }
-  if (count == 0) Serial.println(" - No I2C devices found");
+  if (count == 0) LOG_WARN(" - No I2C devices found");
 }
 
 bool initBME() {
@@ -243,29 +192,44 @@ bool initBME() {
   uint8_t addrs[2] = {BME680_I2C_ADDR, BME680_I2C_ADDR_ALT};
   for (uint8_t addr : addrs) {
     if (addr == 0) continue;
-    Serial.printf("Trying BME680 at 0x%02X...\n", addr);
+    LOG_DEBUG("Trying BME680 at 0x%02X...", addr);
     if (bme.begin(addr)) {
       bmeAddrInUse = addr;
       found = true;
-      Serial.printf("BME680 detected at 0x%02X\n", addr);
+      LOG_INFO("BME680 detected at 0x%02X", addr);
       break;
     }
   }
   if (!found) {
-    Serial.println("BME680 not detected on I2C.");
+    LOG_WARN("BME680 not detected on I2C.");
     return false;
   }
-  bme.setTemperatureOversampling(BME680_OS_8X);
-  bme.setHumidityOversampling(BME680_OS_2X);
-  bme.setPressureOversampling(BME680_OS_4X);
-  bme.setIIRFilterSize(BME680_FILTER_SIZE_3);
-  bme.setGasHeater(320, 150);
+  bme.setTemperatureOversampling(BME_TEMP_OVERSAMPLING);
+  bme.setHumidityOversampling(BME_HUM_OVERSAMPLING);
+  bme.setPressureOversampling(BME_PRESS_OVERSAMPLING);
+  bme.setIIRFilterSize(BME_IIR_FILTER);
+  bme.setGasHeater(BME_HEATER_TEMP_C, BME_HEATER_MS); // 0 ms disables the heater
   return true;
 }
 
-bool readBME(float &tempC, float &hum, float &press, float &gas) {
-  if (!bme.performReading()) {
-    Serial.println("BME680 read failed");
+// Starts a forced-mode measurement and returns immediately; the conversion
+// and gas heater run while the other sensors are read.
+bool startBME() {
+  if (bme.beginReading() == 0) {
+    LOG_WARN("BME680 start failed");
+    return false;
+  }
+  return true;
+}
+
+// Collects the measurement started by startBME(), yielding for whatever part
+// of it has not elapsed yet.
+bool finishBME(float &tempC, float &hum, float &press, float &gas) {
+  StageSpan span(STAGE_BME); // the part of the measurement the sweep waits for
+  const int remaining = bme.remainingReadingMillis();
+  if (remaining > 0) vTaskDelay(pdMS_TO_TICKS(remaining));
+  if (!bme.endReading()) {
+    LOG_WARN("BME680 read failed");
     return false;
   }
   tempC = bme.temperature;
@@ -274,301 +238,783 @@ bool readBME(float &tempC, float &hum, float &press, float &gas) {
   gas = bme.gas_resistance;      // Ohms
   return true;
 }
+#endif
 
-// Simple monotonic mapping from gas resistance to pseudo-VOC (placeholder)
-float gasToVoc(float gasOhms) {
-  // Typical clean air ~100k-500k Ohms; map to ~100-300 ppb-like scale.
-  if (gasOhms <= 0) return 150.0f;
-  float logVal = log10(gasOhms);
-  float voc = 50.0f + (logVal * 80.0f); // tweak to ~100-300 range
-  if (voc < 50.0f) voc = 50.0f;
-  if (voc > 800.0f) voc = 800.0f; // cap
-  return voc;
-}
-
-bool readSDS(float &pm25, float &pm10) {
-  // Attempt to resync and parse SDS011 10-byte frames without blocking long
-  const unsigned long start = millis();
-  while (millis() - start < SDS_READ_WINDOW_MS) {
-    if (!sdsSerial.available()) {
-      delay(2);
-      continue;
-    }
-
-    int first = sdsSerial.read();
-    if (first < 0 || static_cast<uint8_t>(first) != SDS_HEADER1) continue;
+#if NODE_HAS(SENSOR_SDS011)
+// Wake lead over SDS_WARMUP_MS so tick rounding never cuts the warm-up short.
+static const uint32_t SDS_WAKE_LEAD_MS = SDS_WARMUP_MS + 1000;
 
-    uint8_t buf[SDS_FRAME_LEN];
-    buf[0] = SDS_HEADER1;
-    int idx = sdsSerial.readBytes(buf + 1, SDS_FRAME_LEN - 1);
-    if (idx != SDS_FRAME_LEN - 1) continue; // incomplete frame, resync
-    if (buf[1] != SDS_HEADER2 || buf[9] != SDS_TAIL) continue;
+// SDS_DUTY_CYCLE: whether the sensor should sleep through an interval.
+bool sdsCycles(uint32_t intervalMs) {
+  return SDS_DUTY_CYCLE && NODE_SENSOR_ON(SENSOR_SDS011) && intervalMs >= SDS_WAKE_LEAD_MS + SDS_DUTY_MIN_SLEEP_MS;
+}
+#endif
 
-    uint8_t checksum = 0;
-    for (int i = 2; i < 8; i++) checksum += buf[i];
-    if (checksum != buf[8]) continue;
+void beginUplink() {
+  uploader.begin(SERVER_URL);
+  if (&uplink != &uploader) uplink.begin(SERVER_URL);
+}
 
-    uint16_t pm25Raw = (buf[2] | (buf[3] << 8));
-    uint16_t pm10Raw = (buf[4] | (buf[5] << 8));
-    pm25 = pm25Raw / 10.0f;
-    pm10 = pm10Raw / 10.0f;
-    return true;
+// One GET on the HTTPS upload connection, which a following HTTP POST reuses.
+bool syncTimeFromServer() {
+  HTTPClient *http = uploader.prepare(TIME_SERVER_PATH);
+  if (!http) return false;
+  const unsigned long sent = millis();
+  const int code = uploader.get(uploadResponse, sizeof(uploadResponse));
+  const unsigned long rttMs = millis() - sent;
+  if (code != 200) {
+    LOG_WARN("Server time request failed: %d", code);
+    return false;
   }
-  return false;
+  StaticJsonDocument<128> doc;
+  if (deserializeJson(doc, uploadResponse)) return false;
+  double epochMs = doc["epoch_ms"] | 0.0; // older backends only send whole seconds
+  if (epochMs <= 0) epochMs = (doc["epoch"] | 0.0) * 1000.0;
+  if (epochMs < TIME_VALID_EPOCH * 1000.0) return false;
+  timeSetFromServer(static_cast<uint64_t>(epochMs), rttMs);
+  return true;
 }
 
-String isoTimestamp() {
-  struct tm timeinfo;
-  if (getLocalTime(&timeinfo)) {
-    char buf[32];
-    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &timeinfo);
-    return String(buf);
+// Pushes node config values that live outside nodeConfig into their owners.
+void applyNodeConfig() {
+  for (uint8_t i = 0; i < ReportPolicy::CHANNELS; i++) {
+    reportPolicy.setDeadband(static_cast<ReportPolicy::Channel>(i), nodeConfig.deadband[i]);
   }
-  // Fallback: still send something monotonic to avoid null
-  return String("1970-01-01T00:00:00Z");
 }
 
-bool postReading(float radiation, float pm25, float tempC, float hum, float press, float voc) {
-  if (WiFi.status() != WL_CONNECTED) connectWiFi();
-  Serial.printf("WiFi RSSI: %d dBm, free heap: %u\n", WiFi.RSSI(), ESP.getFreeHeap());
-  Serial.printf("Current epoch: %ld\n", static_cast<long>(time(nullptr)));
-  bool timeOk = ensureTimeSynced();
-  IPAddress resolvedIp;
-  if (!checkInternetReachable(resolvedIp)) {
-    Serial.println("Internet check failed; skipping POST");
-    return false;
+// An accepted upload may carry a signed "config" offer (backend
+// node_config.py) and a signed "ota" offer (backend firmware_store.py).
+// `nonce` is the one the upload was signed with.
+void applyOffers(const char *response, const char *nonce) {
+  if (!strstr(response, "\"config\"") && !strstr(response, "\"ota\"")) return;
+  StaticJsonDocument<64> filter;
+  filter["config"] = true;
+  filter["ota"] = true;
+  StaticJsonDocument<1024> doc;
+  if (deserializeJson(doc, response, DeserializationOption::Filter(filter))) return;
+  NodeConfig next;
+  if (nodeConfigApply(doc["config"], signer, next)) {
+    NodeConfigLock lock; // waits for the sensor task to finish its sample
+    nodeConfig = next;
+    applyNodeConfig();
   }
+  otaNoteOffer(doc["ota"], signer, nonce);
+}
+
+bool postSigned(const char *body, size_t len) {
+  if (WiFi.status() != WL_CONNECTED && !connectWiFi()) return false;
+  LOG_DEBUG("WiFi RSSI: %d dBm, free heap: %u, largest block: %u", WiFi.RSSI(), ESP.getFreeHeap(),
+            static_cast<unsigned>(heap_caps_get_largest_free_block(MALLOC_CAP_8BIT)));
+  LOG_DEBUG("Current epoch: %lu", static_cast<unsigned long>(timeNow()));
+  // The server rejects signatures outside its clock-skew window, so a
+  // build-time clock is not good enough here.
+  const bool timeOk = timeSynced() || (TIME_FROM_SERVER && uploader.configured() && syncTimeFromServer());
   if (!timeOk) {
-    Serial.println("Time not synced; skipping POST");
+    LOG_WARN("Time not synced; skipping POST");
     return false;
   }
 
-  StaticJsonDocument<512> doc;
-  doc["device_id"] = NODE_ID;
-  doc["timestamp"] = timeOk ? static_cast<long>(time(nullptr)) : 0;
-  JsonObject data = doc.createNestedObject("data");
-  const bool isWaterNode = String(NODE_ID) == "water_1";
-  if (isWaterNode) {
-    data["radiation_cpm"] = nullptr;
-    data["pm25"] = nullptr;
-    data["air_temp_c"] = nullptr;
-    data["humidity"] = nullptr;
-    data["pressure_hpa"] = nullptr;
-    data["voc"] = nullptr;
-  } else {
-    data["radiation_cpm"] = radiation;
-    data["pm25"] = pm25;
-    data["air_temp_c"] = tempC;
-    data["humidity"] = hum;
-    data["pressure_hpa"] = press;
-    data["voc"] = voc;
-  }
-  if (waterTempValid) {
-    data["water_temp_c"] = lastWaterTempC;
+  if (PAYLOAD_FORMAT == PAYLOAD_FORMAT_JSON) {
+    // Whole bodies outgrow the log ring and would be dropped; a prefix fits
+    // one LOG_LINE_MAX line.
+    const int shown = static_cast<int>(min(len, static_cast<size_t>(LOG_LINE_MAX - 48)));
+    LOG_DEBUG("SENDING JSON (%u bytes): %.*s%s", static_cast<unsigned>(len), shown, body,
+              static_cast<size_t>(shown) < len ? "..." : "");
   } else {
-    data["water_temp_c"] = nullptr;
+    LOG_DEBUG("SENDING %u bytes (%s)", static_cast<unsigned>(len), payloadContentType());
   }
-  data["turbidity_raw"] = lastTurbidityRaw;
-  data["tds_raw"] = lastTdsRaw;
-  data["ph_raw"] = lastPhRaw;
-
-  String body;
-  serializeJson(doc, body);
-  Serial.print("SENDING JSON: ");
-  Serial.println(body);
 
   const int maxAttempts = 4;
   int backoffMs = 1000;
+  uplink.resetCycle();
+  bool ok = false;
   for (int attempt = 1; attempt <= maxAttempts; attempt++) {
-    if (WiFi.status() != WL_CONNECTED) connectWiFi();
-    WiFiClientSecure client;
-    client.setTimeout(15000);
-    client.setInsecure(); // DEBUG ONLY - TODO: pin server cert
-    HTTPClient http;
-    http.setTimeout(15000);
-
-    if (!beginHttps(http, client)) {
-      Serial.println("HTTP begin failed");
-      return false;
+    healthBeat(); // each attempt is bounded by the uplink timeouts, all of them together are not
+    if (WiFi.status() != WL_CONNECTED && !connectWiFi()) break;
+    if (!uplink.configured()) {
+      LOG_ERROR("Uplink begin failed");
+      break;
     }
-    http.addHeader("Content-Type", "application/json");
-    http.addHeader("X-API-Key", API_KEY);
-    const String nonce = makeNonce();
-    const long ts = static_cast<long>(time(nullptr));
-    const String message = String(NODE_ID) + "." + String(ts) + "." + nonce + "." + body;
-    const String signature = hmacSha256Hex(message, NODE_SECRET);
-    http.addHeader("X-Node-Id", NODE_ID);
-    http.addHeader("X-Timestamp", String(ts));
-    http.addHeader("X-Nonce", nonce);
-    http.addHeader("X-Signature", signature);
-
-    Serial.printf("POST attempt %d/%d\n", attempt, maxAttempts);
-    int code = http.POST(body);
-    String resp = http.getString();
-    http.end();
-
-    Serial.printf("POST %s -> %d\n", SERVER_URL, code);
+    char nonce[NONCE_HEX_LEN + 1];
+    char ts[12];
+    char signature[SIGNATURE_HEX_LEN + 1];
+    makeNonce(nonce);
+    snprintf(ts, sizeof(ts), "%lu", static_cast<unsigned long>(timeNow()));
+    {
+      StageSpan span(STAGE_HMAC);
+      signRequest(signer, NODE_ID, ts, nonce, reinterpret_cast<const uint8_t *>(body), len, signature);
+    }
+    char configVersion[12];
+    snprintf(configVersion, sizeof(configVersion), "%lu", static_cast<unsigned long>(nodeConfig.version));
+    const SignedRequest req = {reinterpret_cast<const uint8_t *>(body), len, payloadContentType(), NODE_ID,
+                               ts, nonce, signature, configVersion};
+    const int code = uplink.send(req, uploadResponse, sizeof(uploadResponse));
+    if (code == HTTPC_ERROR_CONNECTION_REFUSED) {
+      LOG_WARN("Connect attempt %d/%d failed", attempt, maxAttempts);
+      if (attempt < maxAttempts) {
+        delay(backoffMs);
+        backoffMs = min(backoffMs * 2, 8000);
+      }
+      continue;
+    }
+
+    LOG_DEBUG("POST attempt %d/%d (%s)", attempt, maxAttempts,
+              uplink.lastReused() ? "reused connection" : "new connection");
+    LOG_INFO("POST %s -> %d", SERVER_URL, code);
     if (code >= 200 && code < 300) {
-      Serial.println(resp);
-      return true;
+      LOG_DEBUG("%s", uploadResponse);
+      applyOffers(uploadResponse, nonce);
+      ok = true;
+      break;
     } else if (code > 0) {
-      Serial.printf("Server error HTTP %d\n", code);
-      Serial.println(resp);
+      LOG_WARN("Server error HTTP %d: %s", code, uploadResponse);
       // fall through and retry
+    } else {
+      LOG_WARN("HTTP POST failed: %s", HTTPClient::errorToString(code).c_str());
+      if (uplink.lastReused() && attempt < maxAttempts) {
+        // Server dropped the idle keep-alive socket; reconnect right away.
+        continue;
+      }
     }
-    Serial.printf("HTTP POST failed: %s\n", http.errorToString(code).c_str());
     if (attempt < maxAttempts) {
       delay(backoffMs);
       backoffMs = min(backoffMs * 2, 8000);
     }
   }
-  return false;
+  uplink.logCycle();
+  return ok;
 }
 
-void setup() {
-  Serial.begin(115200);
-  delay(200);
-  bootMs = millis();
-  sdsWarmupUntil = bootMs + SDS_WARMUP_MS;
-  sdsDebugWindowEnd = sdsWarmupUntil + SDS_RAW_DEBUG_WINDOW_MS;
-  sdsNoFrameHintAt = sdsWarmupUntil + SDS_NO_FRAME_HINT_GRACE_MS;
-  geigerWindowStart = bootMs;
+void enqueueReading(const Reading &r) {
+  if (pendingReadings.empty()) pendingOldestMs = millis();
+  if (pendingReadings.full() && flashQueue.ready()) {
+    // Keep the oldest reading by moving it to flash instead of overwriting it.
+    if (flashQueue.append(&pendingReadings.front(), 1) == 1) pendingReadings.pop();
+  }
+  if (!pendingReadings.push(r)) {
+    readingsDropped++;
+    LOG_WARN("Reading buffer full; dropped oldest (%u dropped total)", readingsDropped);
+  }
+}
+
+bool batchDue() {
+  if (pendingReadings.empty() && flashQueue.size() == 0) return false;
+  if (nextFlushAttemptMs != 0 && static_cast<long>(millis() - nextFlushAttemptMs) < 0) return false;
+  if (urgentFlush) return true;
+  if (flashQueue.size() > 0) return true;
+  if (pendingReadings.size() >= nodeConfig.batchMax) return true;
+  return millis() - pendingOldestMs >= nodeConfig.batchMaxAgeMs;
+}
+
+// Moves everything still in RAM to flash so an outage (or a power loss while
+// offline) does not cost readings.
+void spillPendingToFlash() {
+  if (!flashQueue.ready()) return;
+  while (!pendingReadings.empty()) {
+    const size_t n = pendingReadings.copyOut(uploadScratch, sizeof(uploadScratch) / sizeof(uploadScratch[0]));
+    const size_t stored = flashQueue.append(uploadScratch, n);
+    pendingReadings.pop(stored);
+    if (stored < n) break;
+  }
+  LOG_INFO("Stored offline; %u reading(s) queued in flash", static_cast<unsigned>(flashQueue.size()));
+}
+
+// Returns the number of readings accepted by the server (0 on failure). This
+// can be fewer than `count` when the batch does not fit UPLOAD_BODY_CAPACITY.
+size_t postBatch(const Reading *items, size_t count) {
+  if (NODE_ROLE == NODE_ROLE_LEAF) return espnowLeafSend(items, count);
+
+  // One body per node: a gateway's buffers interleave its leaves' readings
+  // with its own.
+  size_t run = 1;
+  while (run < count && items[run].source == items[0].source) run++;
+  const char *deviceId = espnowSourceId(items[0].source);
+  if (!deviceId) {
+    LOG_WARN("Dropping %u reading(s) from unknown source %u", static_cast<unsigned>(run), items[0].source);
+    return run;
+  }
+
+  // Attach the timing histograms and the health block every
+  // DIAG_INTERVAL_MS; the histograms are only cleared once a body carrying
+  // them has been accepted.
+  static StageHistograms diag;
+  static NodeHealth health;
+  static unsigned long lastDiagMs = 0;
+  const bool withDiag =
+      items[0].source == 0 && DIAG_INTERVAL_MS > 0 && millis() - lastDiagMs >= DIAG_INTERVAL_MS;
+  if (withDiag) {
+    stageSnapshot(diag);
+    healthSnapshot(health);
+  }
+
+  size_t len = 0;
+  size_t included;
+  {
+    StageSpan span(STAGE_SERIALIZE);
+    included = buildBatchBody(items, run, uploadBody, sizeof(uploadBody), len, withDiag ? &diag : nullptr, deviceId,
+                              withDiag ? &health : nullptr);
+  }
+  if (included == 0) {
+    LOG_WARN("Batch body does not fit UPLOAD_BODY_CAPACITY");
+    return 0;
+  }
+  LOG_INFO("Uploading batch of %u reading(s) for %s, %u bytes", static_cast<unsigned>(included), deviceId,
+           static_cast<unsigned>(len));
+  if (!postSigned(uploadBody, len)) return 0;
+  otaNoteUpload(true); // confirms a freshly installed image
+  if (withDiag) {
+    stageConsume(diag);
+    lastDiagMs = millis();
+  }
+  return included;
+}
+
+// Leaves nothing in RAM that a restart would lose.
+void prepareRestart() {
+  drainReadingQueue();
+  spillPendingToFlash();
+  logFlush();
+}
+
+void noteFlushResult(bool ok) {
+  const HealthAction action = healthUploadResult(ok);
+  if (ok) {
+    offlineBackoffMs = 0;
+    nextFlushAttemptMs = 0;
+    return;
+  }
+  if (otaNoteUpload(false)) {
+    prepareRestart();
+    otaRollback();
+  }
+  // LOW_POWER_MODE starts from a cold radio on every wake anyway.
+  if (!LOW_POWER_MODE && action == HEALTH_ACTION_REBOOT) {
+    LOG_ERROR("Uploads keep failing; rebooting");
+    prepareRestart();
+    ESP.restart();
+  }
+  if (!LOW_POWER_MODE && action == HEALTH_ACTION_RESTART_WIFI && NODE_ROLE != NODE_ROLE_LEAF) {
+    LOG_WARN("Uploads keep failing; restarting WiFi");
+    WiFi.disconnect();
+    // A gateway keeps the radio on: its leaves reach it over ESP-NOW.
+    if (NODE_ROLE != NODE_ROLE_GATEWAY) WiFi.mode(WIFI_OFF);
+  }
+  offlineBackoffMs = offlineBackoffMs == 0 ? nodeConfig.intervalMs : min(offlineBackoffMs * 2, OFFLINE_RETRY_MAX_MS);
+  nextFlushAttemptMs = millis() + offlineBackoffMs;
+  LOG_WARN("Upload failed; next attempt in %lu ms", offlineBackoffMs);
+}
+
+// Gateway: readings verified by the ESP-NOW task join the pipeline like the
+// sensor task's, except that a full queue refuses them instead of dropping
+// the oldest; the leaf then keeps the reading and sends it again.
+bool acceptRelayed(const Reading &r) {
+  return xQueueSend(readingQueue, &r, 0) == pdTRUE;
+}
+
+// Moves readings handed over by the sensor task into the upload buffers.
+void drainReadingQueue() {
+  if (!readingQueue) return; // LOW_POWER_MODE runs without the tasks
+  Reading r;
+  while (xQueueReceive(readingQueue, &r, 0) == pdTRUE) enqueueReading(r);
+}
 
-  const bool isWaterNode = String(NODE_ID) == "water_1";
-  if (!isWaterNode) {
-    if (BME680_CS_PIN >= 0) {
-      pinMode(BME680_CS_PIN, OUTPUT);
-      digitalWrite(BME680_CS_PIN, HIGH);
+// Uploads queued readings oldest-first, one signed batch per request: first
+// the flash backlog, then RAM. Readings are only released once the server
+// has accepted them.
+bool flushReadings() {
+  urgentFlush = false;
+  while (flashQueue.size() > 0) {
+    const size_t before = flashQueue.size();
+    const size_t n = flashQueue.peek(uploadScratch, FLASH_DRAIN_BATCH);
+    if (n == 0) {
+      flashQueue.commitPeek(); // only corrupt records in range
+      if (flashQueue.size() == before) break;
+      continue;
+    }
+    const size_t sent = postBatch(uploadScratch, n);
+    if (sent == 0) {
+      spillPendingToFlash();
+      noteFlushResult(false);
+      return false;
     }
+    // Re-peek the part that was actually sent so the commit matches it.
+    if (sent < n) flashQueue.peek(uploadScratch, sent);
+    flashQueue.commitPeek();
+    LOG_INFO("Flash backlog: %u reading(s) left", static_cast<unsigned>(flashQueue.size()));
+    drainReadingQueue();
+  }
 
-    Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
-    delay(BME_I2C_STABILIZE_MS); // allow bus/sensors to power up
-    i2cScan();
+  while (!pendingReadings.empty()) {
+    const size_t count = pendingReadings.copyOut(uploadScratch, nodeConfig.batchMax);
+    const size_t sent = postBatch(uploadScratch, count);
+    if (sent == 0) {
+      spillPendingToFlash();
+      noteFlushResult(false);
+      return false;
+    }
+    pendingReadings.pop(sent);
+    pendingOldestMs = millis();
+    drainReadingQueue();
   }
+  noteFlushResult(true);
+  return true;
+}
 
-  ds18b20.begin();
+// Installs an offered update between flushes. Runs on the network task, so
+// sampling carries on and its readings keep being collected meanwhile; they
+// are uploaded (or spilled to flash) before the restart.
+// Called between OTA chunks: keeps readings moving and the watchdog fed.
+void otaPoll() {
+  drainReadingQueue();
+  healthBeat();
+}
+
+void installOta() {
+  if (WiFi.status() != WL_CONNECTED || !otaInstall(uploader, otaPoll)) return;
+  flushReadings();
+  prepareRestart();
+  ESP.restart();
+}
 
-  pinMode(GEIGER_PIN, GEIGER_USE_PULLUP ? INPUT_PULLUP : INPUT);
-  attachInterrupt(digitalPinToInterrupt(GEIGER_PIN), onGeigerPulse, RISING);
+void restoreSleepState() {
+  lastPm25 = sleepState.lastPm25;
+  lastPm10 = sleepState.lastPm10;
+  lastTempC = sleepState.lastTempC;
+  lastHum = sleepState.lastHum;
+  lastPress = sleepState.lastPress;
+  lastGas = sleepState.lastGas;
+  lastRadiationUsvh = sleepState.lastRadiationUsvh;
+  memcpy(lastWaterTempC, sleepState.lastWaterTempC, sizeof(lastWaterTempC));
+  geigerCarryPulses = sleepState.geigerPulses;
+  geigerCarryMs = sleepState.geigerCountedMs;
+  reportPolicy.state() = sleepState.report;
+  readingFilter.state() = sleepState.filter;
+  timeRestore(sleepState.wallClock);
+}
 
-  connectWiFi();
-  setupTime();
+void saveSleepState() {
+  sleepState.lastPm25 = lastPm25;
+  sleepState.lastPm10 = lastPm10;
+  sleepState.lastTempC = lastTempC;
+  sleepState.lastHum = lastHum;
+  sleepState.lastPress = lastPress;
+  sleepState.lastGas = lastGas;
+  sleepState.lastRadiationUsvh = lastRadiationUsvh;
+  memcpy(sleepState.lastWaterTempC, lastWaterTempC, sizeof(lastWaterTempC));
+#if NODE_HAS(SENSOR_GEIGER)
+  sleepState.geigerPulses = geigerCarryPulses + geiger.totalPulses();
+  sleepState.geigerCountedMs = geigerCarryMs + geiger.countedMs();
+#endif
+  sleepState.report = reportPolicy.state();
+  sleepState.filter = readingFilter.state();
+#if NODE_HAS(SENSOR_SDS011)
+  sleepState.sdsRunning = !sds.sleeping();
+#endif
+  sleepStateMarkValid();
+}
 
-  if (!isWaterNode) {
-    sdsSerial.begin(9600, SERIAL_8N1, SDS_RX_PIN, SDS_TX_PIN);
-    sdsSerial.setTimeout(SDS_READ_TIMEOUT_MS);
-    while (sdsSerial.available()) sdsSerial.read(); // flush stale boot garbage
+// Applies the edge anomaly scorer, the FILTER_* modes and ADAPTIVE_REPORTING
+// to a fresh sample. The scorer sees the raw values, since a Hampel filter
+// clamps exactly the spikes it looks for; an anomalous reading is also
+// uploaded as measured. `urgent` is set when the reading should be uploaded
+// right away rather than batched.
+bool shouldReport(Reading &r, bool &urgent) {
+  urgent = false;
+  float score;
+  const Reading raw = r;
+  readingFilter.apply(r); // always, so the filter windows keep up
+  if (edgeAnomalous(raw, score)) {
+    LOG_INFO("Edge anomaly score %.3f; uploading now", score);
+    urgent = true;
+    r = raw;
+  }
+  if (!ADAPTIVE_REPORTING) return true;
+  const ReportPolicy::Decision d = reportPolicy.evaluate(r);
+  urgent = urgent || (d.report && d.escalated);
+  return d.report || urgent;
+}
 
-    if (!initBME()) {
-      Serial.println("BME680 init failed; continuing without real readings.");
-      bmeRetryAt = millis() + 10000;
+// LOW_POWER_MODE: one sample per wake, then deep sleep. Readings wait in RTC
+// memory; only every DEEP_SLEEP_UPLOAD_EVERY-th wake (or a full RTC buffer)
+// brings Wi-Fi up and runs the normal flush path.
+void runLowPowerCycle(unsigned long wakeMs) {
+  healthWatch(HEALTH_TASK_SENSORS);
+  Reading r = sampleSensors();
+  bool urgent = false;
+  // An unconfirmed image has to get a reading accepted before it sleeps.
+  const bool report = shouldReport(r, urgent) || otaVerifying();
+  if (report && !sleepStatePush(r)) LOG_WARN("RTC reading buffer full; dropped oldest");
+  sleepState.wakeCount++;
+
+  const bool uploadWake = urgent || otaVerifying() || sleepState.wakeCount % DEEP_SLEEP_UPLOAD_EVERY == 0 ||
+                          sleepStateFull();
+  if (uploadWake) {
+    healthWatch(HEALTH_TASK_NETWORK);
+    if (FLASH_QUEUE_ENABLED) flashQueue.begin();
+    for (uint16_t i = 0; i < sleepState.pendingCount; i++) enqueueReading(sleepState.pending[i]);
+    sleepState.pendingCount = 0;
+    if (NODE_ROLE == NODE_ROLE_LEAF && espnowLeafBegin()) {
+      flushReadings(); // spills to flash itself if the gateway does not answer
+    } else if (NODE_ROLE != NODE_ROLE_LEAF && connectWiFi()) {
+      beginUplink();
+      flushReadings();
+      if (otaDue()) installOta();
     } else {
-      delay(BME_POST_CONFIG_DELAY_MS); // stabilize before first real reading
-      bmeWarmupUntil = millis();
-      bmeReady = true;
+      spillPendingToFlash();
+    }
+    // Whatever neither the server nor flash took goes back to RTC memory.
+    while (!pendingReadings.empty()) {
+      sleepStatePush(pendingReadings.front());
+      pendingReadings.pop();
     }
+  } else {
+    LOG_INFO("Buffered %u reading(s) in RTC memory (wake %u)", sleepState.pendingCount,
+             sleepState.wakeCount);
+  }
+
+  const unsigned long intervalMs = ADAPTIVE_REPORTING ? reportPolicy.nextIntervalMs(nodeConfig.intervalMs) : nodeConfig.intervalMs;
+  const unsigned long awakeMs = millis() - wakeMs;
+  uint32_t sleepMs = awakeMs + DEEP_SLEEP_MIN_MS < intervalMs ? intervalMs - awakeMs : DEEP_SLEEP_MIN_MS;
+#if NODE_HAS(SENSOR_SDS011)
+  // Split the sleep: a short wake SDS_WAKE_LEAD_MS before the sample only
+  // starts the sensor, which then warms up while the ESP32 sleeps again.
+  sleepState.sdsPrewake = sdsCycles(sleepMs);
+  if (sleepState.sdsPrewake) {
+    sds.sleep();
+    sleepMs -= SDS_WAKE_LEAD_MS;
   }
+#endif
+  if (otaVerifying()) {
+    // Deep sleep resets through the bootloader, which would roll back an
+    // unconfirmed image anyway; do it now.
+    prepareRestart();
+    otaRollback();
+  }
+  saveSleepState();
+  enterDeepSleep(sleepMs);
+}
+
+void setup() {
+  Serial.begin(115200);
+  logBegin();
+  healthBegin(); // early: reports the previous run's reset and arms the watchdog
+  const bool resumed = LOW_POWER_MODE && sleepStateRestorable();
+  if (!resumed) delay(200);
+  bootMs = millis();
+  sdsWarmupUntil = bootMs + SDS_WARMUP_MS;
+  sdsDebugWindowEnd = sdsWarmupUntil + SDS_RAW_DEBUG_WINDOW_MS;
+  sdsNoFrameHintAt = sdsWarmupUntil + SDS_NO_FRAME_HINT_GRACE_MS;
+  for (uint8_t i = 0; i < DS18B20_MAX_PROBES; i++) lastWaterTempC[i] = NAN;
+  nodeConfigLoad(); // before the drivers: the Geiger window is fixed at begin()
+  applyNodeConfig();
+  otaBegin();
+  readingFilter.reset();
+  if (LOW_POWER_MODE) {
+    if (resumed) {
+      restoreSleepState();
+    } else {
+      sleepStateReset();
+    }
+  }
+#if NODE_HAS(SENSOR_SDS011)
+  if (resumed && sleepState.sdsPrewake) {
+    sds.begin(sdsSerial, SDS_RX_PIN, SDS_TX_PIN);
+    sleepState.sdsPrewake = false;
+    sleepState.sdsRunning = true;
+    enterDeepSleep(SDS_WAKE_LEAD_MS);
+  }
+#endif
+
+#if NODE_HAS(SENSOR_BME680)
+  if (BME680_CS_PIN >= 0) {
+    pinMode(BME680_CS_PIN, OUTPUT);
+    digitalWrite(BME680_CS_PIN, HIGH);
+  }
+
+  Wire.begin(I2C_SDA_PIN, I2C_SCL_PIN);
+  delay(BME_I2C_STABILIZE_MS); // allow bus/sensors to power up
+  if (!resumed) i2cScan(); // keep wake-to-sample time short after deep sleep
+#endif
+
+#if NODE_HAS(SENSOR_DS18B20)
+  waterProbes.begin(ds18b20, DS18B20_RESOLUTION);
+#endif
+#if NODE_HAS(SENSOR_WATER_ADC)
+  const uint8_t adcPins[AdcSampler::CHANNELS] = {TURBIDITY_PIN, TDS_PIN, PH_PIN};
+  waterAdc.begin(adcPins, !LOW_POWER_MODE);
+#endif
+#if NODE_HAS(SENSOR_GEIGER)
+  geiger.begin(GEIGER_PIN, GEIGER_USE_PULLUP, nodeConfig.geigerWindowMs);
+#endif
+
+  timeBegin(); // stamp readings sensibly even if we boot offline
+  signer.begin(NODE_SECRET);
+  if (FLASH_QUEUE_ENABLED && !LOW_POWER_MODE) flashQueue.begin(); // low-power mounts it on upload wakes only
+
+#if NODE_HAS(SENSOR_SDS011)
+  sds.setRawDebugWindow(sdsWarmupUntil, sdsDebugWindowEnd);
+  // After a deep sleep the sensor has normally been warming up all along.
+  sds.begin(sdsSerial, SDS_RX_PIN, SDS_TX_PIN, resumed && sleepState.sdsRunning ? SDS_WARMUP_MS : 0);
+#endif
+#if NODE_HAS(SENSOR_BME680)
+  if (!initBME()) {
+    LOG_ERROR("BME680 init failed; continuing without real readings.");
+    bmeRetryAt = millis() + 10000;
+  } else {
+    delay(BME_POST_CONFIG_DELAY_MS); // stabilize before first real reading
+    bmeWarmupUntil = millis();
+    bmeReady = true;
+  }
+#endif
+
+  if (LOW_POWER_MODE) runLowPowerCycle(bootMs); // does not return
+
+  readingQueue = xQueueCreate(READING_QUEUE_DEPTH, sizeof(Reading));
+  xTaskCreatePinnedToCore(networkTask, "net", NETWORK_TASK_STACK, nullptr, NETWORK_TASK_PRIORITY, nullptr,
+                          NETWORK_TASK_CORE);
+  xTaskCreatePinnedToCore(sensorTask, "sensors", SENSOR_TASK_STACK, nullptr, SENSOR_TASK_PRIORITY, nullptr,
+                          SENSOR_TASK_CORE);
 }
 
 void loop() {
-  rawSdsDebugWindow();
+  // All work happens in sensorTask/networkTask.
+  vTaskDelete(nullptr);
+}
 
-  const bool isWaterNode = String(NODE_ID) == "water_1";
-  if (!isWaterNode && !bmeReady && millis() >= bmeRetryAt) {
-    Serial.println("Retrying BME680 init...");
+Reading sampleSensors() {
+  const unsigned long sweepStart = millis();
+  Reading reading;
+  reading.epoch = timeNow(); // sample time, not upload time
+  reading.source = 0;
+  // Switched-off sensors are sent as null, but the ADC block is left out.
+  reading.sensors = NODE_SENSORS;
+  if (!NODE_SENSOR_ON(SENSOR_WATER_ADC)) reading.sensors &= ~SENSOR_WATER_ADC;
+#if NODE_HAS(SENSOR_DS18B20)
+  if (NODE_SENSOR_ON(SENSOR_DS18B20)) waterProbes.start(); // converts while the other sensors are read
+#endif
+
+#if NODE_HAS(SENSOR_BME680)
+  const bool bmeOn = NODE_SENSOR_ON(SENSOR_BME680);
+  if (bmeOn && !bmeReady && millis() >= bmeRetryAt) {
+    LOG_INFO("Retrying BME680 init...");
     i2cScan();
     bmeReady = initBME();
     if (!bmeReady) {
       bmeRetryAt = millis() + 10000; // retry in 10s
     } else {
       delay(BME_POST_CONFIG_DELAY_MS);
-      
       bmeWarmupUntil = millis();
     }
   }
-
-  float tempC = lastTempC, hum = lastHum, press = lastPress, gas = lastGas;
-  if (!isWaterNode) {
-    if (bmeReady && millis() >= bmeWarmupUntil && readBME(tempC, hum, press, gas)) {
-      lastTempC = tempC;
-      lastHum = hum;
-      lastPress = press;
-      lastGas = gas;
-    } else if (bmeReady && millis() < bmeWarmupUntil) {
-      Serial.println("BME680 warming up...");
+  const bool bmeDue = bmeOn && bmeReady && millis() >= bmeWarmupUntil;
+  const bool bmeStarted = bmeDue && startBME();
+#endif
+
+#if NODE_HAS(SENSOR_SDS011)
+  const bool sdsOn = NODE_SENSOR_ON(SENSOR_SDS011);
+  if (sdsOn == sds.sleeping()) {
+    // Switched off or back on by the node config.
+    if (sdsOn) {
+      sds.wake();
     } else {
-      Serial.println("Using fallback BME defaults this cycle.");
+      sds.sleep();
     }
   }
-
-  float pm25 = lastPm25;
-  float pm10 = lastPm10;
-  if (!isWaterNode) {
-    float pmRead25 = 0, pmRead10 = 0;
-    bool sdsWarming = millis() < sdsWarmupUntil;
-    if (readSDS(pmRead25, pmRead10)) {
-      pm25 = pmRead25;
-      pm10 = pmRead10;
-      lastPm25 = pm25;
-      lastPm10 = pm10;
-      sdsLastGoodFrameMs = millis();
+  const bool sdsWarming = millis() - sds.wokeAtMs() < SDS_WARMUP_MS;
+  if (sdsOn && !sdsWarming) sds.query(); // answered while the other sensors are read
+#endif
+
+  // Fields for sensors this profile lacks, or the node config has switched
+  // off, stay NAN / 0 and are sent as null.
+  reading.pm25 = NAN;
+#if NODE_HAS(SENSOR_SDS011)
+  if (sdsOn) {
+    SdsSample pm;
+    bool gotFrames = false;
+    if (!sdsWarming) {
+      StageSpan span(STAGE_SDS);
+      const unsigned long askedMs = millis();
+      while (!(gotFrames = sds.takeAverage(pm)) && millis() - askedMs < SDS_QUERY_TIMEOUT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+      }
+    }
+    if (gotFrames) {
+      lastPm25 = pm.pm25;
+      lastPm10 = pm.pm10;
       sdsNoFrameHintAt = millis() + SDS_NO_FRAME_HINT_GRACE_MS;
       sdsHintShown = false;
     } else {
       if (sdsWarming) {
-        Serial.println("SDS011 warming up...");
+        LOG_INFO("SDS011 warming up...");
       } else if (!sdsHintShown && millis() > sdsNoFrameHintAt) {
-        Serial.println("No valid SDS frames: check 5V power/fan, RX/TX swap, shared GND, or baud");
+        LOG_WARN("No valid SDS frames: check 5V power/fan, RX/TX swap, shared GND, or baud");
         sdsHintShown = true;
-      } else if (!sdsWarming && millis() > sdsWarmupUntil) {
-        Serial.println("SDS011 read failed; reusing last PM2.5 value.");
+      } else if (millis() > sdsWarmupUntil) {
+        LOG_WARN("SDS011 read failed; reusing last PM2.5 value.");
       } else {
         // still within grace window; stay quiet
       }
     }
+    if (!sdsWarming && healthSensorResult(HEALTH_SENSOR_SDS, gotFrames)) {
+      LOG_WARN("SDS011 keeps failing; restarting its UART");
+      sds.restart();
+    }
+    reading.pm25 = lastPm25;
   }
+#endif
 
   // Geiger CPM -> uSv/h (SEN0463)
-  float radiationUsvh = lastRadiationUsvh;
-  if (!isWaterNode) {
-    unsigned long now = millis();
-    if (now - geigerWindowStart >= GEIGER_WINDOW_MS) {
-      uint32_t pulses = 0;
-      portENTER_CRITICAL(&geigerMux);
-      pulses = geigerPulses;
-      geigerPulses = 0;
-      portEXIT_CRITICAL(&geigerMux);
-
-      float cpm = (pulses * 60000.0f) / GEIGER_WINDOW_MS;
-      radiationUsvh = cpm / GEIGER_CPM_PER_USVH;
-      lastRadiationUsvh = radiationUsvh;
-      geigerWindowStart = now;
+  reading.radiationUsvh = NAN;
+#if NODE_HAS(SENSOR_GEIGER)
+  if (NODE_SENSOR_ON(SENSOR_GEIGER)) {
+    float cpm = 0.0f;
+    if (LOW_POWER_MODE) {
+      // PCNT does not run in deep sleep; the window accumulates awake time.
+      const uint32_t ms = geigerCarryMs + geiger.countedMs();
+      if (ms >= nodeConfig.geigerWindowMs) {
+        const uint32_t pulses = geigerCarryPulses + geiger.totalPulses();
+        lastRadiationUsvh = GeigerCounter::correctDeadTime(pulses * 60000.0f / ms) / GEIGER_CPM_PER_USVH;
+        // Start a new window now (unsigned wrap: carry + total reads 0 from here).
+        geigerCarryPulses = -geiger.totalPulses();
+        geigerCarryMs = -geiger.countedMs();
+      }
+    } else if (geiger.cpm(cpm)) {
+      lastRadiationUsvh = cpm / GEIGER_CPM_PER_USVH;
     }
+    reading.radiationUsvh = lastRadiationUsvh;
   }
-  float voc = gasToVoc(gas);
+#endif
 
-  ds18b20.requestTemperatures();
-  float waterTemp = ds18b20.getTempCByIndex(0);
-  if (waterTemp != DEVICE_DISCONNECTED_C) {
-    lastWaterTempC = waterTemp;
-    waterTempValid = true;
-  } else {
-    waterTempValid = false;
+  AdcSummary adc[AdcSampler::CHANNELS] = {};
+#if NODE_HAS(SENSOR_WATER_ADC)
+  {
+    StageSpan span(STAGE_ADC);
+    waterAdc.summarize(adc);
+  }
+#endif
+
+  reading.tempC = reading.hum = reading.pressHpa = reading.voc = NAN;
+#if NODE_HAS(SENSOR_BME680)
+  if (bmeOn) {
+    float tempC = lastTempC, hum = lastHum, press = lastPress, gas = lastGas;
+    const bool bmeOk = bmeStarted && finishBME(tempC, hum, press, gas);
+    if (bmeOk) {
+      lastTempC = tempC;
+      lastHum = hum;
+      lastPress = press;
+      lastGas = gas;
+    } else if (bmeReady && millis() < bmeWarmupUntil) {
+      LOG_INFO("BME680 warming up...");
+    } else {
+      LOG_WARN("Using fallback BME defaults this cycle.");
+    }
+    if (bmeDue && healthSensorResult(HEALTH_SENSOR_BME, bmeOk)) {
+      LOG_WARN("BME680 keeps failing; reinitializing");
+      bmeReady = false;
+      bmeRetryAt = 0; // the next sample runs initBME()
+    }
+    reading.tempC = tempC;
+    reading.hum = hum;
+    reading.pressHpa = press;
+    reading.voc = gasToVoc(gas);
+  }
+#endif
+
+  for (uint8_t i = 0; i < DS18B20_MAX_PROBES; i++) reading.waterTempC[i] = NAN;
+#if NODE_HAS(SENSOR_DS18B20)
+  if (NODE_SENSOR_ON(SENSOR_DS18B20)) {
+    uint8_t probesRead;
+    {
+      StageSpan span(STAGE_DS18B20);
+      probesRead = waterProbes.collect(reading.waterTempC);
+    }
+    if (probesRead > 0) {
+      memcpy(lastWaterTempC, reading.waterTempC, sizeof(lastWaterTempC));
+    }
   }
-  lastTurbidityRaw = analogRead(TURBIDITY_PIN);
-  lastTdsRaw = analogRead(TDS_PIN);
-  lastPhRaw = analogRead(PH_PIN);
+#endif
+
+  reading.turbidityRaw = adc[0].medianRaw;
+  reading.turbidityMv = adc[0].mv;
+  reading.tdsRaw = adc[1].medianRaw;
+  reading.tdsMv = adc[1].mv;
+  reading.phRaw = adc[2].medianRaw;
+  reading.phMv = adc[2].mv;
+  LOG_DEBUG("Sensor sweep took %lu ms", millis() - sweepStart);
+  return reading;
+}
 
-  postReading(radiationUsvh, pm25, tempC, hum, press, voc);
-  delay(SEND_INTERVAL_MS);
+// Hands a reading to the network task without ever blocking the sampler. If
+// the network side has fallen behind far enough to fill the queue the oldest
+// queued reading is dropped so the cadence is preserved.
+void publishReading(const Reading &r) {
+  if (xQueueSend(readingQueue, &r, 0) == pdTRUE) return;
+  Reading dropped;
+  xQueueReceive(readingQueue, &dropped, 0);
+  xQueueSend(readingQueue, &r, 0);
+  readingQueueOverflows++;
+  LOG_WARN("Reading queue full; dropped oldest (%u total)", readingQueueOverflows);
 }
 
-void rawSdsDebugWindow() {
-  if (!SDS_RAW_DEBUG) return;
-  if (millis() < sdsWarmupUntil) return;
-  if (millis() > sdsDebugWindowEnd) return;
-  while (sdsSerial.available()) {
-    uint8_t b = sdsSerial.read();
-    Serial.printf("%02X ", b);
+void sensorTask(void *) {
+  healthWatch(HEALTH_TASK_SENSORS);
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    Reading r;
+    bool report, urgent = false;
+    uint32_t intervalMs;
+#if NODE_HAS(SENSOR_SDS011)
+    bool sdsCycle;
+#endif
+    {
+      // The network task swaps in pushed configs; none lands mid-sample.
+      NodeConfigLock lock;
+      r = sampleSensors();
+      report = shouldReport(r, urgent);
+      intervalMs = ADAPTIVE_REPORTING ? reportPolicy.nextIntervalMs(nodeConfig.intervalMs) : nodeConfig.intervalMs;
+#if NODE_HAS(SENSOR_WATER_ADC)
+      waterAdc.setIntervalMs(intervalMs);
+#endif
+#if NODE_HAS(SENSOR_SDS011)
+      sdsCycle = sdsCycles(intervalMs);
+#endif
+    }
+    if (report) {
+      if (urgent) urgentFlush = true;
+      publishReading(r);
+    }
+    // Fixed-rate schedule: sample time does not drift with sensor or upload latency.
+#if NODE_HAS(SENSOR_SDS011)
+    if (sdsCycle) {
+      sds.sleep();
+      healthDelayUntil(lastWake, intervalMs - SDS_WAKE_LEAD_MS);
+      sds.wake();
+      healthDelayUntil(lastWake, SDS_WAKE_LEAD_MS);
+      continue;
+    }
+#endif
+    healthDelayUntil(lastWake, intervalMs);
+  }
+}
+
+void networkTask(void *) {
+  healthWatch(HEALTH_TASK_NETWORK);
+  if (NODE_ROLE == NODE_ROLE_LEAF) {
+    espnowLeafBegin();
+  } else {
+    connectWiFi();
+    beginUplink();
+    if (NODE_ROLE == NODE_ROLE_GATEWAY) espnowGatewayBegin(acceptRelayed);
+  }
+  for (;;) {
+    healthBeat();
+    Reading r;
+    // Wake at least once a second so age-based flushes fire on time.
+    if (xQueueReceive(readingQueue, &r, pdMS_TO_TICKS(1000)) == pdTRUE) {
+      enqueueReading(r);
+      drainReadingQueue();
+    }
+    if (batchDue()) flushReadings();
+    if (otaDue()) installOta();
   }
 }
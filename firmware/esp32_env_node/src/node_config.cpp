@@ -0,0 +1,163 @@
+#include "node_config.h"
+
+#include <Preferences.h>
+
+#include "logger.h"
+
+static const char *NVS_NAMESPACE = "nodecfg";
+static const char *NVS_KEY_VERSION = "v";
+static const char *NVS_KEY_BODY = "body";
+static const size_t CONFIG_BODY_MAX = 384;
+
+static const char *CHANNEL_KEYS[ReportPolicy::CHANNELS] = {"radiation", "pm25", "water_temp"};
+
+struct SensorName {
+  const char *name;
+  uint32_t bit;
+};
+
+static const SensorName SENSOR_NAMES[] = {
+    {"bme680", SENSOR_BME680}, {"sds011", SENSOR_SDS011},      {"geiger", SENSOR_GEIGER},
+    {"ds18b20", SENSOR_DS18B20}, {"water_adc", SENSOR_WATER_ADC},
+};
+
+NodeConfig nodeConfig;
+static SemaphoreHandle_t configMutex = nullptr;
+
+NodeConfigLock::NodeConfigLock() {
+  xSemaphoreTake(configMutex, portMAX_DELAY);
+}
+
+NodeConfigLock::~NodeConfigLock() {
+  xSemaphoreGive(configMutex);
+}
+
+static NodeConfig compiledDefaults() {
+  NodeConfig c;
+  c.version = 0;
+  c.intervalMs = SEND_INTERVAL_MS;
+  c.batchMax = BATCH_MAX_READINGS;
+  c.batchMaxAgeMs = BATCH_MAX_AGE_MS;
+  c.geigerWindowMs = min(static_cast<uint32_t>(GEIGER_WINDOW_MS), static_cast<uint32_t>(GEIGER_MAX_BINS) * 1000);
+  c.deadband[ReportPolicy::RADIATION] = REPORT_RAD_DEADBAND_USVH;
+  c.deadband[ReportPolicy::PM25] = REPORT_PM25_DEADBAND;
+  c.deadband[ReportPolicy::WATER_TEMP] = REPORT_WATER_TEMP_DEADBAND_C;
+  c.sensors = NODE_SENSORS;
+  return c;
+}
+
+static uint32_t clampMs(JsonVariantConst v, uint32_t fallback, uint32_t lo, uint32_t hi) {
+  if (!v.is<uint32_t>()) return fallback;
+  return constrain(v.as<uint32_t>(), lo, hi);
+}
+
+// Keys and ranges match backend/node_config.py. Anything missing keeps its
+// compile-time default; the backend has already validated the rest, so
+// clamping here only guards against a mismatched build.
+static bool nodeConfigParse(const char *body, uint32_t version, NodeConfig &out) {
+  StaticJsonDocument<512> doc;
+  if (deserializeJson(doc, body) != DeserializationError::Ok || !doc.is<JsonObject>()) return false;
+
+  out = compiledDefaults();
+  out.version = version;
+  out.intervalMs = clampMs(doc["interval_ms"], out.intervalMs, 1000, 3600000);
+  out.batchMax = clampMs(doc["batch_max"], out.batchMax, 1, BATCH_MAX_READINGS);
+  out.batchMaxAgeMs = clampMs(doc["batch_max_age_ms"], out.batchMaxAgeMs, 1000, 3600000);
+  out.geigerWindowMs = clampMs(doc["geiger_window_ms"], out.geigerWindowMs, 1000,
+                               static_cast<uint32_t>(GEIGER_MAX_BINS) * 1000);
+
+  JsonObjectConst bands = doc["deadband"];
+  for (uint8_t i = 0; i < ReportPolicy::CHANNELS; i++) {
+    JsonVariantConst band = bands[CHANNEL_KEYS[i]];
+    if (band.is<float>() && band.as<float>() >= 0) out.deadband[i] = band.as<float>();
+  }
+
+  JsonArrayConst sensors = doc["sensors"];
+  if (!sensors.isNull()) {
+    uint32_t mask = 0;
+    for (JsonVariantConst s : sensors) {
+      for (const SensorName &n : SENSOR_NAMES) {
+        if (strcmp(s | "", n.name) == 0) mask |= n.bit;
+      }
+    }
+    out.sensors = mask & NODE_SENSORS;
+  }
+  return true;
+}
+
+static void logConfig(const char *what, const NodeConfig &c) {
+  LOG_INFO("%s v%lu: interval %lu ms, batch %u/%lu ms, geiger %lu ms, sensors 0x%02lx", what,
+           static_cast<unsigned long>(c.version), static_cast<unsigned long>(c.intervalMs),
+           static_cast<unsigned>(c.batchMax), static_cast<unsigned long>(c.batchMaxAgeMs),
+           static_cast<unsigned long>(c.geigerWindowMs), static_cast<unsigned long>(c.sensors));
+}
+
+void nodeConfigLoad() {
+  if (!configMutex) configMutex = xSemaphoreCreateMutex();
+  nodeConfig = compiledDefaults();
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, true)) return;
+  const uint32_t version = prefs.getUInt(NVS_KEY_VERSION, 0);
+  char body[CONFIG_BODY_MAX + 1] = {0};
+  const size_t len = version ? prefs.getString(NVS_KEY_BODY, body, sizeof(body)) : 0;
+  prefs.end();
+  // The version is kept even on defaults: it is what older offers are
+  // checked against.
+  nodeConfig.version = version;
+  if (len == 0) return;
+  NodeConfig loaded;
+  if (!nodeConfigParse(body, version, loaded)) {
+    LOG_WARN("Stored node config v%lu unreadable; using defaults", static_cast<unsigned long>(version));
+    return;
+  }
+  nodeConfig = loaded;
+  logConfig("Node config", nodeConfig);
+}
+
+static bool signatureMatches(HmacSigner &signer, uint32_t version, const char *body, const char *sigHex) {
+  char head[64];
+  const int n = snprintf(head, sizeof(head), "config.%s.%lu.", NODE_ID, static_cast<unsigned long>(version));
+  if (n <= 0 || static_cast<size_t>(n) >= sizeof(head)) return false;
+  uint8_t mac[HmacSigner::MAC_LEN];
+  signer.start();
+  signer.update(head, n);
+  signer.update(body, strlen(body));
+  signer.finish(mac);
+  char expected[SIGNATURE_HEX_LEN + 1];
+  toHex(mac, sizeof(mac), expected);
+  return signatureEquals(expected, sigHex);
+}
+
+bool nodeConfigApply(JsonVariantConst offer, HmacSigner &signer, NodeConfig &out) {
+  if (!offer.is<JsonObjectConst>() || !offer["version"].is<uint32_t>()) return false;
+  const uint32_t version = offer["version"];
+  const char *body = offer["body"];
+  if (!body || version == nodeConfig.version) return false;
+  if (version < nodeConfig.version) {
+    LOG_WARN("Node config v%lu older than v%lu; ignored", static_cast<unsigned long>(version),
+             static_cast<unsigned long>(nodeConfig.version));
+    return false;
+  }
+  if (strlen(body) > CONFIG_BODY_MAX) {
+    LOG_WARN("Node config v%lu too large (%u bytes); ignored", static_cast<unsigned long>(version),
+             static_cast<unsigned>(strlen(body)));
+    return false;
+  }
+  if (!signatureMatches(signer, version, body, offer["sig"])) {
+    LOG_WARN("Node config v%lu has a bad signature; ignored", static_cast<unsigned long>(version));
+    return false;
+  }
+  if (!nodeConfigParse(body, version, out)) {
+    LOG_WARN("Node config v%lu unreadable; ignored", static_cast<unsigned long>(version));
+    return false;
+  }
+
+  Preferences prefs;
+  if (prefs.begin(NVS_NAMESPACE, false)) {
+    prefs.putString(NVS_KEY_BODY, body);
+    prefs.putUInt(NVS_KEY_VERSION, version);
+    prefs.end();
+  }
+  logConfig("Applied node config", out);
+  return true;
+}
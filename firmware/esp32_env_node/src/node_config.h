@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "config_defaults.h"
+#include "report_policy.h"
+#include "signing.h"
+
+// Sampling parameters the backend can push in a telemetry response as
+// "config": {"version", "body", "sig"} (backend node_config.py). The body is a
+// JSON overlay on the compile-time defaults below, signed with the node's
+// HMAC secret over "config.<nodeId>.<version>.<body>"; "{}" means defaults.
+// Versions only grow, and an offer not newer than the running one is
+// ignored, so an old signed config cannot be replayed. An accepted body and
+// its version are kept in NVS, so they also apply after a reboot or deep
+// sleep.
+struct NodeConfig {
+  uint32_t version;
+  uint32_t intervalMs;      // SEND_INTERVAL_MS
+  uint16_t batchMax;        // BATCH_MAX_READINGS (never above it)
+  uint32_t batchMaxAgeMs;   // BATCH_MAX_AGE_MS
+  uint32_t geigerWindowMs;  // GEIGER_WINDOW_MS; takes effect on the next boot
+  float deadband[ReportPolicy::CHANNELS];
+  uint32_t sensors;         // SENSOR_* bits sampled; a subset of NODE_SENSORS
+};
+
+// Written by the network task only, under NodeConfigLock; the sensor task
+// holds the lock while it reads.
+extern NodeConfig nodeConfig;
+
+class NodeConfigLock {
+ public:
+  NodeConfigLock();
+  ~NodeConfigLock();
+  NodeConfigLock(const NodeConfigLock &) = delete;
+  NodeConfigLock &operator=(const NodeConfigLock &) = delete;
+};
+
+// Compiled in and not switched off by the pushed config.
+#define NODE_SENSOR_ON(sensor) (NODE_HAS(sensor) && (nodeConfig.sensors & (sensor)) != 0)
+
+// Compile-time defaults overlaid with the body saved in NVS, if any.
+void nodeConfigLoad();
+// Checks the signature and version of a "config" offer and saves it. Returns
+// true with the new configuration in `out`; the caller installs it in
+// nodeConfig.
+bool nodeConfigApply(JsonVariantConst offer, HmacSigner &signer, NodeConfig &out);
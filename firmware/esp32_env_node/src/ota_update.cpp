@@ -0,0 +1,296 @@
+#include "ota_update.h"
+
+#include <Preferences.h>
+#include <Update.h>
+#include <esp32/rom/miniz.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+
+#include "logger.h"
+
+static const char *NVS_NAMESPACE = "ota";
+static const char *NVS_KEY_TRIED = "tried"; // version booted into, until confirmed
+static const char *NVS_KEY_BAD = "bad";     // last version that was rolled back
+static const char *NVS_KEY_BOOTS = "boots"; // boots of the tried version so far
+
+struct Offer {
+  uint32_t version;
+  uint32_t size;
+  bool zlib;
+  char url[96];
+  char sha256[SIGNATURE_HEX_LEN + 1];
+};
+
+static Offer offer;
+static bool offerPending = false;
+static unsigned long retryAt = 0;
+static uint32_t badVersion = 0;
+static bool unconfirmed = false;
+static uint16_t failedCycles = 0;
+
+// Arduino marks every new image valid at startup unless told to leave the
+// decision to the sketch; otaNoteUpload() makes it.
+extern "C" bool verifyRollbackLater() {
+  return true;
+}
+
+static bool pendingVerify() {
+  esp_ota_img_states_t state;
+  return esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+         state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+void otaBegin() {
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, false)) return;
+  const uint32_t tried = prefs.getUInt(NVS_KEY_TRIED, 0);
+  badVersion = prefs.getUInt(NVS_KEY_BAD, 0);
+  if (tried != 0 && tried != FIRMWARE_VERSION) {
+    // Back on the old image: the new one crashed or failed its health check.
+    badVersion = tried;
+    prefs.putUInt(NVS_KEY_BAD, tried);
+    prefs.remove(NVS_KEY_TRIED);
+    prefs.remove(NVS_KEY_BOOTS);
+    LOG_WARN("Firmware v%lu was rolled back; staying on v%lu", static_cast<unsigned long>(tried),
+             static_cast<unsigned long>(FIRMWARE_VERSION));
+  }
+  // Without rollback support in the bootloader the image state stays
+  // undefined, and the NVS record alone marks it as on probation.
+  unconfirmed = OTA_ENABLED && (pendingVerify() || tried == FIRMWARE_VERSION);
+  const uint8_t boots = unconfirmed ? prefs.getUChar(NVS_KEY_BOOTS, 0) + 1 : 0;
+  if (unconfirmed) prefs.putUChar(NVS_KEY_BOOTS, boots);
+  prefs.end();
+  if (!unconfirmed) return;
+  if (boots > OTA_UNCONFIRMED_BOOTS) {
+    LOG_WARN("Firmware v%lu booted %u times without confirming", static_cast<unsigned long>(FIRMWARE_VERSION),
+             static_cast<unsigned>(boots - 1));
+    otaRollback();
+    return;
+  }
+  LOG_INFO("Firmware v%lu unconfirmed (boot %u of %d); needs an accepted upload within %d cycle(s)",
+           static_cast<unsigned long>(FIRMWARE_VERSION), static_cast<unsigned>(boots), OTA_UNCONFIRMED_BOOTS,
+           OTA_HEALTHY_WITHIN_CYCLES);
+}
+
+// `nonce` is null for an upgrade; a downgrade is bound to the request.
+static bool offerSignatureMatches(HmacSigner &signer, const Offer &o, const char *encoding, const char *nonce,
+                                  const char *sigHex) {
+  char message[224];
+  const int n = snprintf(message, sizeof(message), "ota.%s.%lu.%lu.%s.%s%s%s", NODE_ID,
+                         static_cast<unsigned long>(o.version), static_cast<unsigned long>(o.size), encoding,
+                         o.sha256, nonce ? ".downgrade." : "", nonce ? nonce : "");
+  if (n <= 0 || static_cast<size_t>(n) >= sizeof(message)) return false;
+  uint8_t mac[HmacSigner::MAC_LEN];
+  signer.start();
+  signer.update(message, n);
+  signer.finish(mac);
+  char expected[SIGNATURE_HEX_LEN + 1];
+  toHex(mac, sizeof(mac), expected);
+  return signatureEquals(expected, sigHex);
+}
+
+bool otaNoteOffer(JsonVariantConst o, HmacSigner &signer, const char *nonce) {
+  if (!OTA_ENABLED || unconfirmed || !o.is<JsonObjectConst>()) return false;
+  const uint32_t version = o["version"] | 0;
+  if (version == 0 || version == FIRMWARE_VERSION || (offerPending && version == offer.version)) return false;
+  if (version == badVersion) {
+    LOG_DEBUG("Firmware v%lu offered again after a rollback; ignored", static_cast<unsigned long>(version));
+    return false;
+  }
+  const bool downgrade = version < FIRMWARE_VERSION;
+  if (downgrade && !(o["downgrade"] | false)) {
+    LOG_WARN("Firmware v%lu older than v%lu and not marked as a downgrade; ignored",
+             static_cast<unsigned long>(version), static_cast<unsigned long>(FIRMWARE_VERSION));
+    return false;
+  }
+  const char *url = o["url"] | "";
+  const char *sha256 = o["sha256"] | "";
+  const char *encoding = o["encoding"] | "";
+  const bool zlib = strcmp(encoding, "zlib") == 0;
+  if (url[0] != '/' || strlen(url) >= sizeof(offer.url) || strlen(sha256) != SIGNATURE_HEX_LEN ||
+      (!zlib && strcmp(encoding, "identity") != 0) || !o["size"].is<uint32_t>()) {
+    LOG_WARN("Firmware v%lu offer malformed; ignored", static_cast<unsigned long>(version));
+    return false;
+  }
+  Offer parsed = {version, o["size"].as<uint32_t>(), zlib, {0}, {0}};
+  strlcpy(parsed.url, url, sizeof(parsed.url));
+  strlcpy(parsed.sha256, sha256, sizeof(parsed.sha256));
+  if (!offerSignatureMatches(signer, parsed, encoding, downgrade ? nonce : nullptr, o["sig"])) {
+    LOG_WARN("Firmware v%lu offer has a bad signature; ignored", static_cast<unsigned long>(version));
+    return false;
+  }
+  offer = parsed;
+  offerPending = true;
+  retryAt = 0;
+  LOG_INFO("Firmware v%lu offered (%lu bytes, %s)", static_cast<unsigned long>(version),
+           static_cast<unsigned long>(offer.size), encoding);
+  return true;
+}
+
+bool otaDue() {
+  return offerPending && (retryAt == 0 || static_cast<long>(millis() - retryAt) >= 0);
+}
+
+// Streaming state for one download. The inflater writes into a 32 KiB
+// window that doubles as the output buffer for Update.write().
+struct Download {
+  mbedtls_sha256_context sha;
+  tinfl_decompressor *inflator; // nullptr for "identity"
+  uint8_t *window;
+  size_t windowPos;
+  size_t written;
+  bool ended; // the zlib stream is complete
+  void (*poll)();
+};
+
+static bool writeImage(Download &d, uint8_t *data, size_t len) {
+  if (d.written + len > offer.size) return false;
+  mbedtls_sha256_update_ret(&d.sha, data, len);
+  if (Update.write(data, len) != len) return false;
+  d.written += len;
+  return true;
+}
+
+static bool inflateChunk(Download &d, const uint8_t *data, size_t len) {
+  for (;;) {
+    if (d.ended) return len == 0; // nothing may follow the stream
+    size_t in = len;
+    size_t out = TINFL_LZ_DICT_SIZE - d.windowPos;
+    const tinfl_status status =
+        tinfl_decompress(d.inflator, data, &in, d.window, d.window + d.windowPos, &out,
+                         TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32 | TINFL_FLAG_HAS_MORE_INPUT);
+    data += in;
+    len -= in;
+    if (out > 0 && !writeImage(d, d.window + d.windowPos, out)) return false;
+    d.windowPos = (d.windowPos + out) & (TINFL_LZ_DICT_SIZE - 1);
+    if (status < TINFL_STATUS_DONE) return false;
+    if (status == TINFL_STATUS_DONE) d.ended = true;
+    if (status == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0) return true;
+  }
+}
+
+static bool onChunk(void *ctx, const uint8_t *data, size_t len) {
+  Download &d = *static_cast<Download *>(ctx);
+  if (d.poll) d.poll();
+  if (!d.inflator) return writeImage(d, const_cast<uint8_t *>(data), len);
+  return inflateChunk(d, data, len);
+}
+
+static bool finishDownload(Download &d, int code) {
+  if (code != 200) {
+    LOG_WARN("Firmware download failed: %d (%u of %lu bytes written)", code, static_cast<unsigned>(d.written),
+             static_cast<unsigned long>(offer.size));
+    return false;
+  }
+  if (d.written != offer.size || (d.inflator && !d.ended)) {
+    LOG_WARN("Firmware image incomplete: %u of %lu bytes", static_cast<unsigned>(d.written),
+             static_cast<unsigned long>(offer.size));
+    return false;
+  }
+  uint8_t digest[32];
+  mbedtls_sha256_finish_ret(&d.sha, digest);
+  char hex[SIGNATURE_HEX_LEN + 1];
+  toHex(digest, sizeof(digest), hex);
+  if (strcmp(hex, offer.sha256) != 0) {
+    LOG_WARN("Firmware image SHA-256 mismatch");
+    return false;
+  }
+  return true;
+}
+
+bool otaInstall(UploadSession &session, void (*poll)()) {
+  if (!otaDue()) return false;
+  retryAt = millis() + OTA_RETRY_MS;
+  if (retryAt == 0) retryAt = 1;
+  HTTPClient *http = session.prepare(offer.url);
+  if (!http) return false;
+  http->addHeader("X-API-Key", API_KEY);
+  if (!Update.begin(offer.size, U_FLASH)) {
+    LOG_WARN("Firmware v%lu does not fit: %s", static_cast<unsigned long>(offer.version), Update.errorString());
+    http->end();
+    offerPending = false; // will not fit next time either
+    return false;
+  }
+
+  Download d = {};
+  mbedtls_sha256_init(&d.sha);
+  mbedtls_sha256_starts_ret(&d.sha, 0);
+  d.poll = poll;
+  bool ready = true;
+  if (offer.zlib) {
+    d.inflator = static_cast<tinfl_decompressor *>(malloc(sizeof(tinfl_decompressor)));
+    d.window = static_cast<uint8_t *>(malloc(TINFL_LZ_DICT_SIZE));
+    ready = d.inflator && d.window;
+    if (ready) tinfl_init(d.inflator);
+  }
+  LOG_INFO("Downloading firmware v%lu from %s", static_cast<unsigned long>(offer.version), offer.url);
+  const unsigned long started = millis();
+  bool ok = false;
+  if (ready) {
+    const int code = session.getTo(onChunk, &d);
+    ok = finishDownload(d, code);
+  } else {
+    http->end();
+    LOG_WARN("No memory for the firmware inflater");
+  }
+  mbedtls_sha256_free(&d.sha);
+  free(d.inflator);
+  free(d.window);
+
+  // end() checks the image header and makes the partition the boot target.
+  if (!ok || !Update.end()) {
+    if (ok) LOG_WARN("Firmware image rejected: %s", Update.errorString());
+    Update.abort();
+    return false;
+  }
+  Preferences prefs;
+  if (prefs.begin(NVS_NAMESPACE, false)) {
+    prefs.putUInt(NVS_KEY_TRIED, offer.version);
+    prefs.remove(NVS_KEY_BOOTS);
+    prefs.end();
+  }
+  offerPending = false;
+  LOG_INFO("Firmware v%lu written in %lu ms; restarting into it", static_cast<unsigned long>(offer.version),
+           millis() - started);
+  return true;
+}
+
+bool otaVerifying() {
+  return unconfirmed;
+}
+
+static void confirm() {
+  if (pendingVerify()) esp_ota_mark_app_valid_cancel_rollback();
+  Preferences prefs;
+  if (prefs.begin(NVS_NAMESPACE, false)) {
+    prefs.remove(NVS_KEY_TRIED);
+    prefs.remove(NVS_KEY_BOOTS);
+    prefs.end();
+  }
+  unconfirmed = false;
+  LOG_INFO("Firmware v%lu confirmed", static_cast<unsigned long>(FIRMWARE_VERSION));
+}
+
+bool otaNoteUpload(bool accepted) {
+  if (!unconfirmed) return false;
+  if (accepted) {
+    confirm();
+    return false;
+  }
+  return ++failedCycles >= OTA_HEALTHY_WITHIN_CYCLES;
+}
+
+void otaRollback() {
+  LOG_ERROR("Firmware v%lu unhealthy; rolling back", static_cast<unsigned long>(FIRMWARE_VERSION));
+  logFlush();
+  // The previous image records the rollback on its next boot (otaBegin()).
+  if (pendingVerify()) esp_ota_mark_app_invalid_rollback_and_reboot();
+  const esp_partition_t *previous = esp_ota_get_next_update_partition(nullptr);
+  esp_app_desc_t desc;
+  if (previous && esp_ota_get_partition_description(previous, &desc) == ESP_OK &&
+      esp_ota_set_boot_partition(previous) == ESP_OK) {
+    esp_restart();
+  }
+  LOG_ERROR("No previous firmware to roll back to; keeping v%lu", static_cast<unsigned long>(FIRMWARE_VERSION));
+  confirm();
+}
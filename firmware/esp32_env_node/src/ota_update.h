@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "config_defaults.h"
+#include "signing.h"
+#include "upload_session.h"
+
+// Over-the-air updates into the idle app partition of the default dual-OTA
+// layout. The backend offers an image in a telemetry response as
+// "ota": {"version", "url", "size", "encoding", "sha256", "sig"} (backend
+// firmware_store.py), signed with the node's HMAC secret over
+// "ota.<nodeId>.<version>.<size>.<encoding>.<sha256>". The download runs on
+// the upload connection and is inflated (encoding "zlib") and hashed on its
+// way straight into flash, so the image is never held in RAM; the partition
+// only becomes bootable once size and SHA-256 match the signed offer.
+//
+// Only newer versions are taken as they are. An older one needs
+// "downgrade": true, and its signature then also covers that flag and the
+// nonce of the request being answered (".downgrade.<nonce>"), so a captured
+// offer cannot be replayed later to force an old image back on.
+//
+// A new image starts unconfirmed. It is kept once an upload is accepted and
+// rolled back if OTA_HEALTHY_WITHIN_CYCLES flush cycles fail first, or if it
+// boots OTA_UNCONFIRMED_BOOTS times without confirming (counted in NVS, so a
+// crash loop ends even where the bootloader cannot roll back by itself). A
+// version that was rolled back is not installed again.
+
+// Boot-time bookkeeping: finds out whether this image still has to prove
+// itself and whether the last update was rolled back.
+void otaBegin();
+// Checks the signature of an "ota" offer that answered the request signed
+// with `nonce` and remembers it for otaInstall().
+bool otaNoteOffer(JsonVariantConst offer, HmacSigner &signer, const char *nonce);
+// An offer is waiting and not backing off after a failed download.
+bool otaDue();
+// Downloads and writes the offered image, calling `poll` between chunks.
+// Returns true when it is ready to boot; the caller restarts.
+bool otaInstall(UploadSession &session, void (*poll)());
+// The running image has not been confirmed yet.
+bool otaVerifying();
+// Reports the outcome of a flush cycle. Returns true if the unconfirmed image
+// has now failed its health check and should be rolled back.
+bool otaNoteUpload(bool accepted);
+// Boots the previous image. Does not return unless there is none.
+void otaRollback();
@@ -0,0 +1,47 @@
+#include "reading_filter.h"
+
+void ReadingFilter::reset() {
+  for (ChannelState &c : _state.channels) {
+    c.hampel.reset();
+    c.ema.reset();
+  }
+}
+
+float ReadingFilter::filter(Channel c, float x, uint8_t mode, float minDeviation) {
+  ChannelState &s = _state.channels[c];
+  switch (mode) {
+    case FILTER_MODE_MEDIAN:
+      if (isnan(x)) return x;
+      s.hampel.window.push(x);
+      return s.hampel.window.median();
+    case FILTER_MODE_EMA:
+      return s.ema.apply(x, FILTER_EMA_ALPHA);
+    case FILTER_MODE_HAMPEL:
+      return s.hampel.apply(x, FILTER_HAMPEL_K, minDeviation);
+    case FILTER_MODE_HAMPEL_EMA:
+      return s.ema.apply(s.hampel.apply(x, FILTER_HAMPEL_K, minDeviation), FILTER_EMA_ALPHA);
+    default:
+      return x;
+  }
+}
+
+static uint16_t toRaw(float v) {
+  return static_cast<uint16_t>(constrain(lroundf(v), 0L, 0xFFFFL));
+}
+
+void ReadingFilter::apply(Reading &r) {
+  r.radiationUsvh = filter(RADIATION, r.radiationUsvh, FILTER_RADIATION, FILTER_RADIATION_MIN_DEV);
+  r.pm25 = filter(PM25, r.pm25, FILTER_PM25, FILTER_PM25_MIN_DEV);
+  r.tempC = filter(AIR_TEMP, r.tempC, FILTER_AIR, 0.5f);
+  r.hum = filter(HUMIDITY, r.hum, FILTER_AIR, 2.0f);
+  r.pressHpa = filter(PRESSURE, r.pressHpa, FILTER_AIR, 1.0f);
+  r.voc = filter(VOC, r.voc, FILTER_AIR, 10.0f);
+  for (uint8_t i = 0; i < DS18B20_MAX_PROBES; i++) {
+    r.waterTempC[i] = filter(static_cast<Channel>(WATER_TEMP + i), r.waterTempC[i], FILTER_WATER_TEMP, 0.3f);
+  }
+  if (NODE_HAS(SENSOR_WATER_ADC)) {
+    r.turbidityRaw = toRaw(filter(TURBIDITY, r.turbidityRaw, FILTER_WATER_ADC, FILTER_ADC_MIN_DEV));
+    r.tdsRaw = toRaw(filter(TDS, r.tdsRaw, FILTER_WATER_ADC, FILTER_ADC_MIN_DEV));
+    r.phRaw = toRaw(filter(PH, r.phRaw, FILTER_WATER_ADC, FILTER_ADC_MIN_DEV));
+  }
+}
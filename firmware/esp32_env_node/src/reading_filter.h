@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config_defaults.h"
+#include "filters.h"
+#include "reading.h"
+
+// Applies the per-channel FILTER_* modes to a fresh reading before it is
+// reported. The state is plain data so LOW_POWER_MODE can keep it in RTC
+// memory between wakes.
+class ReadingFilter {
+ public:
+  enum Channel : uint8_t {
+    RADIATION,
+    PM25,
+    AIR_TEMP,
+    HUMIDITY,
+    PRESSURE,
+    VOC,
+    TURBIDITY,
+    TDS,
+    PH,
+    WATER_TEMP, // first of DS18B20_MAX_PROBES
+    CHANNELS = WATER_TEMP + DS18B20_MAX_PROBES
+  };
+
+  struct ChannelState {
+    HampelFilter<FILTER_WINDOW> hampel; // also provides the rolling median
+    Ema ema;
+  };
+
+  struct State {
+    ChannelState channels[CHANNELS];
+  };
+
+  void reset();
+  void apply(Reading &r);
+
+  State &state() { return _state; }
+
+ private:
+  float filter(Channel c, float x, uint8_t mode, float minDeviation);
+
+  State _state;
+};
@@ -0,0 +1,64 @@
+#include "report_policy.h"
+
+#include "logger.h"
+
+static const char *CHANNEL_NAMES[ReportPolicy::CHANNELS] = {"radiation", "pm25", "water_temp"};
+
+float ReportPolicy::channelValue(const Reading &r, Channel c) {
+  switch (c) {
+    case RADIATION:
+      return r.radiationUsvh;
+    case PM25:
+      return r.pm25;
+    case WATER_TEMP:
+      return r.waterTempC[0];
+    default:
+      return NAN;
+  }
+}
+
+ReportPolicy::Decision ReportPolicy::evaluate(const Reading &r) {
+  const uint32_t now = r.epoch;
+  bool changed = !_state.primed;
+  bool trigger = false;
+  const float minutes = _state.primed && now > _state.previousEpoch ? (now - _state.previousEpoch) / 60.0f : 0.0f;
+
+  for (uint8_t i = 0; i < CHANNELS; i++) {
+    const Channel c = static_cast<Channel>(i);
+    const float v = channelValue(r, c);
+    if (isnan(v)) continue;
+    const Rule &k = _rules[i];
+    const float reported = _state.reported[i];
+    if (isnan(reported) || fabsf(v - reported) >= k.deadband) changed = true;
+    if (k.alert > 0 && v >= k.alert) {
+      if (!trigger) LOG_INFO("Report policy: %s %.3f above alert level", CHANNEL_NAMES[i], v);
+      trigger = true;
+    }
+    const float previous = _state.previous[i];
+    if (k.ratePerMin > 0 && minutes > 0 && !isnan(previous) && fabsf(v - previous) / minutes >= k.ratePerMin) {
+      if (!trigger) LOG_INFO("Report policy: %s changing %.3f/min", CHANNEL_NAMES[i], (v - previous) / minutes);
+      trigger = true;
+    }
+    _state.previous[i] = v;
+  }
+  _state.previousEpoch = now;
+  _state.primed = true;
+
+  if (trigger) _state.escalatedUntilEpoch = now + REPORT_ESCALATION_HOLD_MS / 1000;
+  _escalated = now < _state.escalatedUntilEpoch;
+
+  const bool heartbeat = now - _state.lastReportEpoch >= REPORT_HEARTBEAT_MS / 1000;
+  Decision d = {changed || heartbeat || _escalated, _escalated};
+  if (d.report) {
+    for (uint8_t i = 0; i < CHANNELS; i++) {
+      const float v = channelValue(r, static_cast<Channel>(i));
+      if (!isnan(v)) _state.reported[i] = v;
+    }
+    _state.lastReportEpoch = now;
+  }
+  return d;
+}
+
+uint32_t ReportPolicy::nextIntervalMs(uint32_t baseMs) const {
+  return _escalated ? REPORT_ESCALATED_INTERVAL_MS : baseMs;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config_defaults.h"
+#include "reading.h"
+
+// Decides per sample whether a reading is worth reporting and how soon the
+// next sample should be taken. A reading is reported when any channel has
+// moved past its deadband since the last reported value, when the heartbeat
+// interval has elapsed, or while escalated. Crossing a channel's alert level,
+// or a rate of change spike, escalates: samples are taken every
+// REPORT_ESCALATED_INTERVAL_MS and flushed immediately until the channel has
+// been quiet for REPORT_ESCALATION_HOLD_MS.
+class ReportPolicy {
+ public:
+  enum Channel : uint8_t { RADIATION, PM25, WATER_TEMP, CHANNELS };
+
+  struct Rule {
+    float deadband;
+    float alert;        // absolute level that escalates; <= 0 disables
+    float ratePerMin;   // |change| per minute that escalates; <= 0 disables
+  };
+
+  struct Decision {
+    bool report;
+    bool escalated;
+  };
+
+  // Plain data so LOW_POWER_MODE can keep it in RTC memory.
+  struct State {
+    float reported[CHANNELS];
+    float previous[CHANNELS];
+    uint32_t previousEpoch;
+    uint32_t lastReportEpoch;
+    uint32_t escalatedUntilEpoch;
+    bool primed;
+  };
+
+  // Readings carry epoch seconds, which survive deep sleep; timing is kept in
+  // those rather than millis().
+  Decision evaluate(const Reading &r);
+  // baseMs while quiet, REPORT_ESCALATED_INTERVAL_MS while escalated.
+  uint32_t nextIntervalMs(uint32_t baseMs) const;
+  // Overrides a channel's REPORT_*_DEADBAND default (pushed node config).
+  void setDeadband(Channel c, float deadband) { _rules[c].deadband = deadband; }
+  bool escalated() const { return _escalated; }
+
+  State &state() { return _state; }
+
+ private:
+  static float channelValue(const Reading &r, Channel c);
+
+  Rule _rules[CHANNELS] = {
+      {REPORT_RAD_DEADBAND_USVH, REPORT_RAD_ALERT_USVH, REPORT_RAD_RATE_PER_MIN},
+      {REPORT_PM25_DEADBAND, REPORT_PM25_ALERT, REPORT_PM25_RATE_PER_MIN},
+      {REPORT_WATER_TEMP_DEADBAND_C, REPORT_WATER_TEMP_ALERT_C, REPORT_WATER_TEMP_RATE_PER_MIN},
+  };
+  State _state = {};
+  bool _escalated = false;
+};
@@ -0,0 +1,137 @@
+#include "sds011.h"
+
+#include "config_defaults.h"
+#include "logger.h"
+
+void Sds011::begin(HardwareSerial &port, int rxPin, int txPin, unsigned long runningForMs) {
+  _port = &port;
+  _rxPin = rxPin;
+  _txPin = txPin;
+  port.begin(9600, SERIAL_8N1, rxPin, txPin);
+  while (port.available()) port.read(); // flush stale boot garbage
+  port.onReceive([this]() { onRx(); });
+  wake();
+  // Both settings persist in the sensor's flash; setting them every boot
+  // undoes whatever an earlier firmware or another host left there.
+  send(SdsCommand::REPORTING_MODE, 1, 1);
+  send(SdsCommand::WORKING_PERIOD, 1, 0);
+  _wokeAtMs -= runningForMs;
+}
+
+void Sds011::restart() {
+  if (!_port) return;
+  const unsigned long runningForMs = _sleeping ? 0 : millis() - _wokeAtMs;
+  _port->end();
+  begin(*_port, _rxPin, _txPin, runningForMs);
+}
+
+void Sds011::send(SdsCommand::Id id, uint8_t arg1, uint8_t arg2) {
+  if (!_port) return;
+  uint8_t frame[SdsCommand::LEN];
+  SdsCommand::build(id, arg1, arg2, frame);
+  _port->write(frame, sizeof(frame));
+  _port->flush(); // 20 ms at 9600 baud; keeps back-to-back commands apart
+}
+
+void Sds011::wake() {
+  send(SdsCommand::SLEEP_WORK, 1, 1);
+  _sleeping = false;
+  _wokeAtMs = millis();
+}
+
+void Sds011::sleep() {
+  send(SdsCommand::SLEEP_WORK, 1, 0);
+  _sleeping = true;
+}
+
+void Sds011::query() {
+  if (_sleeping) return;
+  // Anything still summed is from before the query (e.g. active-mode frames
+  // sent before begin() switched the sensor over).
+  portENTER_CRITICAL(&_mux);
+  _sumPm25 = 0.0f;
+  _sumPm10 = 0.0f;
+  _sumFrames = 0;
+  portEXIT_CRITICAL(&_mux);
+  send(SdsCommand::QUERY, 0, 0);
+}
+
+void Sds011::setRawDebugWindow(unsigned long startMs, unsigned long endMs) {
+  _debugStartMs = startMs;
+  _debugEndMs = endMs;
+}
+
+void Sds011::onRx() {
+  const unsigned long now = millis();
+  uint8_t chunk[32];
+  int n;
+  while ((n = static_cast<int>(_port->read(chunk, sizeof(chunk)))) > 0) {
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    if (SDS_RAW_DEBUG && now >= _debugStartMs && now <= _debugEndMs) {
+      char hex[sizeof(chunk) * 3 + 1];
+      for (int i = 0; i < n; i++) snprintf(hex + i * 3, 4, "%02X ", chunk[i]);
+      LOG_DEBUG("SDS RX %s", hex);
+    }
+#endif
+    for (int i = 0; i < n; i++) {
+      const SdsFrameParser::Frame frame = _parser.feed(chunk[i]);
+      if (frame == SdsFrameParser::REPLY) {
+        LOG_DEBUG("SDS reply to 0x%02X: %02X %02X", _parser.replyCommand(), _parser.replyArg(0),
+                  _parser.replyArg(1));
+      }
+      if (frame != SdsFrameParser::DATA) continue;
+      const float pm25 = _parser.pm25Raw() / 10.0f;
+      const float pm10 = _parser.pm10Raw() / 10.0f;
+      portENTER_CRITICAL(&_mux);
+      _lastPm25 = pm25;
+      _lastPm10 = pm10;
+      _lastFrameMs = now;
+      _haveFrame = true;
+      _sumPm25 += pm25;
+      _sumPm10 += pm10;
+      _sumFrames++;
+      portEXIT_CRITICAL(&_mux);
+    }
+  }
+}
+
+bool Sds011::latest(SdsSample &out) const {
+  portENTER_CRITICAL(&_mux);
+  const bool have = _haveFrame;
+  out.pm25 = _lastPm25;
+  out.pm10 = _lastPm10;
+  out.frames = have ? 1 : 0;
+  const unsigned long frameMs = _lastFrameMs;
+  portEXIT_CRITICAL(&_mux);
+  out.ageMs = millis() - frameMs;
+  return have;
+}
+
+bool Sds011::takeAverage(SdsSample &out) {
+  portENTER_CRITICAL(&_mux);
+  const uint32_t frames = _sumFrames;
+  if (frames > 0) {
+    out.pm25 = _sumPm25 / frames;
+    out.pm10 = _sumPm10 / frames;
+  }
+  const unsigned long frameMs = _lastFrameMs;
+  _sumPm25 = 0.0f;
+  _sumPm10 = 0.0f;
+  _sumFrames = 0;
+  portEXIT_CRITICAL(&_mux);
+  out.frames = frames;
+  out.ageMs = millis() - frameMs;
+  return frames > 0;
+}
+
+uint32_t Sds011::goodFrames() const {
+  return _parser.frames();
+}
+
+uint32_t Sds011::badFrames() const {
+  return _parser.checksumErrors() + _parser.framingErrors();
+}
+
+uint32_t Sds011::replies() const {
+  return _parser.replies();
+}
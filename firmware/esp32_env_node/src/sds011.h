@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "sds_frame_parser.h"
+
+struct SdsSample {
+  float pm25;
+  float pm10;
+  uint32_t frames;       // frames folded into this value
+  unsigned long ageMs;   // time since the newest of those frames
+};
+
+// SDS011 on a hardware UART, parsed from the UART RX event callback instead
+// of being polled. The sensor is put in query mode with no working period of
+// its own, so it only sends a frame when asked and the fan and laser run only
+// between wake() and sleep(); main.cpp schedules those around each sample.
+class Sds011 {
+ public:
+  // Wakes the sensor (it may still be asleep from before a reset) and
+  // switches it to query mode. runningForMs is how long it has already been
+  // awake, e.g. through a deep sleep, and counts towards the warm-up.
+  void begin(HardwareSerial &port, int rxPin, int txPin, unsigned long runningForMs = 0);
+
+  // Re-opens the UART and sends the setup commands again, for a sensor that
+  // has stopped answering. Time it has already been awake still counts.
+  void restart();
+
+  void wake();
+  void sleep();
+  // Requests one measurement frame, which takeAverage() then returns on its
+  // own. No-op while asleep.
+  void query();
+  bool sleeping() const { return _sleeping; }
+  // millis() of the last wake(); readings settle SDS_WARMUP_MS after it.
+  unsigned long wokeAtMs() const { return _wokeAtMs; }
+
+  // Hex-dump raw RX bytes between these millis() values (SDS_RAW_DEBUG, and
+  // only when LOG_LEVEL includes debug output).
+  void setRawDebugWindow(unsigned long startMs, unsigned long endMs);
+
+  // Last good frame. Returns false if none has been seen yet.
+  bool latest(SdsSample &out) const;
+  // Mean of the frames received since the previous call. Returns false if
+  // no new frame arrived in between.
+  bool takeAverage(SdsSample &out);
+
+  uint32_t goodFrames() const;
+  uint32_t badFrames() const;
+  uint32_t replies() const;
+
+ private:
+  void onRx();
+  void send(SdsCommand::Id id, uint8_t arg1, uint8_t arg2);
+
+  HardwareSerial *_port = nullptr;
+  int _rxPin = -1;
+  int _txPin = -1;
+  SdsFrameParser _parser;
+  mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  float _lastPm25 = 0.0f;
+  float _lastPm10 = 0.0f;
+  unsigned long _lastFrameMs = 0;
+  bool _haveFrame = false;
+  float _sumPm25 = 0.0f;
+  float _sumPm10 = 0.0f;
+  uint32_t _sumFrames = 0;
+  bool _sleeping = false;
+  unsigned long _wokeAtMs = 0;
+  unsigned long _debugStartMs = 0;
+  unsigned long _debugEndMs = 0;
+};
@@ -0,0 +1,54 @@
+#include "sleep_state.h"
+
+#include <WiFi.h>
+#include <esp_sleep.h>
+
+#include "health.h"
+#include "logger.h"
+
+// Changes whenever the layout does, so a reflashed node never reads stale RTC data.
+static const uint32_t SLEEP_STATE_MAGIC = 0x534C0000u ^ sizeof(SleepState);
+
+static_assert(SLEEP_BUFFER_CAPACITY >= DEEP_SLEEP_UPLOAD_EVERY, "RTC buffer must hold a full upload cycle");
+static_assert(sizeof(SleepState) <= 6 * 1024, "SleepState does not fit RTC slow memory");
+
+RTC_DATA_ATTR SleepState sleepState;
+
+bool sleepStateRestorable() {
+  return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && sleepState.magic == SLEEP_STATE_MAGIC &&
+         sleepState.pendingCount <= SLEEP_BUFFER_CAPACITY;
+}
+
+void sleepStateReset() {
+  memset(&sleepState, 0, sizeof(sleepState));
+}
+
+bool sleepStatePush(const Reading &r) {
+  bool evicted = false;
+  if (sleepState.pendingCount == SLEEP_BUFFER_CAPACITY) {
+    memmove(&sleepState.pending[0], &sleepState.pending[1], sizeof(Reading) * (SLEEP_BUFFER_CAPACITY - 1));
+    sleepState.pendingCount--;
+    evicted = true;
+  }
+  sleepState.pending[sleepState.pendingCount++] = r;
+  return !evicted;
+}
+
+bool sleepStateFull() {
+  return sleepState.pendingCount >= SLEEP_BUFFER_CAPACITY;
+}
+
+void sleepStateMarkValid() {
+  sleepState.magic = SLEEP_STATE_MAGIC;
+}
+
+void enterDeepSleep(uint32_t sleepMs) {
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+  LOG_INFO("Deep sleep for %lu ms", static_cast<unsigned long>(sleepMs));
+  logFlush();
+  timeSaveForSleep(sleepState.wallClock, sleepMs);
+  healthBeforeSleep(sleepMs);
+  esp_sleep_enable_timer_wakeup(static_cast<uint64_t>(sleepMs) * 1000ULL);
+  esp_deep_sleep_start();
+}
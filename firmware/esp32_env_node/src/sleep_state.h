@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config_defaults.h"
+#include "reading.h"
+#include "reading_filter.h"
+#include "report_policy.h"
+#include "time_service.h"
+
+// State carried across deep sleep in RTC slow memory (LOW_POWER_MODE). It is
+// only trusted after a timer wakeup with a matching magic; any other reset
+// starts from scratch.
+struct SleepState {
+  uint32_t magic;
+  uint32_t wakeCount;
+  float lastPm25;
+  float lastPm10;
+  float lastTempC;
+  float lastHum;
+  float lastPress;
+  float lastGas;
+  float lastRadiationUsvh;
+  float lastWaterTempC[DS18B20_MAX_PROBES];
+  // Geiger window: pulses and awake counting time accumulated so far.
+  uint32_t geigerPulses;
+  uint32_t geigerCountedMs;
+  ReportPolicy::State report;
+  ReadingFilter::State filter;
+  // SDS011 duty cycle: the next wake only starts the sensor warming up, and
+  // whether the sensor was left running (it keeps running through deep sleep).
+  bool sdsPrewake;
+  bool sdsRunning;
+  // Saved by enterDeepSleep() with the sleep time already added.
+  TimeState wallClock;
+  // Readings sampled on non-upload wakes, oldest first.
+  uint16_t pendingCount;
+  Reading pending[SLEEP_BUFFER_CAPACITY];
+};
+
+extern SleepState sleepState;
+
+// True when this boot is a timer wakeup and sleepState holds valid data.
+bool sleepStateRestorable();
+void sleepStateReset();
+// Appends a reading, evicting the oldest when full. Returns false if it evicted.
+bool sleepStatePush(const Reading &r);
+bool sleepStateFull();
+void sleepStateMarkValid();
+
+// Turns the radio off and sleeps for sleepMs with an RTC timer wakeup.
+[[noreturn]] void enterDeepSleep(uint32_t sleepMs);
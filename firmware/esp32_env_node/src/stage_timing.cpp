@@ -0,0 +1,32 @@
+#include "stage_timing.h"
+
+static StageHistograms live;
+static portMUX_TYPE liveMux = portMUX_INITIALIZER_UNLOCKED;
+
+void stageRecord(Stage s, uint32_t us) {
+  uint8_t b = 0;
+  while (b < StageHistograms::EDGES && us > StageHistograms::EDGES_US[b]) b++;
+  portENTER_CRITICAL(&liveMux);
+  if (live.counts[s][b] < 0xFFFF) live.counts[s][b]++;
+  if (us > live.maxUs[s]) live.maxUs[s] = us;
+  portEXIT_CRITICAL(&liveMux);
+}
+
+void stageSnapshot(StageHistograms &out) {
+  portENTER_CRITICAL(&liveMux);
+  out = live;
+  portEXIT_CRITICAL(&liveMux);
+}
+
+void stageConsume(const StageHistograms &sent) {
+  portENTER_CRITICAL(&liveMux);
+  for (uint8_t s = 0; s < STAGE_COUNT; s++) {
+    bool empty = true;
+    for (uint8_t b = 0; b < StageHistograms::BUCKETS; b++) {
+      live.counts[s][b] -= min(live.counts[s][b], sent.counts[s][b]);
+      if (live.counts[s][b]) empty = false;
+    }
+    if (empty) live.maxUs[s] = 0;
+  }
+  portEXIT_CRITICAL(&liveMux);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "health.h"
+#include "stage_histograms.h"
+
+// Per-stage latency histograms. Spans are timed with esp_timer_get_time()
+// and folded into fixed half-decade buckets in RAM; the network task
+// attaches a snapshot to an upload every DIAG_INTERVAL_MS as the "diag"
+// block and subtracts it once the server has accepted it.
+void stageRecord(Stage s, uint32_t us);
+void stageSnapshot(StageHistograms &out);
+// Removes counts already reported; maxima reset once a stage is fully drained.
+void stageConsume(const StageHistograms &sent);
+
+// Times its own scope, and tells the health monitor which stage the task is
+// in so a watchdog reset can name it.
+class StageSpan {
+ public:
+  explicit StageSpan(Stage s) : _stage(s), _outer(healthEnterStage(s)), _startUs(esp_timer_get_time()) {}
+  ~StageSpan() {
+    stageRecord(_stage, static_cast<uint32_t>(esp_timer_get_time() - _startUs));
+    healthLeaveStage(_outer);
+  }
+
+ private:
+  Stage _stage;
+  uint8_t _outer;
+  int64_t _startUs;
+};
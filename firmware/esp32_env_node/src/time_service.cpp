@@ -0,0 +1,140 @@
+#include "time_service.h"
+
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <sys/time.h>
+
+#include "logger.h"
+
+static TimeState clockState;
+static portMUX_TYPE clockMux = portMUX_INITIALIZER_UNLOCKED;
+static bool sntpStarted = false;
+
+static int64_t epochUsNow(const TimeState &s) {
+  return esp_timer_get_time() + s.offsetUs;
+}
+
+static void setClock(int64_t epochUs, uint8_t source) {
+  portENTER_CRITICAL(&clockMux);
+  clockState.offsetUs = epochUs - esp_timer_get_time();
+  clockState.source = source;
+  if (source >= TIME_SOURCE_SNTP) clockState.syncedEpoch = static_cast<uint32_t>(epochUs / 1000000);
+  portEXIT_CRITICAL(&clockMux);
+}
+
+// Keeps time()/gettimeofday() in line for libraries that read the system clock.
+static void setSystemClock(int64_t epochUs) {
+  struct timeval tv;
+  tv.tv_sec = static_cast<time_t>(epochUs / 1000000);
+  tv.tv_usec = static_cast<suseconds_t>(epochUs % 1000000);
+  settimeofday(&tv, nullptr);
+}
+
+// Runs on the lwIP thread after SNTP has already stepped the system clock.
+static void onSntpSync(struct timeval *tv) {
+  setClock(static_cast<int64_t>(tv->tv_sec) * 1000000 + tv->tv_usec, TIME_SOURCE_SNTP);
+  LOG_INFO("Time synced via NTP, epoch=%ld", static_cast<long>(tv->tv_sec));
+}
+
+static int monthFromString(const char *mon) {
+  static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+  for (int i = 0; i < 12; i++) {
+    if (strncmp(mon, months[i], 3) == 0) return i;
+  }
+  return -1;
+}
+
+static time_t buildTime() {
+  char mon[4] = {0};
+  int day = 0;
+  int year = 0;
+  int hour = 0, minute = 0, second = 0;
+  if (sscanf(__DATE__, "%3s %d %d", mon, &day, &year) != 3) return 0;
+  if (sscanf(__TIME__, "%d:%d:%d", &hour, &minute, &second) != 3) return 0;
+  const int month = monthFromString(mon);
+  if (month < 0) return 0;
+
+  struct tm tm_time = {};
+  tm_time.tm_year = year - 1900;
+  tm_time.tm_mon = month;
+  tm_time.tm_mday = day;
+  tm_time.tm_hour = hour;
+  tm_time.tm_min = minute;
+  tm_time.tm_sec = second;
+  return mktime(&tm_time);
+}
+
+void timeBegin() {
+  if (timeSource() != TIME_SOURCE_NONE) return;
+  // The system clock may still be valid after a soft reset.
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (tv.tv_sec >= static_cast<time_t>(TIME_VALID_EPOCH)) {
+    setClock(static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec, TIME_SOURCE_BUILD);
+    return;
+  }
+  const time_t compileTime = buildTime();
+  if (compileTime < static_cast<time_t>(TIME_VALID_EPOCH)) return;
+  const int64_t epochUs = static_cast<int64_t>(compileTime) * 1000000;
+  setClock(epochUs, TIME_SOURCE_BUILD);
+  setSystemClock(epochUs);
+  LOG_INFO("Bootstrap time set from compile time, epoch=%ld", static_cast<long>(compileTime));
+}
+
+void timeStartSntp() {
+  // Once started, lwIP keeps re-polling on its own schedule. A node woken
+  // from deep sleep with a recent offset skips SNTP for this wake.
+  if (sntpStarted || !timeNeedsSync()) return;
+  sntp_set_time_sync_notification_cb(onSntpSync);
+  configTime(0, 0, "pool.ntp.org", "time.nist.gov", "time.google.com");
+  sntpStarted = true;
+}
+
+uint32_t timeNow() {
+  portENTER_CRITICAL(&clockMux);
+  const TimeState s = clockState;
+  portEXIT_CRITICAL(&clockMux);
+  if (s.source == TIME_SOURCE_NONE) return 0;
+  return static_cast<uint32_t>(epochUsNow(s) / 1000000);
+}
+
+uint8_t timeSource() {
+  portENTER_CRITICAL(&clockMux);
+  const uint8_t source = clockState.source;
+  portEXIT_CRITICAL(&clockMux);
+  return source;
+}
+
+bool timeSynced() {
+  return timeSource() >= TIME_SOURCE_SNTP;
+}
+
+bool timeNeedsSync() {
+  if (!timeSynced()) return true;
+  portENTER_CRITICAL(&clockMux);
+  const uint32_t synced = clockState.syncedEpoch;
+  portEXIT_CRITICAL(&clockMux);
+  return timeNow() - synced >= TIME_RESYNC_MS / 1000;
+}
+
+void timeSetFromServer(uint64_t epochMs, uint32_t rttMs) {
+  // The reply was written roughly halfway through the round trip.
+  const int64_t epochUs = static_cast<int64_t>(epochMs) * 1000 + static_cast<int64_t>(rttMs) * 500;
+  setClock(epochUs, TIME_SOURCE_SERVER);
+  setSystemClock(epochUs);
+  LOG_INFO("Time synced via server, epoch=%ld (rtt %u ms)", static_cast<long>(epochUs / 1000000),
+           static_cast<unsigned>(rttMs));
+}
+
+void timeSaveForSleep(TimeState &out, uint32_t sleepMs) {
+  portENTER_CRITICAL(&clockMux);
+  out = clockState;
+  portEXIT_CRITICAL(&clockMux);
+  if (out.source != TIME_SOURCE_NONE) out.offsetUs += esp_timer_get_time() + static_cast<int64_t>(sleepMs) * 1000;
+}
+
+void timeRestore(const TimeState &saved) {
+  portENTER_CRITICAL(&clockMux);
+  clockState = saved;
+  portEXIT_CRITICAL(&clockMux);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "config_defaults.h"
+
+// Wall-clock service. Epoch time is kept as an offset from esp_timer (which is
+// monotonic from boot), so stamping a reading is one addition and never
+// touches SNTP or the RTC. SNTP runs in the background and updates the offset
+// from its completion callback; the backend's /api/time can stand in when a
+// sync is needed before SNTP has answered. Nothing here blocks.
+enum TimeSource : uint8_t {
+  TIME_SOURCE_NONE,
+  TIME_SOURCE_BUILD,  // seeded from __DATE__/__TIME__; only good for ordering
+  TIME_SOURCE_SNTP,
+  TIME_SOURCE_SERVER,
+};
+
+// Plain data so it can live in RTC memory across deep sleep.
+struct TimeState {
+  int64_t offsetUs;      // epoch microseconds = esp_timer_get_time() + offsetUs
+  uint32_t syncedEpoch;  // when the offset last came from SNTP or the server
+  uint8_t source;
+};
+
+// Anything earlier is treated as "clock not set".
+static const uint32_t TIME_VALID_EPOCH = 1700000000UL;
+
+// Seeds the clock from the build time if nothing better is known yet.
+void timeBegin();
+// Starts SNTP once the network is up. Safe to call on every reconnect.
+void timeStartSntp();
+// Epoch seconds, or 0 if the clock has never been set.
+uint32_t timeNow();
+uint8_t timeSource();
+// True once SNTP or the server has set the clock.
+bool timeSynced();
+// True if unsynced, or the last sync is older than TIME_RESYNC_MS.
+bool timeNeedsSync();
+// Applies a server-reported epoch (in ms) measured with the given round trip.
+void timeSetFromServer(uint64_t epochMs, uint32_t rttMs);
+
+// Deep sleep: the saved offset is advanced by the sleep duration because
+// esp_timer restarts from zero on wake.
+void timeSaveForSleep(TimeState &out, uint32_t sleepMs);
+void timeRestore(const TimeState &saved);
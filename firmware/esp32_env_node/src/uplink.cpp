@@ -0,0 +1,14 @@
+#include "uplink.h"
+
+#include "logger.h"
+
+void Uplink::logCycle() const {
+  LOG_INFO("Upload session: requests=%u handshakes=%u reused=%u failures=%u (total %u/%u/%u/%u)",
+           _cycle.requests, _cycle.handshakes, _cycle.reused, _cycle.failures,
+           _total.requests, _total.handshakes, _total.reused, _total.failures);
+}
+
+void Uplink::count(uint32_t Counters::*field) {
+  _cycle.*field += 1;
+  _total.*field += 1;
+}
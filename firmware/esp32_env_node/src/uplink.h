@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+
+// One signed upload as handed to a transport. The signature covers
+// "<nodeId>.<timestamp>.<nonce>.<body>" (see signRequest()).
+struct SignedRequest {
+  const uint8_t *body;
+  size_t len;
+  const char *contentType;
+  const char *nodeId;
+  const char *timestamp;
+  const char *nonce;
+  const char *signature;
+  const char *configVersion;  // node config the node runs (node_config.h)
+};
+
+// Transport for signed uploads to the backend; selected by UPLINK_TRANSPORT.
+// Implementations keep their connection open between sends and count
+// requests, handshakes and reuse the same way.
+class Uplink {
+ public:
+  struct Counters {
+    uint32_t requests = 0;
+    uint32_t handshakes = 0;
+    uint32_t reused = 0;
+    uint32_t failures = 0;
+  };
+
+  virtual ~Uplink() {}
+
+  virtual bool begin(const char *url) = 0;
+  virtual bool configured() const = 0;
+  // Sends one request and waits for the server's answer. Returns the HTTP
+  // status the backend reported, or a negative HTTPC_ERROR_* code on transport
+  // failure (HTTPC_ERROR_CONNECTION_REFUSED if no connection could be opened).
+  // Up to respCap-1 bytes of the response body are stored NUL-terminated.
+  virtual int send(const SignedRequest &req, char *resp, size_t respCap) = 0;
+  virtual void close() = 0;
+
+  // True if the last send() went out on an already-open connection.
+  bool lastReused() const { return _lastReused; }
+  const Counters &cycle() const { return _cycle; }
+  const Counters &total() const { return _total; }
+  void resetCycle() { _cycle = Counters(); }
+  void logCycle() const;
+
+ protected:
+  void count(uint32_t Counters::*field);
+
+  bool _lastReused = false;
+
+ private:
+  Counters _cycle;
+  Counters _total;
+};
@@ -0,0 +1,185 @@
+#include "upload_session.h"
+
+#include <WiFi.h>
+
+#include "config_defaults.h"
+#include "logger.h"
+#include "stage_timing.h"
+
+bool UploadSession::begin(const char *url) {
+  const String full = String(url);
+  int schemePos = full.indexOf("://");
+  int hostStart = schemePos >= 0 ? schemePos + 3 : 0;
+  int pathStart = full.indexOf('/', hostStart);
+  _host = pathStart >= 0 ? full.substring(hostStart, pathStart) : full.substring(hostStart);
+  _path = pathStart >= 0 ? full.substring(pathStart) : "/";
+  if (_host.length() == 0) {
+    LOG_ERROR("HTTPS begin failed: host empty");
+    return false;
+  }
+  _client.setTimeout(15000);
+  _client.setHandshakeTimeout(15000);
+  _client.setInsecure(); // DEBUG ONLY - TODO: pin server cert
+  _http.setTimeout(15000);
+  _http.setReuse(true);
+  _configured = true;
+  LOG_DEBUG("HTTPS host=%s path=%s (keep-alive)", _host.c_str(), _path.c_str());
+  return true;
+}
+
+HTTPClient *UploadSession::prepare(const char *path) {
+  if (!_configured) return nullptr;
+  _lastReused = connected();
+  if (!_lastReused && !connectTransport()) {
+    count(&Counters::failures);
+    return nullptr;
+  }
+  // begin() only resets request state; HTTPClient sees the socket on _client
+  // is already open and reuses it instead of connecting by hostname.
+  if (!_http.begin(_client, _host.c_str(), 443, path ? path : _path.c_str(), true)) return nullptr;
+  return &_http;
+}
+
+int UploadSession::send(const SignedRequest &req, char *resp, size_t respCap) {
+  HTTPClient *http = prepare();
+  if (!http) return HTTPC_ERROR_CONNECTION_REFUSED;
+  http->addHeader("Content-Type", req.contentType);
+  http->addHeader("X-API-Key", API_KEY);
+  http->addHeader("X-Node-Id", req.nodeId);
+  http->addHeader("X-Timestamp", req.timestamp);
+  http->addHeader("X-Nonce", req.nonce);
+  http->addHeader("X-Signature", req.signature);
+  http->addHeader("X-Config-Version", req.configVersion);
+  http->addHeader("X-Firmware-Version", FIRMWARE_VERSION_TEXT);
+  return post(req.body, req.len, resp, respCap);
+}
+
+int UploadSession::post(const uint8_t *body, size_t len, char *resp, size_t respCap) {
+  int code;
+  {
+    StageSpan span(STAGE_POST);
+    code = _http.POST(const_cast<uint8_t *>(body), len);
+    resp[0] = '\0';
+    if (code > 0) readResponse(resp, respCap); // drain the body so the socket can be reused
+  }
+  return finish(code);
+}
+
+int UploadSession::get(char *resp, size_t respCap) {
+  const int code = _http.GET();
+  resp[0] = '\0';
+  if (code > 0) readResponse(resp, respCap);
+  return finish(code);
+}
+
+int UploadSession::getTo(BodySink sink, void *ctx) {
+  int code = _http.GET();
+  if (code == HTTP_CODE_OK) {
+    int remaining = _http.getSize();
+    WiFiClient *stream = _http.getStreamPtr();
+    if (remaining <= 0 || !stream) code = HTTPC_ERROR_NO_STREAM;
+    uint8_t chunk[1024];
+    while (code > 0 && remaining > 0) {
+      const size_t got = stream->readBytes(chunk, min(static_cast<size_t>(remaining), sizeof(chunk)));
+      if (got == 0) {
+        code = HTTPC_ERROR_READ_TIMEOUT;
+      } else if (!sink(ctx, chunk, got)) {
+        code = HTTPC_ERROR_STREAM_WRITE; // leaves the rest unread, so the socket is dropped
+      }
+      remaining -= got;
+    }
+  } else if (code > 0) {
+    char discard[64];
+    readResponse(discard, sizeof(discard));
+  }
+  return finish(code);
+}
+
+int UploadSession::finish(int code) {
+  count(&Counters::requests);
+  if (_lastReused) count(&Counters::reused);
+  _http.end();
+
+  if (code <= 0) {
+    count(&Counters::failures);
+    // A stale keep-alive socket fails on first write; drop it so the next
+    // attempt starts a fresh handshake instead of failing again. A failure on
+    // a fresh connection may mean the address moved, so re-resolve too.
+    if (!_lastReused) invalidateAddress();
+    close();
+  }
+  return code;
+}
+
+size_t UploadSession::readResponse(char *resp, size_t respCap) {
+  int remaining = _http.getSize();
+  if (remaining < 0) {
+    // Chunked or close-delimited: let HTTPClient decode it.
+    const String body = _http.getString();
+    strlcpy(resp, body.c_str(), respCap);
+    return strlen(resp);
+  }
+  WiFiClient *stream = _http.getStreamPtr();
+  size_t stored = 0;
+  uint8_t sink[64];
+  while (remaining > 0 && stream) {
+    uint8_t *dst = sink;
+    size_t want = min(static_cast<size_t>(remaining), sizeof(sink));
+    if (stored + 1 < respCap) {
+      dst = reinterpret_cast<uint8_t *>(resp + stored);
+      want = min(want, respCap - 1 - stored);
+    }
+    const size_t got = stream->readBytes(dst, want);
+    if (got == 0) break; // timed out
+    if (dst != sink) stored += got;
+    remaining -= got;
+  }
+  resp[stored] = '\0';
+  return stored;
+}
+
+bool UploadSession::resolve() {
+  const unsigned long now = millis();
+  if (_resolvedAt != 0 && now - _resolvedAt < DNS_CACHE_TTL_MS) return true;
+  IPAddress ip;
+  int found;
+  {
+    StageSpan span(STAGE_DNS);
+    found = WiFi.hostByName(_host.c_str(), ip);
+  }
+  if (!found) {
+    LOG_WARN("DNS resolution failed for %s", _host.c_str());
+    _resolvedAt = 0;
+    return false;
+  }
+  _resolvedIp = ip;
+  _resolvedAt = now == 0 ? 1 : now;
+  LOG_DEBUG("DNS %s -> %s (cached)", _host.c_str(), _resolvedIp.toString().c_str());
+  return true;
+}
+
+bool UploadSession::connectTransport() {
+  if (!resolve()) return false;
+  count(&Counters::handshakes);
+  // Connect by cached IP but keep the hostname for SNI.
+  int connected;
+  {
+    StageSpan span(STAGE_TLS);
+    connected = _client.connect(_resolvedIp, 443, _host.c_str(), nullptr, nullptr, nullptr);
+  }
+  if (!connected) {
+    LOG_WARN("TLS connect to %s failed; will re-resolve", _resolvedIp.toString().c_str());
+    _client.stop();
+    invalidateAddress();
+    return false;
+  }
+  return true;
+}
+
+void UploadSession::close() {
+  _client.stop();
+}
+
+bool UploadSession::connected() {
+  return _client.connected();
+}
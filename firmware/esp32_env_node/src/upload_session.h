@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+
+#include "uplink.h"
+
+// Long-lived HTTPS uploader for SERVER_URL. The TLS client and HTTPClient are
+// kept across requests so HTTP/1.1 keep-alive can reuse the open connection;
+// a full handshake only happens when the server (or a failure) closes it.
+// The server address is resolved once and cached for DNS_CACHE_TTL_MS; a
+// failed connect drops the cache so the next attempt resolves again.
+class UploadSession : public Uplink {
+ public:
+  bool begin(const char *url) override;
+  bool configured() const override { return _configured; }
+  // POSTs the body with the signature in X-* headers.
+  int send(const SignedRequest &req, char *resp, size_t respCap) override;
+  void close() override;
+
+  // Starts a request on the session, connecting first if needed; add headers on
+  // the returned client, then call post() or get(). path defaults to the one
+  // in the upload URL. Returns nullptr on connect failure.
+  HTTPClient *prepare(const char *path = nullptr);
+  // Posts the body without copying it. The rest of the response body past
+  // respCap-1 bytes is drained and dropped.
+  int post(const uint8_t *body, size_t len, char *resp, size_t respCap);
+  // GET on the same connection, with the same response handling as post().
+  int get(char *resp, size_t respCap);
+  // GET whose 200 body is handed to `sink` piece by piece as it arrives
+  // instead of being stored; the sink returns false to abort. The body must
+  // have a Content-Length.
+  typedef bool (*BodySink)(void *ctx, const uint8_t *data, size_t len);
+  int getTo(BodySink sink, void *ctx);
+
+  bool connected();
+  void invalidateAddress() { _resolvedAt = 0; }
+
+  const String &host() const { return _host; }
+
+ private:
+  // Ends the request; on failure closes the socket (and re-resolves if it was fresh).
+  int finish(int code);
+  size_t readResponse(char *resp, size_t respCap);
+  bool resolve();
+  bool connectTransport();
+
+  WiFiClientSecure _client;
+  HTTPClient _http;
+  String _host;
+  String _path;
+  bool _configured = false;
+  IPAddress _resolvedIp;
+  unsigned long _resolvedAt = 0;
+};
@@ -0,0 +1,57 @@
+#include "water_temp.h"
+
+#include "logger.h"
+
+void WaterTempProbes::begin(DallasTemperature &bus, uint8_t resolution) {
+  _bus = &bus;
+  _resolution = resolution;
+  bus.begin();
+  bus.setWaitForConversion(false);
+  discover();
+}
+
+void WaterTempProbes::discover() {
+  _count = 0;
+  const uint8_t found = _bus->getDeviceCount();
+  for (uint8_t i = 0; i < found && _count < DS18B20_MAX_PROBES; i++) {
+    if (!_bus->getAddress(_addrs[_count], i)) continue;
+    _bus->setResolution(_addrs[_count], _resolution);
+    LOG_INFO("DS18B20 #%u ROM %02X%02X%02X%02X%02X%02X%02X%02X (%u-bit)", _count + 1,
+             _addrs[_count][0], _addrs[_count][1], _addrs[_count][2], _addrs[_count][3],
+             _addrs[_count][4], _addrs[_count][5], _addrs[_count][6], _addrs[_count][7], _resolution);
+    _count++;
+  }
+  _conversionMs = _bus->millisToWaitForConversion(_resolution);
+}
+
+void WaterTempProbes::start() {
+  if (!_bus) return;
+  if (_count == 0) {
+    // Probe unplugged at boot or since; look again before converting.
+    _bus->begin();
+    discover();
+    if (_count == 0) return;
+  }
+  _bus->requestTemperatures(); // returns immediately with setWaitForConversion(false)
+  _startedMs = millis();
+  _pending = true;
+}
+
+uint8_t WaterTempProbes::collect(float *out) {
+  for (uint8_t i = 0; i < DS18B20_MAX_PROBES; i++) out[i] = NAN;
+  if (!_pending) return 0;
+  _pending = false;
+
+  const unsigned long elapsed = millis() - _startedMs;
+  if (elapsed < _conversionMs) vTaskDelay(pdMS_TO_TICKS(_conversionMs - elapsed));
+
+  uint8_t valid = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    const float t = _bus->getTempC(_addrs[i]);
+    if (t == DEVICE_DISCONNECTED_C) continue;
+    out[i] = t;
+    valid++;
+  }
+  if (valid == 0) _count = 0; // force a rediscovery on the next cycle
+  return valid;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Arduino.h>
+#include <DallasTemperature.h>
+
+#include "config_defaults.h"
+
+// DS18B20 probes read without blocking on the conversion. start() kicks off
+// a conversion on every probe and returns immediately; collect() fetches the
+// results by ROM address (no bus search per read), yielding only for
+// whatever part of the conversion time the caller did not already use.
+class WaterTempProbes {
+ public:
+  void begin(DallasTemperature &bus, uint8_t resolution);
+  void start();
+  // Fills out[0..DS18B20_MAX_PROBES) with temperatures or NAN; returns the
+  // number of probes that answered.
+  uint8_t collect(float *out);
+  uint8_t count() const { return _count; }
+
+ private:
+  void discover();
+
+  DallasTemperature *_bus = nullptr;
+  DeviceAddress _addrs[DS18B20_MAX_PROBES];
+  uint8_t _count = 0;
+  uint8_t _resolution = 12;
+  unsigned long _startedMs = 0;
+  unsigned long _conversionMs = 0;
+  bool _pending = false;
+};
@@ -0,0 +1,43 @@
+#include "wifi_cache.h"
+
+#include <Preferences.h>
+
+static const uint32_t WIFI_CACHE_MAGIC = 0x57494649u; // "WIFI"
+static const char *NVS_NAMESPACE = "wifi";
+static const char *NVS_KEY = "cache";
+
+RTC_DATA_ATTR static WifiCache rtcCache;
+
+static bool sameLink(const WifiCache &a, const WifiCache &b) {
+  return a.channel == b.channel && memcmp(a.bssid, b.bssid, sizeof(a.bssid)) == 0 && a.ip == b.ip &&
+         a.gateway == b.gateway && a.subnet == b.subnet;
+}
+
+bool wifiCacheLoad(WifiCache &out) {
+  if (rtcCache.magic == WIFI_CACHE_MAGIC) {
+    out = rtcCache;
+    return true;
+  }
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, true)) return false;
+  const size_t got = prefs.getBytes(NVS_KEY, &out, sizeof(out));
+  prefs.end();
+  if (got != sizeof(out) || out.magic != WIFI_CACHE_MAGIC || out.channel == 0) return false;
+  rtcCache = out;
+  return true;
+}
+
+void wifiCacheStore(const WifiCache &in) {
+  WifiCache entry = in;
+  entry.magic = WIFI_CACHE_MAGIC;
+  rtcCache = entry;
+
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, false)) return;
+  WifiCache stored;
+  const bool unchanged = prefs.getBytes(NVS_KEY, &stored, sizeof(stored)) == sizeof(stored) &&
+                         stored.magic == WIFI_CACHE_MAGIC && sameLink(stored, entry);
+  if (!unchanged) prefs.putBytes(NVS_KEY, &entry, sizeof(entry));
+  prefs.end();
+}
+
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Last good association (BSSID, channel, DHCP lease) for fast reconnects.
+// Kept in RTC memory for deep-sleep wakes and mirrored to NVS for cold boots;
+// NVS is only rewritten when something changed.
+struct WifiCache {
+  uint32_t magic;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+};
+
+bool wifiCacheLoad(WifiCache &out);
+void wifiCacheStore(const WifiCache &in);
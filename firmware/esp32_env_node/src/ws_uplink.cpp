@@ -0,0 +1,275 @@
+#include "ws_uplink.h"
+
+#include <HTTPClient.h>
+#include <esp_system.h>
+#include <mbedtls/base64.h>
+#include <mbedtls/sha1.h>
+
+#include "config_defaults.h"
+#include "logger.h"
+#include "stage_timing.h"
+
+static const uint8_t WS_OP_TEXT = 0x1;
+static const uint8_t WS_OP_BINARY = 0x2;
+static const uint8_t WS_OP_CLOSE = 0x8;
+static const uint8_t WS_OP_PING = 0x9;
+static const uint8_t WS_OP_PONG = 0xA;
+static const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static bool expired(unsigned long deadline) {
+  return static_cast<long>(millis() - deadline) >= 0;
+}
+
+bool WsUplink::begin(const char *url) {
+  const String full = String(url);
+  int schemePos = full.indexOf("://");
+  int hostStart = schemePos >= 0 ? schemePos + 3 : 0;
+  int pathStart = full.indexOf('/', hostStart);
+  _host = pathStart >= 0 ? full.substring(hostStart, pathStart) : full.substring(hostStart);
+  if (_host.length() == 0) {
+    LOG_ERROR("WebSocket begin failed: host empty");
+    return false;
+  }
+  _client.setInsecure(); // DEBUG ONLY - TODO: pin server cert
+  _configured = true;
+  LOG_DEBUG("WebSocket host=%s path=%s", _host.c_str(), UPLINK_WS_PATH);
+  return true;
+}
+
+int WsUplink::send(const SignedRequest &req, char *resp, size_t respCap) {
+  resp[0] = '\0';
+  _lastReused = _open && _client.connected();
+  if (!_lastReused && !connect(req)) {
+    count(&Counters::failures);
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  count(&Counters::requests);
+  if (_lastReused) count(&Counters::reused);
+
+  char head[128];
+  const int headLen = snprintf(head, sizeof(head), "%s %s %s %s\n", req.timestamp, req.nonce, req.signature,
+                               req.configVersion);
+  if (headLen <= 0 || static_cast<size_t>(headLen) >= sizeof(head)) return HTTPC_ERROR_TOO_LESS_RAM;
+  int code;
+  {
+    StageSpan span(STAGE_POST);
+    code = writeFrame(WS_OP_BINARY, reinterpret_cast<const uint8_t *>(head), headLen, req.body, req.len)
+               ? readReply(resp, respCap)
+               : HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+  if (code <= 0) {
+    // Stale or broken socket: the next send reconnects.
+    count(&Counters::failures);
+    close();
+  }
+  return code;
+}
+
+void WsUplink::close() {
+  _client.stop();
+  _open = false;
+}
+
+bool WsUplink::connect(const SignedRequest &req) {
+  close();
+  count(&Counters::handshakes);
+  int connected;
+  {
+    StageSpan span(STAGE_TLS);
+    connected = _client.connect(_host.c_str(), 443);
+  }
+  if (!connected) {
+    LOG_WARN("TLS connect to %s failed", _host.c_str());
+    return false;
+  }
+  if (!handshake(req)) {
+    close();
+    return false;
+  }
+  _open = true;
+  LOG_INFO("WebSocket uplink open to %s%s", _host.c_str(), UPLINK_WS_PATH);
+  return true;
+}
+
+bool WsUplink::handshake(const SignedRequest &req) {
+  uint8_t keyBytes[16];
+  esp_fill_random(keyBytes, sizeof(keyBytes));
+  unsigned char key[25]; // 24 base64 chars + NUL
+  size_t keyLen = 0;
+  mbedtls_base64_encode(key, sizeof(key), &keyLen, keyBytes, sizeof(keyBytes));
+
+  char request[384];
+  const int n = snprintf(request, sizeof(request),
+                         "GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                         "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n"
+                         "X-API-Key: %s\r\nX-Node-Id: %s\r\nX-Content-Type: %s\r\n"
+                         "X-Firmware-Version: %s\r\n\r\n",
+                         UPLINK_WS_PATH, _host.c_str(), key, API_KEY, req.nodeId, req.contentType,
+                         FIRMWARE_VERSION_TEXT);
+  if (n <= 0 || static_cast<size_t>(n) >= sizeof(request)) return false;
+  if (!writeAll(reinterpret_cast<const uint8_t *>(request), n)) return false;
+
+  char acceptSrc[sizeof(key) + sizeof(WS_GUID)];
+  snprintf(acceptSrc, sizeof(acceptSrc), "%s%s", key, WS_GUID);
+  uint8_t digest[20];
+  mbedtls_sha1_ret(reinterpret_cast<const unsigned char *>(acceptSrc), strlen(acceptSrc), digest);
+  unsigned char expected[29]; // 28 base64 chars + NUL
+  size_t expectedLen = 0;
+  mbedtls_base64_encode(expected, sizeof(expected), &expectedLen, digest, sizeof(digest));
+
+  const unsigned long deadline = millis() + UPLINK_WS_REPLY_TIMEOUT_MS;
+  char line[160];
+  if (!readLine(line, sizeof(line), deadline)) return false;
+  if (strncmp(line, "HTTP/1.1 101", 12) != 0) {
+    LOG_WARN("WebSocket upgrade refused: %s", line);
+    return false;
+  }
+  bool accepted = false;
+  while (readLine(line, sizeof(line), deadline)) {
+    if (line[0] == '\0') {
+      if (!accepted) LOG_WARN("WebSocket upgrade: bad Sec-WebSocket-Accept");
+      return accepted;
+    }
+    if (strncasecmp(line, "Sec-WebSocket-Accept:", 21) == 0) {
+      const char *value = line + 21;
+      while (*value == ' ') value++;
+      accepted = strcmp(value, reinterpret_cast<const char *>(expected)) == 0;
+    }
+  }
+  return false;
+}
+
+bool WsUplink::readExact(uint8_t *dst, size_t len, unsigned long deadline) {
+  while (len > 0) {
+    const int got = _client.read(dst, len);
+    if (got > 0) {
+      dst += got;
+      len -= got;
+      continue;
+    }
+    if (!_client.connected() || expired(deadline)) return false;
+    delay(1);
+  }
+  return true;
+}
+
+// Reads one CRLF-terminated header line without the line ending; overlong
+// lines are truncated.
+bool WsUplink::readLine(char *line, size_t cap, unsigned long deadline) {
+  size_t n = 0;
+  for (;;) {
+    uint8_t c;
+    if (!readExact(&c, 1, deadline)) return false;
+    if (c == '\n') break;
+    if (c != '\r' && n + 1 < cap) line[n++] = static_cast<char>(c);
+  }
+  line[n] = '\0';
+  return true;
+}
+
+bool WsUplink::writeAll(const uint8_t *data, size_t len) {
+  while (len > 0) {
+    const size_t wrote = _client.write(data, len);
+    if (wrote == 0) return false;
+    data += wrote;
+    len -= wrote;
+  }
+  return true;
+}
+
+bool WsUplink::writeFrame(uint8_t opcode, const uint8_t *head, size_t headLen, const uint8_t *body,
+                          size_t bodyLen) {
+  const uint64_t len = static_cast<uint64_t>(headLen) + bodyLen;
+  uint8_t hdr[14];
+  size_t h = 0;
+  hdr[h++] = 0x80 | opcode; // FIN: never fragmented
+  if (len < 126) {
+    hdr[h++] = 0x80 | static_cast<uint8_t>(len);
+  } else if (len <= 0xFFFF) {
+    hdr[h++] = 0x80 | 126;
+    hdr[h++] = static_cast<uint8_t>(len >> 8);
+    hdr[h++] = static_cast<uint8_t>(len);
+  } else {
+    hdr[h++] = 0x80 | 127;
+    for (int shift = 56; shift >= 0; shift -= 8) hdr[h++] = static_cast<uint8_t>(len >> shift);
+  }
+  uint8_t mask[4];
+  esp_fill_random(mask, sizeof(mask));
+  memcpy(hdr + h, mask, sizeof(mask));
+  h += sizeof(mask);
+  if (!writeAll(hdr, h)) return false;
+
+  // Client frames must be masked; mask through a scratch buffer so the body
+  // is never copied whole.
+  uint8_t chunk[512];
+  size_t pos = 0;
+  const uint8_t *parts[2] = {head, body};
+  const size_t lens[2] = {headLen, bodyLen};
+  for (uint8_t p = 0; p < 2; p++) {
+    for (size_t off = 0; off < lens[p];) {
+      const size_t n = min(sizeof(chunk), lens[p] - off);
+      for (size_t i = 0; i < n; i++) chunk[i] = parts[p][off + i] ^ mask[(pos + i) & 3];
+      if (!writeAll(chunk, n)) return false;
+      off += n;
+      pos += n;
+    }
+  }
+  return true;
+}
+
+int WsUplink::readReply(char *resp, size_t respCap) {
+  const unsigned long deadline = millis() + UPLINK_WS_REPLY_TIMEOUT_MS;
+  for (;;) {
+    uint8_t hdr[2];
+    if (!readExact(hdr, sizeof(hdr), deadline)) return HTTPC_ERROR_READ_TIMEOUT;
+    const uint8_t opcode = hdr[0] & 0x0F;
+    // The backend never masks or fragments; anything else is a protocol error.
+    if ((hdr[1] & 0x80) || !(hdr[0] & 0x80)) return HTTPC_ERROR_CONNECTION_LOST;
+    uint64_t len = hdr[1] & 0x7F;
+    if (len >= 126) {
+      uint8_t ext[8];
+      const size_t extLen = len == 126 ? 2 : 8;
+      if (!readExact(ext, extLen, deadline)) return HTTPC_ERROR_READ_TIMEOUT;
+      len = 0;
+      for (size_t i = 0; i < extLen; i++) len = (len << 8) | ext[i];
+    }
+
+    // Keep what fits in resp and drain the rest.
+    size_t stored = 0;
+    uint8_t sink[64];
+    while (len > 0) {
+      uint8_t *dst = sink;
+      size_t want = static_cast<size_t>(min<uint64_t>(len, sizeof(sink)));
+      if (stored + 1 < respCap) {
+        dst = reinterpret_cast<uint8_t *>(resp + stored);
+        want = min(want, respCap - 1 - stored);
+      }
+      if (!readExact(dst, want, deadline)) return HTTPC_ERROR_READ_TIMEOUT;
+      if (dst != sink) stored += want;
+      len -= want;
+    }
+    resp[stored] = '\0';
+
+    switch (opcode) {
+      case WS_OP_PING:
+        if (!writeFrame(WS_OP_PONG, reinterpret_cast<const uint8_t *>(resp), stored, nullptr, 0)) {
+          return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+        }
+        continue;
+      case WS_OP_PONG:
+        continue;
+      case WS_OP_TEXT:
+      case WS_OP_BINARY: {
+        char *rest = nullptr;
+        const long status = strtol(resp, &rest, 10);
+        if (rest == resp) return HTTPC_ERROR_NO_HTTP_SERVER;
+        if (*rest == ' ') rest++;
+        memmove(resp, rest, strlen(rest) + 1);
+        return static_cast<int>(status);
+      }
+      case WS_OP_CLOSE:
+      default:
+        return HTTPC_ERROR_CONNECTION_LOST;
+    }
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+
+#include "uplink.h"
+
+// Signed uploads as frames on one long-lived TLS WebSocket to UPLINK_WS_PATH
+// on the SERVER_URL host (backend ws_uplink.py). The upgrade request carries
+// X-API-Key, X-Node-Id and X-Content-Type once; each upload is then a single
+// binary frame "<timestamp> <nonce> <signature>\n<body>", answered in order
+// with a text frame "<status> <response json>". A request is only treated
+// as delivered once that answer arrives, so an unanswered batch stays queued
+// and is sent again.
+class WsUplink : public Uplink {
+ public:
+  bool begin(const char *url) override;
+  bool configured() const override { return _configured; }
+  int send(const SignedRequest &req, char *resp, size_t respCap) override;
+  void close() override;
+
+ private:
+  bool connect(const SignedRequest &req);
+  bool handshake(const SignedRequest &req);
+  bool readExact(uint8_t *dst, size_t len, unsigned long deadline);
+  bool readLine(char *line, size_t cap, unsigned long deadline);
+  bool writeAll(const uint8_t *data, size_t len);
+  // Writes one masked client frame whose payload is head followed by body.
+  bool writeFrame(uint8_t opcode, const uint8_t *head, size_t headLen, const uint8_t *body, size_t bodyLen);
+  int readReply(char *resp, size_t respCap);
+
+  WiFiClientSecure _client;
+  String _host;
+  bool _configured = false;
+  bool _open = false;
+};
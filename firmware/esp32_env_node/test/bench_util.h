@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <unity.h>
+
+// Shared by test_core and test_bench, on the host and on the board.
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_timer.h>
+
+inline uint64_t benchMicros() {
+  return static_cast<uint64_t>(esp_timer_get_time());
+}
+#else
+#include <chrono>
+
+inline uint64_t benchMicros() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+#ifdef BENCH_COUNT_ALLOCS
+// Every malloc/calloc/realloc in the image goes through these
+// (-Wl,--wrap=..., see [alloc_count] in platformio.ini).
+static volatile uint32_t benchAllocCount = 0;
+
+extern "C" {
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+
+void *__wrap_malloc(size_t n) {
+  benchAllocCount = benchAllocCount + 1;
+  return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+  benchAllocCount = benchAllocCount + 1;
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t n) {
+  benchAllocCount = benchAllocCount + 1;
+  return __real_realloc(p, n);
+}
+}
+
+inline bool benchCountsAllocs() {
+  return true;
+}
+
+inline uint32_t benchAllocs() {
+  return benchAllocCount;
+}
+#else
+inline bool benchCountsAllocs() {
+  return false;
+}
+
+inline uint32_t benchAllocs() {
+  return 0;
+}
+#endif
+
+// One result line, e.g. "sds_parse: 1234567.0 frames/s".
+inline void benchReport(const char *name, double value, const char *unit) {
+  char line[96];
+  snprintf(line, sizeof(line), "%s: %.1f %s", name, value, unit);
+  TEST_MESSAGE(line);
+}
+
+// Runs main() on the host and setup() on the board; the board waits for the
+// serial monitor the test runner opens after flashing.
+#ifdef ARDUINO
+#define BENCH_MAIN(runner) \
+  void setup() {           \
+    delay(2000);           \
+    runner();              \
+  }                        \
+  void loop() {}
+#else
+#define BENCH_MAIN(runner) \
+  int main() {             \
+    return runner();       \
+  }
+#endif
@@ -0,0 +1,5 @@
+#pragma once
+
+// Stands in for include/config.h in env:native. Only what lib/node_core
+// reads; everything else keeps its config_defaults.h value.
+#define NODE_ID "bench_node"
@@ -0,0 +1,140 @@
+#include <string.h>
+
+#include "../bench_util.h"
+#include "payload.h"
+#include "sds_frame_parser.h"
+#include "sensor_math.h"
+#include "signing.h"
+
+// Microbenchmarks for the per-sample and per-upload hot paths. Each one
+// prints its rate through TEST_MESSAGE so runs can be compared before and
+// after a change; the assertions only catch results that are wrong, plus
+// any heap allocation in the upload path where allocations are counted.
+
+void setUp() {}
+void tearDown() {}
+
+#ifdef ARDUINO
+static const uint32_t SCALE = 1;
+#else
+static const uint32_t SCALE = 20;
+#endif
+
+static double perSecond(uint64_t count, uint64_t elapsedUs) {
+  return elapsedUs ? count * 1e6 / elapsedUs : 0.0;
+}
+
+static void bench_sds_parse() {
+  // One valid frame per 11 bytes: the frame plus a byte of line noise.
+  static uint8_t stream[11 * 256];
+  const uint8_t frame[SdsFrameParser::FRAME_LEN] = {0xAA, 0xC0, 0xD4, 0x04, 0x3A, 0x0A, 0xA1, 0x60, 0x1D, 0xAB};
+  for (size_t i = 0; i < sizeof(stream); i += 11) {
+    memcpy(stream + i, frame, sizeof(frame));
+    stream[i + 10] = 0x5A;
+  }
+  SdsFrameParser p;
+  const uint32_t passes = 100 * SCALE;
+  uint32_t frames = 0;
+  const uint64_t start = benchMicros();
+  for (uint32_t n = 0; n < passes; n++) {
+    for (uint8_t b : stream) frames += p.feed(b) == SdsFrameParser::DATA;
+  }
+  const uint64_t elapsed = benchMicros() - start;
+  TEST_ASSERT_EQUAL_UINT32(passes * 256, frames);
+  benchReport("sds_parse", perSecond(frames, elapsed), "frames/s");
+  benchReport("sds_parse_bytes", perSecond(static_cast<uint64_t>(passes) * sizeof(stream), elapsed), "B/s");
+}
+
+static void bench_sign(size_t bodyLen, const char *name) {
+  static uint8_t body[4096];
+  memset(body, 'x', sizeof(body));
+  HmacSigner signer;
+  signer.begin("bench-secret");
+  char signature[SIGNATURE_HEX_LEN + 1];
+  const uint32_t rounds = 50 * SCALE;
+  const uint64_t start = benchMicros();
+  for (uint32_t n = 0; n < rounds; n++) {
+    signRequest(signer, NODE_ID, "1700000000", "0123456789abcdef", body, bodyLen, signature);
+  }
+  const uint64_t elapsed = benchMicros() - start;
+  TEST_ASSERT_EQUAL(SIGNATURE_HEX_LEN, strlen(signature));
+  benchReport(name, perSecond(static_cast<uint64_t>(rounds) * bodyLen, elapsed), "B/s signed");
+  benchReport(name, elapsed / static_cast<double>(rounds), "us/request");
+}
+
+static void bench_sign_small() {
+  bench_sign(256, "hmac_256B");
+}
+
+static void bench_sign_batch() {
+  bench_sign(4096, "hmac_4KiB");
+}
+
+static void bench_to_hex() {
+  uint8_t mac[HmacSigner::MAC_LEN];
+  for (uint8_t i = 0; i < sizeof(mac); i++) mac[i] = i * 7;
+  char out[SIGNATURE_HEX_LEN + 1];
+  const uint32_t rounds = 10000 * SCALE;
+  const uint64_t start = benchMicros();
+  for (uint32_t n = 0; n < rounds; n++) {
+    mac[0] = static_cast<uint8_t>(n);
+    toHex(mac, sizeof(mac), out);
+  }
+  const uint64_t elapsed = benchMicros() - start;
+  benchReport("to_hex", perSecond(static_cast<uint64_t>(rounds) * sizeof(mac), elapsed), "B/s");
+}
+
+static void bench_gas_to_voc() {
+  const uint32_t rounds = 10000 * SCALE;
+  volatile float sink = 0;
+  const uint64_t start = benchMicros();
+  for (uint32_t n = 0; n < rounds; n++) sink = sink + gasToVoc(50000.0f + n);
+  const uint64_t elapsed = benchMicros() - start;
+  benchReport("gas_to_voc", perSecond(rounds, elapsed), "calls/s");
+}
+
+static void bench_payload() {
+  static Reading items[BATCH_MAX_READINGS];
+  for (uint16_t i = 0; i < BATCH_MAX_READINGS; i++) {
+    Reading &r = items[i];
+    memset(&r, 0, sizeof(r));
+    r.epoch = 1700000000 + i * 60;
+    r.sensors = NODE_SENSORS;
+    r.radiationUsvh = 0.11f;
+    r.pm25 = 7.5f + i;
+    r.tempC = 21.5f;
+    r.hum = 45.0f;
+    r.pressHpa = 1011.0f;
+    r.voc = gasToVoc(120000.0f);
+    for (uint8_t p = 0; p < DS18B20_MAX_PROBES; p++) r.waterTempC[p] = 14.0f;
+  }
+  static char body[UPLOAD_BODY_CAPACITY];
+  const uint32_t rounds = 20 * SCALE;
+  size_t len = 0;
+  size_t written = 0;
+  const uint32_t allocsBefore = benchAllocs();
+  const uint64_t start = benchMicros();
+  for (uint32_t n = 0; n < rounds; n++) written = buildBatchBody(items, BATCH_MAX_READINGS, body, sizeof(body), len);
+  const uint64_t elapsed = benchMicros() - start;
+  const uint32_t allocs = benchAllocs() - allocsBefore;
+  TEST_ASSERT_EQUAL_UINT(BATCH_MAX_READINGS, written);
+  benchReport(payloadContentType(), elapsed / static_cast<double>(rounds), "us/batch");
+  benchReport("payload_bytes", len, "B/batch");
+  if (benchCountsAllocs()) {
+    benchReport("payload_allocs", allocs / static_cast<double>(rounds), "allocs/batch");
+    TEST_ASSERT_EQUAL_UINT32(0, allocs);
+  }
+}
+
+static int runAll() {
+  UNITY_BEGIN();
+  RUN_TEST(bench_sds_parse);
+  RUN_TEST(bench_sign_small);
+  RUN_TEST(bench_sign_batch);
+  RUN_TEST(bench_to_hex);
+  RUN_TEST(bench_gas_to_voc);
+  RUN_TEST(bench_payload);
+  return UNITY_END();
+}
+
+BENCH_MAIN(runAll)
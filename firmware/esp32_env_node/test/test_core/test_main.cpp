@@ -0,0 +1,346 @@
+#include <ArduinoJson.h>
+#include <string.h>
+
+#include "../bench_util.h"
+#include "espnow_frame.h"
+#include "filters.h"
+#include "payload.h"
+#include "ring_buffer.h"
+#include "sds_frame_parser.h"
+#include "sensor_math.h"
+#include "signing.h"
+
+void setUp() {}
+void tearDown() {}
+
+static const uint8_t SDS_DATA_FRAME[SdsFrameParser::FRAME_LEN] = {0xAA, 0xC0, 0xD4, 0x04, 0x3A,
+                                                                  0x0A, 0xA1, 0x60, 0x1D, 0xAB};
+
+static SdsFrameParser::Frame feedAll(SdsFrameParser &p, const uint8_t *bytes, size_t n) {
+  SdsFrameParser::Frame last = SdsFrameParser::NONE;
+  for (size_t i = 0; i < n; i++) {
+    const SdsFrameParser::Frame f = p.feed(bytes[i]);
+    if (f != SdsFrameParser::NONE) last = f;
+  }
+  return last;
+}
+
+static void test_sds_parser_reads_measurement() {
+  SdsFrameParser p;
+  TEST_ASSERT_EQUAL(SdsFrameParser::DATA, feedAll(p, SDS_DATA_FRAME, sizeof(SDS_DATA_FRAME)));
+  TEST_ASSERT_EQUAL_UINT16(1236, p.pm25Raw());
+  TEST_ASSERT_EQUAL_UINT16(2618, p.pm10Raw());
+  TEST_ASSERT_EQUAL_UINT32(1, p.frames());
+}
+
+static void test_sds_parser_resyncs_after_bad_checksum() {
+  SdsFrameParser p;
+  uint8_t bad[SdsFrameParser::FRAME_LEN];
+  memcpy(bad, SDS_DATA_FRAME, sizeof(bad));
+  bad[8] ^= 0x01;
+  TEST_ASSERT_EQUAL(SdsFrameParser::NONE, feedAll(p, bad, sizeof(bad)));
+  TEST_ASSERT_EQUAL_UINT32(1, p.checksumErrors());
+  const uint8_t noise[] = {0x00, 0xAA, 0x13};
+  feedAll(p, noise, sizeof(noise));
+  TEST_ASSERT_EQUAL(SdsFrameParser::DATA, feedAll(p, SDS_DATA_FRAME, sizeof(SDS_DATA_FRAME)));
+  TEST_ASSERT_EQUAL_UINT32(1, p.frames());
+}
+
+static void test_sds_parser_reports_command_reply() {
+  SdsFrameParser p;
+  const uint8_t reply[] = {0xAA, 0xC5, 0x06, 0x01, 0x00, 0x00, 0xA1, 0x60, 0x08, 0xAB};
+  TEST_ASSERT_EQUAL(SdsFrameParser::REPLY, feedAll(p, reply, sizeof(reply)));
+  TEST_ASSERT_EQUAL_HEX8(SdsCommand::SLEEP_WORK, p.replyCommand());
+  TEST_ASSERT_EQUAL_HEX8(0x01, p.replyArg(0));
+  TEST_ASSERT_EQUAL_UINT32(0, p.frames());
+}
+
+static void test_sds_command_frames() {
+  uint8_t frame[SdsCommand::LEN];
+  SdsCommand::build(SdsCommand::SLEEP_WORK, 1, 0, frame);
+  TEST_ASSERT_EQUAL_HEX8(0xAA, frame[0]);
+  TEST_ASSERT_EQUAL_HEX8(0xB4, frame[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x05, frame[17]);
+  TEST_ASSERT_EQUAL_HEX8(0xAB, frame[18]);
+  SdsCommand::build(SdsCommand::QUERY, 0, 0, frame);
+  TEST_ASSERT_EQUAL_HEX8(0x02, frame[17]);
+}
+
+static void test_to_hex() {
+  const uint8_t bytes[] = {0x00, 0x0F, 0xA5, 0xFF};
+  char out[sizeof(bytes) * 2 + 1];
+  toHex(bytes, sizeof(bytes), out);
+  TEST_ASSERT_EQUAL_STRING("000fa5ff", out);
+}
+
+static void macHex(HmacSigner &signer, const char *message, char (&out)[SIGNATURE_HEX_LEN + 1]) {
+  uint8_t mac[HmacSigner::MAC_LEN];
+  signer.start();
+  signer.update(message, strlen(message));
+  signer.finish(mac);
+  toHex(mac, sizeof(mac), out);
+}
+
+// RFC 4231 test cases 2 (short key) and 6 (key longer than a block).
+static void test_hmac_matches_rfc4231() {
+  HmacSigner signer;
+  char out[SIGNATURE_HEX_LEN + 1];
+  signer.begin("Jefe");
+  macHex(signer, "what do ya want for nothing?", out);
+  TEST_ASSERT_EQUAL_STRING("5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843", out);
+  // The midstate is reused: a second message must not see the first.
+  macHex(signer, "what do ya want for nothing?", out);
+  TEST_ASSERT_EQUAL_STRING("5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843", out);
+
+  char longKey[132];
+  memset(longKey, 0xAA, 131);
+  longKey[131] = '\0';
+  signer.begin(longKey);
+  macHex(signer, "Test Using Larger Than Block-Size Key - Hash Key First", out);
+  TEST_ASSERT_EQUAL_STRING("60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54", out);
+}
+
+static void test_sign_request_covers_all_fields() {
+  HmacSigner signer;
+  signer.begin("secret");
+  const char body[] = "{\"readings\":[]}";
+  char signature[SIGNATURE_HEX_LEN + 1];
+  signRequest(signer, "ground_1", "1700000000", "0123456789abcdef", reinterpret_cast<const uint8_t *>(body),
+              strlen(body), signature);
+  char expected[SIGNATURE_HEX_LEN + 1];
+  macHex(signer, "ground_1.1700000000.0123456789abcdef.{\"readings\":[]}", expected);
+  TEST_ASSERT_EQUAL_STRING(expected, signature);
+}
+
+static void test_signature_equals_needs_exact_match() {
+  char expected[SIGNATURE_HEX_LEN + 1];
+  memset(expected, 'a', SIGNATURE_HEX_LEN);
+  expected[SIGNATURE_HEX_LEN] = '\0';
+  char other[SIGNATURE_HEX_LEN + 1];
+  memcpy(other, expected, sizeof(other));
+  TEST_ASSERT_TRUE(signatureEquals(expected, other));
+  other[SIGNATURE_HEX_LEN - 1] = 'b';
+  TEST_ASSERT_FALSE(signatureEquals(expected, other));
+  other[SIGNATURE_HEX_LEN - 1] = '\0';
+  TEST_ASSERT_FALSE(signatureEquals(expected, other));
+  TEST_ASSERT_FALSE(signatureEquals(expected, nullptr));
+}
+
+static void test_gas_to_voc_is_monotonic_and_capped() {
+  TEST_ASSERT_EQUAL_FLOAT(150.0f, gasToVoc(0.0f));
+  TEST_ASSERT_TRUE(gasToVoc(50000.0f) < gasToVoc(500000.0f));
+  TEST_ASSERT_EQUAL_FLOAT(50.0f, gasToVoc(1.0f));
+  TEST_ASSERT_EQUAL_FLOAT(800.0f, gasToVoc(1e12f));
+}
+
+static void test_ring_buffer_evicts_oldest() {
+  RingBuffer<int, 3> ring;
+  TEST_ASSERT_TRUE(ring.push(1));
+  ring.push(2);
+  ring.push(3);
+  TEST_ASSERT_FALSE(ring.push(4));
+  TEST_ASSERT_EQUAL_INT(2, ring.front());
+  int out[3];
+  TEST_ASSERT_EQUAL_UINT(3, ring.copyOut(out, 3));
+  TEST_ASSERT_EQUAL_INT(4, out[2]);
+  ring.pop(2);
+  TEST_ASSERT_EQUAL_UINT(1, ring.size());
+}
+
+static void test_hampel_rejects_spike() {
+  HampelFilter<5> f;
+  f.reset();
+  for (int i = 0; i < 4; i++) f.apply(10.0f + 0.1f * i, 3.0f, 0.5f);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 10.2f, f.apply(100.0f, 3.0f, 0.5f));
+  TEST_ASSERT_TRUE(isnan(f.apply(NAN, 3.0f, 0.5f)));
+}
+
+static Reading sampleReading(uint32_t epoch) {
+  Reading r = {};
+  r.epoch = epoch;
+  r.sensors = NODE_PROFILE_ALL;
+  r.radiationUsvh = 0.12f;
+  r.pm25 = 8.5f;
+  r.tempC = 21.0f;
+  r.hum = 40.0f;
+  r.pressHpa = 1012.0f;
+  r.voc = 120.0f;
+  for (uint8_t i = 0; i < DS18B20_MAX_PROBES; i++) r.waterTempC[i] = 14.5f;
+  return r;
+}
+
+static DeserializationError parseBody(JsonDocument &doc, const char *body, size_t len) {
+  if (PAYLOAD_FORMAT == PAYLOAD_FORMAT_MSGPACK) return deserializeMsgPack(doc, body, len);
+  return deserializeJson(doc, body, len);
+}
+
+static void test_payload_round_trips() {
+  const Reading items[2] = {sampleReading(1700000000), sampleReading(1700000060)};
+  static char body[4096];
+  size_t len = 0;
+  TEST_ASSERT_EQUAL_UINT(2, buildBatchBody(items, 2, body, sizeof(body), len));
+  DynamicJsonDocument doc(4096);
+  TEST_ASSERT_FALSE(parseBody(doc, body, len));
+  TEST_ASSERT_EQUAL_STRING(NODE_ID, doc["device_id"]);
+  JsonArray readings = doc["readings"];
+  TEST_ASSERT_EQUAL_UINT(2, readings.size());
+  if (PAYLOAD_FORMAT == PAYLOAD_FORMAT_MSGPACK) {
+    TEST_ASSERT_EQUAL_INT(1, doc["v"].as<int>());
+    TEST_ASSERT_EQUAL_UINT32(1700000060, readings[1][0].as<uint32_t>());
+  } else {
+    TEST_ASSERT_EQUAL_UINT32(1700000060, readings[1]["timestamp"].as<uint32_t>());
+  }
+}
+
+static void test_payload_stops_at_capacity() {
+  Reading items[8];
+  for (uint8_t i = 0; i < 8; i++) items[i] = sampleReading(1700000000 + i);
+  static char one[4096];
+  size_t oneLen = 0;
+  buildBatchBody(items, 1, one, sizeof(one), oneLen);
+  static char body[4096];
+  size_t len = 0;
+  // Room for about two and a half readings: whole readings only.
+  const size_t written = buildBatchBody(items, 8, body, oneLen * 5 / 2, len);
+  TEST_ASSERT_TRUE(written >= 1 && written < 8);
+  TEST_ASSERT_TRUE(len < oneLen * 5 / 2);
+  TEST_ASSERT_EQUAL_UINT(0, buildBatchBody(items, 8, body, 8, len));
+}
+
+static void test_payload_uses_given_device_id() {
+  const Reading item = sampleReading(1700000000);
+  static char body[4096];
+  size_t len = 0;
+  TEST_ASSERT_EQUAL_UINT(1, buildBatchBody(&item, 1, body, sizeof(body), len, nullptr, "water_lg_7"));
+  DynamicJsonDocument doc(4096);
+  TEST_ASSERT_FALSE(parseBody(doc, body, len));
+  TEST_ASSERT_EQUAL_STRING("water_lg_7", doc["device_id"]);
+}
+
+// A gateway's own profile must not decide which fields of a leaf's reading
+// are sent; env:native_air runs this on an air-profile build.
+static void test_payload_follows_the_reading_sensors() {
+  Reading leaf = sampleReading(1700000000);
+  leaf.sensors = NODE_PROFILE_WATER;
+  leaf.turbidityRaw = 3;
+  static char body[4096];
+  size_t len = 0;
+  TEST_ASSERT_EQUAL_UINT(1, buildBatchBody(&leaf, 1, body, sizeof(body), len, nullptr, "water_1"));
+  DynamicJsonDocument doc(4096);
+  TEST_ASSERT_FALSE(parseBody(doc, body, len));
+  JsonVariant row = doc["readings"][0];
+  if (PAYLOAD_FORMAT == PAYLOAD_FORMAT_MSGPACK) {
+    TEST_ASSERT_TRUE(row[2].isNull()); // pm25
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 14.5f, row[7].as<float>()); // water_temp_c
+    TEST_ASSERT_EQUAL_UINT(3, row[8].as<unsigned>()); // turbidity_raw
+  } else {
+    JsonObject data = row["data"];
+    TEST_ASSERT_FALSE(data.containsKey("pm25"));
+    TEST_ASSERT_FALSE(data.containsKey("air_temp_c"));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 14.5f, data["water_temp_c"].as<float>());
+    TEST_ASSERT_EQUAL_UINT(3, data["turbidity_raw"].as<unsigned>());
+    TEST_ASSERT_EQUAL_UINT(4, data["ph_mv"].size());
+  }
+}
+
+static void test_payload_attaches_health() {
+  const Reading item = sampleReading(1700000000);
+  NodeHealth health = {};
+  health.reset = HEALTH_RESET_TASK_WDT;
+  health.uptimeS = 86400;
+  health.stuckTask = HEALTH_TASK_NETWORK;
+  health.stuckStage = STAGE_TLS;
+  health.wdtResets = 1;
+  health.sdsFails = 2;
+  static char body[4096];
+  size_t len = 0;
+  TEST_ASSERT_EQUAL_UINT(1, buildBatchBody(&item, 1, body, sizeof(body), len, nullptr, NODE_ID, &health));
+  DynamicJsonDocument doc(4096);
+  TEST_ASSERT_FALSE(parseBody(doc, body, len));
+  TEST_ASSERT_EQUAL_STRING("task_wdt", doc["health"]["reset"]);
+  TEST_ASSERT_EQUAL_STRING("net:tls", doc["health"]["stuck"]);
+  TEST_ASSERT_EQUAL_UINT32(86400, doc["health"]["uptime_s"].as<uint32_t>());
+  TEST_ASSERT_EQUAL_INT(2, doc["health"]["fails"]["sds"].as<int>());
+
+  health.stuckTask = HEALTH_TASK_COUNT; // not a watchdog reset: no "stuck"
+  buildBatchBody(&item, 1, body, sizeof(body), len, nullptr, NODE_ID, &health);
+  TEST_ASSERT_FALSE(parseBody(doc, body, len));
+  TEST_ASSERT_TRUE(doc["health"]["stuck"].isNull());
+}
+
+static void test_espnow_reading_round_trips_and_rejects_tampering() {
+  HmacSigner signer;
+  signer.begin("mesh");
+  Reading r = sampleReading(1700000000);
+  uint8_t frame[ESPNOW_FRAME_MAX];
+  const size_t len = espnowEncodeReading(signer, "water_2", 42, 1700000100, r, frame, sizeof(frame));
+  TEST_ASSERT_TRUE(len > 0 && len <= ESPNOW_FRAME_MAX);
+  EspNowReading got;
+  TEST_ASSERT_TRUE(espnowDecodeReading(signer, frame, len, got));
+  TEST_ASSERT_EQUAL_STRING("water_2", got.nodeId);
+  TEST_ASSERT_EQUAL_UINT32(42, got.seq);
+  TEST_ASSERT_EQUAL_UINT32(1700000100, got.sentAt);
+  TEST_ASSERT_EQUAL_UINT32(1700000000, got.reading.epoch);
+  TEST_ASSERT_EQUAL_FLOAT(8.5f, got.reading.pm25);
+  TEST_ASSERT_FALSE(espnowDecodeReading(signer, frame, len - 1, got));
+  frame[3] ^= 0x01; // seq
+  TEST_ASSERT_FALSE(espnowDecodeReading(signer, frame, len, got));
+  frame[3] ^= 0x01;
+  HmacSigner other;
+  other.begin("not-mesh");
+  TEST_ASSERT_FALSE(espnowDecodeReading(other, frame, len, got));
+}
+
+static void test_espnow_ack_is_bound_to_the_leaf() {
+  HmacSigner signer;
+  signer.begin("mesh");
+  const EspNowAck ack = {7, 1700000000123ULL};
+  uint8_t frame[ESPNOW_FRAME_MAX];
+  const size_t len = espnowEncodeAck(signer, "water_2", ack, frame, sizeof(frame));
+  EspNowAck got;
+  TEST_ASSERT_TRUE(espnowDecodeAck(signer, "water_2", frame, len, got));
+  TEST_ASSERT_EQUAL_UINT32(7, got.seq);
+  TEST_ASSERT_TRUE(got.epochMs == 1700000000123ULL);
+  TEST_ASSERT_FALSE(espnowDecodeAck(signer, "water_3", frame, len, got));
+}
+
+static void test_espnow_stale_reply_is_bound_to_the_leaf_and_not_an_ack() {
+  HmacSigner signer;
+  signer.begin("mesh");
+  const EspNowStale stale = {7, 4096};
+  uint8_t frame[ESPNOW_FRAME_MAX];
+  const size_t len = espnowEncodeStale(signer, "water_2", stale, frame, sizeof(frame));
+  EspNowStale got;
+  TEST_ASSERT_TRUE(espnowDecodeStale(signer, "water_2", frame, len, got));
+  TEST_ASSERT_EQUAL_UINT32(7, got.seq);
+  TEST_ASSERT_EQUAL_UINT32(4096, got.floor);
+  TEST_ASSERT_FALSE(espnowDecodeStale(signer, "water_3", frame, len, got));
+  EspNowAck ack;
+  TEST_ASSERT_FALSE(espnowDecodeAck(signer, "water_2", frame, len, ack));
+}
+
+static int runAll() {
+  UNITY_BEGIN();
+  RUN_TEST(test_sds_parser_reads_measurement);
+  RUN_TEST(test_sds_parser_resyncs_after_bad_checksum);
+  RUN_TEST(test_sds_parser_reports_command_reply);
+  RUN_TEST(test_sds_command_frames);
+  RUN_TEST(test_to_hex);
+  RUN_TEST(test_hmac_matches_rfc4231);
+  RUN_TEST(test_sign_request_covers_all_fields);
+  RUN_TEST(test_signature_equals_needs_exact_match);
+  RUN_TEST(test_gas_to_voc_is_monotonic_and_capped);
+  RUN_TEST(test_ring_buffer_evicts_oldest);
+  RUN_TEST(test_hampel_rejects_spike);
+  RUN_TEST(test_payload_round_trips);
+  RUN_TEST(test_payload_stops_at_capacity);
+  RUN_TEST(test_payload_uses_given_device_id);
+  RUN_TEST(test_payload_follows_the_reading_sensors);
+  RUN_TEST(test_payload_attaches_health);
+  RUN_TEST(test_espnow_reading_round_trips_and_rejects_tampering);
+  RUN_TEST(test_espnow_ack_is_bound_to_the_leaf);
+  RUN_TEST(test_espnow_stale_reply_is_bound_to_the_leaf_and_not_an_ack);
+  return UNITY_END();
+}
+
+BENCH_MAIN(runAll)
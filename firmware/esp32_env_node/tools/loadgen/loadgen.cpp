@@ -0,0 +1,419 @@
+// Fleet-scale load generator for the telemetry backend. Emulates many nodes
+// uploading signed batches with the firmware's own payload builder and HMAC
+// signer, so the backend sees byte-for-byte what ESP32 nodes send:
+//
+//   pio run -e loadgen
+//   .pio/build/loadgen/program --url http://127.0.0.1:5000/api/telemetry
+//       --nodes 2000 --interval 60 --duration 120 --skew 30 --replay 0.01
+//
+// The backend must know every node's secret; --print-secrets writes the
+// TELEMETRY_HMAC_SECRETS value for the same --nodes/--prefix/--secret.
+//
+// Uploads are scheduled open-loop: every node has a fixed due time per
+// interval, and a late start is counted as schedule lag instead of silently
+// lowering the offered rate.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "net.h"
+#include "payload.h"
+#include "signing.h"
+
+using Clock = std::chrono::steady_clock;
+
+enum Transport { TRANSPORT_HTTP, TRANSPORT_HTTP_CLOSE, TRANSPORT_WS };
+
+struct Options {
+  std::string url;
+  std::string apiKey;
+  std::string secret = "loadgen-secret";
+  std::vector<std::string> prefixes = {"ground_lg_", "water_lg_"};
+  unsigned nodes = 1000;
+  double intervalSec = 60;
+  double rate = 0; // total uploads/s; overrides intervalSec when set
+  unsigned batch = BATCH_MAX_READINGS;
+  Transport transport = TRANSPORT_HTTP;
+  unsigned workers = 8;
+  double durationSec = 60;
+  double skewSec = 0;
+  double replay = 0;
+  int timeoutMs = 10000;
+  bool printSecrets = false;
+};
+
+struct Node {
+  std::string id;
+  int64_t skewSec;
+  Clock::time_point due;
+  SignedBatch last; // kept for deliberate replays
+  Conn ws;
+};
+
+// What one worker saw; merged once every worker has finished.
+struct Stats {
+  std::vector<uint32_t> latencyUs;
+  std::vector<uint32_t> lagUs;
+  std::map<std::string, uint64_t> outcomes;
+  uint64_t sent = 0;
+  uint64_t ok = 0;
+  uint64_t readings = 0;
+  uint64_t bodyBytes = 0;
+  uint64_t connects = 0;
+  uint64_t replaysSent = 0;
+  uint64_t replaysRejected = 0;
+};
+
+static const char NONCE_REPLAY_ERROR[] = "Nonce replay detected";
+
+static std::atomic<uint64_t> sentTotal{0};
+static std::atomic<uint64_t> okTotal{0};
+
+static std::string nodeId(const Options &opt, unsigned i) {
+  return opt.prefixes[i % opt.prefixes.size()] + std::to_string(i);
+}
+
+// Plausible values around the same means as backend/scripts/simulate.py.
+static void fillReading(Reading &r, uint32_t epoch, std::mt19937 &rng) {
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  r = Reading();
+  r.epoch = epoch;
+  r.sensors = NODE_SENSORS;
+  r.radiationUsvh = 0.15f + 0.02f * noise(rng);
+  r.pm25 = 12.0f + 3.0f * noise(rng);
+  r.tempC = 27.0f + 2.0f * noise(rng);
+  r.hum = 65.0f + 5.0f * noise(rng);
+  r.pressHpa = 1010.0f + 3.0f * noise(rng);
+  r.voc = 180.0f + 40.0f * noise(rng);
+  for (float &t : r.waterTempC) t = 24.0f + noise(rng);
+  r.turbidityRaw = static_cast<uint16_t>(1800 + 50 * noise(rng));
+  r.tdsRaw = static_cast<uint16_t>(1200 + 40 * noise(rng));
+  r.phRaw = static_cast<uint16_t>(2100 + 30 * noise(rng));
+  const AnalogStats mv = {1450, 1450, 1400, 1500};
+  r.turbidityMv = r.tdsMv = r.phMv = mv;
+}
+
+// Builds and signs a fresh batch stamped with the node's (skewed) clock.
+static size_t buildBatch(const Options &opt, Node &node, HmacSigner &signer, std::mt19937 &rng,
+                         std::vector<Reading> &items, std::vector<char> &buf) {
+  const int64_t now = static_cast<int64_t>(time(nullptr)) + node.skewSec;
+  const double spacing = opt.intervalSec / items.size();
+  for (size_t i = 0; i < items.size(); i++) {
+    const double age = (items.size() - 1 - i) * spacing;
+    fillReading(items[i], static_cast<uint32_t>(now - static_cast<int64_t>(age)), rng);
+  }
+  size_t len = 0;
+  const size_t written = buildBatchBody(items.data(), items.size(), buf.data(), buf.size(), len, nullptr,
+                                        node.id.c_str());
+  char ts[16];
+  snprintf(ts, sizeof(ts), "%lld", static_cast<long long>(now));
+  char nonce[NONCE_HEX_LEN + 1];
+  makeNonce(nonce);
+  char signature[SIGNATURE_HEX_LEN + 1];
+  signRequest(signer, node.id.c_str(), ts, nonce, reinterpret_cast<const uint8_t *>(buf.data()), len, signature);
+  node.last.nodeId = node.id;
+  node.last.timestamp = ts;
+  node.last.nonce = nonce;
+  node.last.signature = signature;
+  node.last.body.assign(buf.data(), len);
+  return written;
+}
+
+// "<status> <error>" for rejections, so NonceCache and window rejections are
+// counted apart from everything else.
+static std::string outcome(int status, const std::string &resp) {
+  if (status == NET_ERROR_STALE || status == NET_ERROR_IO) return "transport error";
+  std::string label = std::to_string(status);
+  if (status == 200) return label + " ok";
+  static const char key[] = "\"error\":";
+  size_t at = resp.find(key);
+  if (at == std::string::npos) return label;
+  at = resp.find('"', at + sizeof(key) - 1);
+  const size_t end = at == std::string::npos ? at : resp.find('"', at + 1);
+  return end == std::string::npos ? label : label + " " + resp.substr(at + 1, end - at - 1);
+}
+
+static int send(const Options &opt, const Endpoint &ep, Conn &shared, Node &node, Stats &stats, std::string &resp) {
+  const char *contentType = payloadContentType();
+  Conn &conn = opt.transport == TRANSPORT_WS ? node.ws : shared;
+  // A reused socket the server already dropped gets one retry on a fresh
+  // connection, as the firmware does.
+  for (int attempt = 0; attempt < 2; attempt++) {
+    const bool reused = conn.isOpen();
+    if (!reused) {
+      stats.connects++;
+      if (!conn.open(ep, opt.timeoutMs)) return NET_ERROR_IO;
+      if (opt.transport == TRANSPORT_WS &&
+          !wsHandshake(conn, ep, opt.apiKey.c_str(), node.id.c_str(), contentType)) {
+        conn.close();
+        return NET_ERROR_IO;
+      }
+    }
+    const int code = opt.transport == TRANSPORT_WS
+                         ? wsSend(conn, node.last, resp)
+                         : httpPost(conn, ep, opt.apiKey.c_str(), contentType, node.last,
+                                    opt.transport == TRANSPORT_HTTP, resp);
+    if (code != NET_ERROR_STALE || !reused) return code;
+  }
+  return NET_ERROR_IO;
+}
+
+static void runWorker(const Options &opt, const Endpoint &ep, std::vector<Node *> nodes, Clock::time_point end,
+                      Stats &stats, unsigned seed) {
+  using Due = std::pair<Clock::time_point, size_t>;
+  std::priority_queue<Due, std::vector<Due>, std::greater<Due>> schedule;
+  for (size_t i = 0; i < nodes.size(); i++) schedule.push(Due(nodes[i]->due, i));
+
+  HmacSigner signer;
+  signer.begin(opt.secret.c_str());
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::vector<Reading> items(opt.batch);
+  std::vector<char> buf(UPLOAD_BODY_CAPACITY);
+  Conn shared;
+  std::string resp;
+  const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opt.intervalSec));
+
+  while (!schedule.empty()) {
+    const Due next = schedule.top();
+    schedule.pop();
+    // Uploads still queued when time is up are dropped, not sent late.
+    if (next.first >= end || Clock::now() >= end) continue;
+    Node &node = *nodes[next.second];
+    std::this_thread::sleep_until(next.first);
+
+    const bool replay = !node.last.body.empty() && unit(rng) < opt.replay;
+    size_t readings = 0;
+    if (!replay) readings = buildBatch(opt, node, signer, rng, items, buf);
+
+    const Clock::time_point start = Clock::now();
+    const int code = send(opt, ep, shared, node, stats, resp);
+    const Clock::time_point done = Clock::now();
+
+    const std::string label = outcome(code, resp);
+    stats.outcomes[label]++;
+    stats.sent++;
+    stats.bodyBytes += node.last.body.size();
+    stats.latencyUs.push_back(
+        static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(done - start).count()));
+    stats.lagUs.push_back(
+        static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(start - next.first).count()));
+    sentTotal++;
+    if (code == 200) {
+      stats.ok++;
+      stats.readings += readings;
+      okTotal++;
+    }
+    if (replay) {
+      stats.replaysSent++;
+      if (label.find(NONCE_REPLAY_ERROR) != std::string::npos) stats.replaysRejected++;
+    }
+
+    node.due = next.first + interval;
+    schedule.push(Due(node.due, next.second));
+  }
+  for (Node *node : nodes) node->ws.close();
+}
+
+static double percentile(std::vector<uint32_t> &v, double p) {
+  if (v.empty()) return 0;
+  const size_t idx = static_cast<size_t>(p * (v.size() - 1) + 0.5);
+  std::nth_element(v.begin(), v.begin() + idx, v.end());
+  return v[idx];
+}
+
+static void printDistribution(const char *name, std::vector<uint32_t> &v) {
+  printf("%-12s p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f ms\n", name, percentile(v, 0.50) / 1000,
+         percentile(v, 0.90) / 1000, percentile(v, 0.99) / 1000, percentile(v, 1.0) / 1000);
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s --url http://HOST[:PORT]/api/telemetry [options]\n"
+          "  --api-key KEY      X-API-Key (default: $ESP32_API_KEY)\n"
+          "  --secret S         HMAC secret shared by every emulated node (default: loadgen-secret)\n"
+          "  --nodes N          emulated nodes (default 1000)\n"
+          "  --prefix A,B,...   node id prefixes, assigned round robin (default ground_lg_,water_lg_)\n"
+          "  --interval SEC     upload interval per node (default 60)\n"
+          "  --rate R           total uploads per second; overrides --interval\n"
+          "  --batch K          readings per upload (default %d)\n"
+          "  --transport T      http (keep-alive), http-close or ws (default http)\n"
+          "  --workers W        sending threads (default 8)\n"
+          "  --duration SEC     run time (default 60)\n"
+          "  --skew SEC         per-node clock offset, uniform in [-SEC, SEC] (default 0)\n"
+          "  --replay FRACTION  resend the previous signed upload this often (default 0)\n"
+          "  --timeout MS       socket timeout (default 10000)\n"
+          "  --print-secrets    print TELEMETRY_HMAC_SECRETS for these nodes and exit\n",
+          argv0, BATCH_MAX_READINGS);
+}
+
+static bool parseOptions(int argc, char **argv, Options &opt) {
+  enum { URL = 1, API_KEY, SECRET, NODES, PREFIX, INTERVAL, RATE, BATCH, TRANSPORT,
+         WORKERS, DURATION, SKEW, REPLAY, TIMEOUT, PRINT_SECRETS };
+  static const option longOptions[] = {
+      {"url", required_argument, nullptr, URL},
+      {"api-key", required_argument, nullptr, API_KEY},
+      {"secret", required_argument, nullptr, SECRET},
+      {"nodes", required_argument, nullptr, NODES},
+      {"prefix", required_argument, nullptr, PREFIX},
+      {"interval", required_argument, nullptr, INTERVAL},
+      {"rate", required_argument, nullptr, RATE},
+      {"batch", required_argument, nullptr, BATCH},
+      {"transport", required_argument, nullptr, TRANSPORT},
+      {"workers", required_argument, nullptr, WORKERS},
+      {"duration", required_argument, nullptr, DURATION},
+      {"skew", required_argument, nullptr, SKEW},
+      {"replay", required_argument, nullptr, REPLAY},
+      {"timeout", required_argument, nullptr, TIMEOUT},
+      {"print-secrets", no_argument, nullptr, PRINT_SECRETS},
+      {nullptr, 0, nullptr, 0},
+  };
+  if (const char *key = getenv("ESP32_API_KEY")) opt.apiKey = key;
+  int c;
+  while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+    switch (c) {
+      case URL: opt.url = optarg; break;
+      case API_KEY: opt.apiKey = optarg; break;
+      case SECRET: opt.secret = optarg; break;
+      case NODES: opt.nodes = strtoul(optarg, nullptr, 10); break;
+      case PREFIX: {
+        opt.prefixes.clear();
+        std::string list = optarg;
+        for (size_t at = 0; at <= list.size();) {
+          const size_t comma = std::min(list.find(',', at), list.size());
+          if (comma > at) opt.prefixes.push_back(list.substr(at, comma - at));
+          at = comma + 1;
+        }
+        break;
+      }
+      case INTERVAL: opt.intervalSec = atof(optarg); break;
+      case RATE: opt.rate = atof(optarg); break;
+      case BATCH: opt.batch = strtoul(optarg, nullptr, 10); break;
+      case TRANSPORT:
+        if (strcmp(optarg, "http") == 0) opt.transport = TRANSPORT_HTTP;
+        else if (strcmp(optarg, "http-close") == 0) opt.transport = TRANSPORT_HTTP_CLOSE;
+        else if (strcmp(optarg, "ws") == 0) opt.transport = TRANSPORT_WS;
+        else return false;
+        break;
+      case WORKERS: opt.workers = strtoul(optarg, nullptr, 10); break;
+      case DURATION: opt.durationSec = atof(optarg); break;
+      case SKEW: opt.skewSec = fabs(atof(optarg)); break;
+      case REPLAY: opt.replay = atof(optarg); break;
+      case TIMEOUT: opt.timeoutMs = atoi(optarg); break;
+      case PRINT_SECRETS: opt.printSecrets = true; break;
+      default: return false;
+    }
+  }
+  if (opt.rate > 0) opt.intervalSec = opt.nodes / opt.rate;
+  return !opt.prefixes.empty() && opt.nodes > 0 && opt.batch > 0 && opt.workers > 0 && opt.intervalSec > 0 &&
+         opt.durationSec > 0 && (opt.printSecrets || !opt.url.empty());
+}
+
+int main(int argc, char **argv) {
+  Options opt;
+  if (!parseOptions(argc, argv, opt)) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (opt.printSecrets) {
+    printf("{");
+    for (unsigned i = 0; i < opt.nodes; i++) {
+      printf("%s\"%s\":\"%s\"", i ? "," : "", nodeId(opt, i).c_str(), opt.secret.c_str());
+    }
+    printf("}\n");
+    return 0;
+  }
+  Endpoint ep;
+  if (!ep.parse(opt.url)) {
+    fprintf(stderr, "only http:// URLs are supported: %s\n", opt.url.c_str());
+    return 2;
+  }
+  opt.workers = std::min(opt.workers, opt.nodes);
+
+  // Random phase per node so the fleet does not upload in lockstep.
+  std::mt19937 rng(std::random_device{}());
+  std::uniform_real_distribution<double> phase(0.0, opt.intervalSec);
+  std::uniform_int_distribution<int64_t> skew(-static_cast<int64_t>(opt.skewSec),
+                                              static_cast<int64_t>(opt.skewSec));
+  const Clock::time_point begin = Clock::now();
+  const Clock::time_point end =
+      begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opt.durationSec));
+  std::vector<std::unique_ptr<Node>> fleet;
+  std::vector<std::vector<Node *>> shards(opt.workers);
+  for (unsigned i = 0; i < opt.nodes; i++) {
+    std::unique_ptr<Node> node(new Node());
+    node->id = nodeId(opt, i);
+    node->skewSec = skew(rng);
+    node->due = begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(phase(rng)));
+    shards[i % opt.workers].push_back(node.get());
+    fleet.push_back(std::move(node));
+  }
+
+  static const char *transportNames[] = {"http", "http-close", "ws"};
+  printf("loadgen: %u nodes, %.1f uploads/s offered, batch %u, %s, %u workers, %.0f s -> %s\n", opt.nodes,
+         opt.nodes / opt.intervalSec, opt.batch, transportNames[opt.transport], opt.workers, opt.durationSec,
+         opt.url.c_str());
+
+  std::vector<Stats> stats(opt.workers);
+  std::vector<std::thread> threads;
+  for (unsigned w = 0; w < opt.workers; w++) {
+    threads.emplace_back(runWorker, std::cref(opt), std::cref(ep), shards[w], end, std::ref(stats[w]), rng());
+  }
+  uint64_t lastSent = 0;
+  for (Clock::time_point tick = begin + std::chrono::seconds(10); tick < end; tick += std::chrono::seconds(10)) {
+    std::this_thread::sleep_until(tick);
+    const uint64_t sent = sentTotal;
+    printf("  %4.0f s  sent %llu (%.1f/s), ok %llu\n", std::chrono::duration<double>(tick - begin).count(),
+           static_cast<unsigned long long>(sent), (sent - lastSent) / 10.0,
+           static_cast<unsigned long long>(okTotal.load()));
+    fflush(stdout);
+    lastSent = sent;
+  }
+  for (std::thread &t : threads) t.join();
+  const double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+
+  Stats total;
+  for (Stats &s : stats) {
+    total.latencyUs.insert(total.latencyUs.end(), s.latencyUs.begin(), s.latencyUs.end());
+    total.lagUs.insert(total.lagUs.end(), s.lagUs.begin(), s.lagUs.end());
+    for (const auto &o : s.outcomes) total.outcomes[o.first] += o.second;
+    total.sent += s.sent;
+    total.ok += s.ok;
+    total.readings += s.readings;
+    total.bodyBytes += s.bodyBytes;
+    total.connects += s.connects;
+    total.replaysSent += s.replaysSent;
+    total.replaysRejected += s.replaysRejected;
+  }
+
+  printf("\nuploads      %llu sent, %llu ok in %.1f s: %.1f uploads/s, %.1f readings/s accepted\n",
+         static_cast<unsigned long long>(total.sent), static_cast<unsigned long long>(total.ok), elapsed,
+         total.sent / elapsed, total.readings / elapsed);
+  printf("bodies       %.0f B average, %llu connection(s) opened\n",
+         total.sent ? static_cast<double>(total.bodyBytes) / total.sent : 0.0,
+         static_cast<unsigned long long>(total.connects));
+  printDistribution("latency", total.latencyUs);
+  printDistribution("lag", total.lagUs);
+  printf("replays      %llu sent, %llu rejected by the nonce cache\n",
+         static_cast<unsigned long long>(total.replaysSent), static_cast<unsigned long long>(total.replaysRejected));
+  printf("responses\n");
+  for (const auto &o : total.outcomes) {
+    printf("  %-40s %10llu\n", o.first.c_str(), static_cast<unsigned long long>(o.second));
+  }
+  return total.outcomes.count("transport error") ? 1 : 0;
+}
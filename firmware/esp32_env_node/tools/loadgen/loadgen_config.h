@@ -0,0 +1,5 @@
+#pragma once
+
+// Stands in for include/config.h in env:loadgen. The node ids come from the
+// command line; NODE_ID is only the payload builder's default.
+#define NODE_ID "loadgen"
@@ -0,0 +1,299 @@
+#include "net.h"
+
+#include <mbedtls/base64.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <random>
+
+#include "config_defaults.h"
+
+static const uint8_t WS_OP_TEXT = 0x1;
+static const uint8_t WS_OP_BINARY = 0x2;
+static const uint8_t WS_OP_CLOSE = 0x8;
+static const uint8_t WS_OP_PING = 0x9;
+static const uint8_t WS_OP_PONG = 0xA;
+
+static void randomBytes(uint8_t *out, size_t len) {
+  static thread_local std::mt19937 rng{std::random_device{}()};
+  for (size_t i = 0; i < len; i++) out[i] = static_cast<uint8_t>(rng());
+}
+
+bool Endpoint::parse(const std::string &url) {
+  static const char scheme[] = "http://";
+  if (url.compare(0, sizeof(scheme) - 1, scheme) != 0) return false;
+  const size_t hostStart = sizeof(scheme) - 1;
+  const size_t pathStart = url.find('/', hostStart);
+  const std::string authority = url.substr(hostStart, pathStart == std::string::npos ? std::string::npos
+                                                                                      : pathStart - hostStart);
+  path = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+  const size_t colon = authority.rfind(':');
+  host = colon == std::string::npos ? authority : authority.substr(0, colon);
+  port = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+  return !host.empty() && !port.empty();
+}
+
+bool Conn::open(const Endpoint &ep, int timeoutMs) {
+  close();
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *res = nullptr;
+  if (getaddrinfo(ep.host.c_str(), ep.port.c_str(), &hints, &res) != 0) return false;
+  for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+    const int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+    timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      _fd = fd;
+      break;
+    }
+    ::close(fd);
+  }
+  freeaddrinfo(res);
+  _start = _end = 0;
+  _received = 0;
+  return _fd >= 0;
+}
+
+void Conn::close() {
+  if (_fd >= 0) ::close(_fd);
+  _fd = -1;
+  _start = _end = 0;
+}
+
+bool Conn::writeAll(const void *data, size_t len) {
+  const char *p = static_cast<const char *>(data);
+  while (len > 0) {
+    const ssize_t wrote = send(_fd, p, len, MSG_NOSIGNAL);
+    if (wrote <= 0) return false;
+    p += wrote;
+    len -= static_cast<size_t>(wrote);
+  }
+  return true;
+}
+
+bool Conn::fill() {
+  if (_fd < 0) return false;
+  const ssize_t got = recv(_fd, _buf, sizeof(_buf), 0);
+  if (got <= 0) return false;
+  _start = 0;
+  _end = static_cast<size_t>(got);
+  _received += _end;
+  return true;
+}
+
+bool Conn::readExact(void *dst, size_t len) {
+  char *out = static_cast<char *>(dst);
+  while (len > 0) {
+    if (_start == _end && !fill()) return false;
+    const size_t n = len < _end - _start ? len : _end - _start;
+    memcpy(out, _buf + _start, n);
+    _start += n;
+    out += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool Conn::readLine(std::string &line) {
+  line.clear();
+  for (;;) {
+    char c;
+    if (!readExact(&c, 1)) return false;
+    if (c == '\n') return true;
+    if (c != '\r') line.push_back(c);
+  }
+}
+
+void Conn::readToEnd(std::string &out) {
+  for (;;) {
+    out.append(_buf + _start, _end - _start);
+    _start = _end;
+    if (!fill()) return;
+  }
+}
+
+// Reads a chunked body; false on a malformed or truncated stream.
+static bool readChunked(Conn &conn, std::string &out) {
+  std::string line;
+  for (;;) {
+    if (!conn.readLine(line)) return false;
+    const size_t size = strtoul(line.c_str(), nullptr, 16);
+    if (size == 0) break;
+    const size_t at = out.size();
+    out.resize(at + size);
+    if (!conn.readExact(&out[at], size) || !conn.readLine(line)) return false;
+  }
+  // Trailers, up to the blank line.
+  while (conn.readLine(line)) {
+    if (line.empty()) return true;
+  }
+  return false;
+}
+
+int httpPost(Conn &conn, const Endpoint &ep, const char *apiKey, const char *contentType, const SignedBatch &req,
+             bool keepAlive, std::string &resp) {
+  resp.clear();
+  char head[640];
+  const int n = snprintf(head, sizeof(head),
+                         "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                         "Connection: %s\r\nX-API-Key: %s\r\nX-Node-Id: %s\r\nX-Timestamp: %s\r\n"
+                         "X-Nonce: %s\r\nX-Signature: %s\r\nX-Config-Version: 0\r\n\r\n",
+                         ep.path.c_str(), ep.host.c_str(), contentType, req.body.size(),
+                         keepAlive ? "keep-alive" : "close", apiKey, req.nodeId.c_str(), req.timestamp.c_str(),
+                         req.nonce.c_str(), req.signature.c_str());
+  if (n <= 0 || static_cast<size_t>(n) >= sizeof(head)) return NET_ERROR_IO;
+
+  conn.markRequest();
+  std::string line;
+  if (!conn.writeAll(head, n) || !conn.writeAll(req.body.data(), req.body.size()) || !conn.readLine(line)) {
+    conn.close();
+    return conn.receivedSinceMark() == 0 ? NET_ERROR_STALE : NET_ERROR_IO;
+  }
+  int status = 0;
+  if (sscanf(line.c_str(), "HTTP/1.%*d %d", &status) != 1) {
+    conn.close();
+    return NET_ERROR_IO;
+  }
+
+  long contentLength = -1;
+  bool chunked = false;
+  bool serverCloses = !keepAlive;
+  for (;;) {
+    if (!conn.readLine(line)) {
+      conn.close();
+      return NET_ERROR_IO;
+    }
+    if (line.empty()) break;
+    const char *h = line.c_str();
+    if (strncasecmp(h, "Content-Length:", 15) == 0) {
+      contentLength = strtol(h + 15, nullptr, 10);
+    } else if (strncasecmp(h, "Transfer-Encoding:", 18) == 0) {
+      chunked = strstr(h + 18, "chunked") != nullptr;
+    } else if (strncasecmp(h, "Connection:", 11) == 0) {
+      serverCloses = serverCloses || strcasestr(h + 11, "close") != nullptr;
+    }
+  }
+
+  bool ok = true;
+  if (chunked) {
+    ok = readChunked(conn, resp);
+  } else if (contentLength >= 0) {
+    resp.resize(static_cast<size_t>(contentLength));
+    ok = contentLength == 0 || conn.readExact(&resp[0], resp.size());
+  } else {
+    conn.readToEnd(resp);
+    serverCloses = true;
+  }
+  if (!ok || serverCloses) conn.close();
+  return ok ? status : NET_ERROR_IO;
+}
+
+bool wsHandshake(Conn &conn, const Endpoint &ep, const char *apiKey, const char *nodeId, const char *contentType) {
+  uint8_t keyBytes[16];
+  randomBytes(keyBytes, sizeof(keyBytes));
+  unsigned char key[25]; // 24 base64 chars + NUL
+  size_t keyLen = 0;
+  mbedtls_base64_encode(key, sizeof(key), &keyLen, keyBytes, sizeof(keyBytes));
+
+  char request[512];
+  const int n = snprintf(request, sizeof(request),
+                         "GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                         "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n"
+                         "X-API-Key: %s\r\nX-Node-Id: %s\r\nX-Content-Type: %s\r\n\r\n",
+                         UPLINK_WS_PATH, ep.host.c_str(), key, apiKey, nodeId, contentType);
+  if (n <= 0 || static_cast<size_t>(n) >= sizeof(request)) return false;
+  std::string line;
+  if (!conn.writeAll(request, n) || !conn.readLine(line)) return false;
+  // The accept hash is not checked: the point is load, not the server's
+  // handshake, which the backend tests already cover.
+  if (line.compare(0, 12, "HTTP/1.1 101") != 0) return false;
+  while (conn.readLine(line)) {
+    if (line.empty()) return true;
+  }
+  return false;
+}
+
+static bool wsWriteFrame(Conn &conn, uint8_t opcode, const std::string &head, const std::string &body) {
+  const uint64_t len = head.size() + body.size();
+  std::string frame;
+  frame.reserve(14 + len);
+  frame.push_back(static_cast<char>(0x80 | opcode));
+  if (len < 126) {
+    frame.push_back(static_cast<char>(0x80 | len));
+  } else if (len <= 0xFFFF) {
+    frame.push_back(static_cast<char>(0x80 | 126));
+    frame.push_back(static_cast<char>(len >> 8));
+    frame.push_back(static_cast<char>(len));
+  } else {
+    frame.push_back(static_cast<char>(0x80 | 127));
+    for (int shift = 56; shift >= 0; shift -= 8) frame.push_back(static_cast<char>(len >> shift));
+  }
+  uint8_t mask[4];
+  randomBytes(mask, sizeof(mask));
+  frame.append(reinterpret_cast<const char *>(mask), sizeof(mask));
+  size_t pos = 0;
+  for (const std::string *part : {&head, &body}) {
+    for (char c : *part) frame.push_back(static_cast<char>(c ^ mask[pos++ & 3]));
+  }
+  return conn.writeAll(frame.data(), frame.size());
+}
+
+int wsSend(Conn &conn, const SignedBatch &req, std::string &resp) {
+  resp.clear();
+  const std::string head = req.timestamp + " " + req.nonce + " " + req.signature + " 0\n";
+  conn.markRequest();
+  if (!wsWriteFrame(conn, WS_OP_BINARY, head, req.body)) {
+    conn.close();
+    return NET_ERROR_STALE;
+  }
+  for (;;) {
+    uint8_t hdr[2];
+    if (!conn.readExact(hdr, sizeof(hdr))) {
+      const bool stale = conn.receivedSinceMark() == 0;
+      conn.close();
+      return stale ? NET_ERROR_STALE : NET_ERROR_IO;
+    }
+    const uint8_t opcode = hdr[0] & 0x0F;
+    uint64_t len = hdr[1] & 0x7F;
+    if (len >= 126) {
+      uint8_t ext[8];
+      const size_t extLen = len == 126 ? 2 : 8;
+      if (!conn.readExact(ext, extLen)) break;
+      len = 0;
+      for (size_t i = 0; i < extLen; i++) len = (len << 8) | ext[i];
+    }
+    std::string payload(static_cast<size_t>(len), '\0');
+    if (len > 0 && !conn.readExact(&payload[0], payload.size())) break;
+
+    if (opcode == WS_OP_PING) {
+      if (!wsWriteFrame(conn, WS_OP_PONG, payload, std::string())) break;
+      continue;
+    }
+    if (opcode == WS_OP_CLOSE) break;
+    if (opcode != WS_OP_TEXT) continue;
+    // "<status> <json>"
+    const int status = atoi(payload.c_str());
+    const size_t space = payload.find(' ');
+    if (status <= 0 || space == std::string::npos) break;
+    resp = payload.substr(space + 1);
+    return status;
+  }
+  conn.close();
+  return NET_ERROR_IO;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <string>
+
+// Blocking TCP client for the load generator: HTTP/1.1 POSTs (kept alive or
+// one connection per request) and the same WebSocket framing as
+// src/ws_uplink.cpp. Plain http:// only; point it at the backend itself
+// rather than at a TLS front.
+
+struct Endpoint {
+  std::string host;
+  std::string port;
+  std::string path;
+
+  // "http://host[:port]/path"; false if the URL is not plain HTTP.
+  bool parse(const std::string &url);
+};
+
+// One upload as the firmware sends it: signature headers plus the body they
+// cover.
+struct SignedBatch {
+  std::string nodeId;
+  std::string timestamp;
+  std::string nonce;
+  std::string signature;
+  std::string body;
+};
+
+class Conn {
+ public:
+  ~Conn() { close(); }
+
+  bool open(const Endpoint &ep, int timeoutMs);
+  bool isOpen() const { return _fd >= 0; }
+  void close();
+
+  bool writeAll(const void *data, size_t len);
+  bool readExact(void *dst, size_t len);
+  // One CRLF-terminated line without the line ending.
+  bool readLine(std::string &line);
+  // Everything until the peer closes.
+  void readToEnd(std::string &out);
+  // Bytes received since the last markRequest(); tells a stale keep-alive
+  // socket (nothing came back) from a request the server did see.
+  size_t receivedSinceMark() const { return _received; }
+  void markRequest() { _received = 0; }
+
+ private:
+  bool fill();
+
+  int _fd = -1;
+  char _buf[4096];
+  size_t _start = 0;
+  size_t _end = 0;
+  size_t _received = 0;
+};
+
+// Transport failures; HTTP statuses are positive.
+static const int NET_ERROR_STALE = -1;  // reused socket died before any reply byte
+static const int NET_ERROR_IO = -2;
+
+// POSTs the batch and returns the HTTP status with the response body in
+// `resp`. With keepAlive false the connection is closed afterwards.
+int httpPost(Conn &conn, const Endpoint &ep, const char *apiKey, const char *contentType, const SignedBatch &req,
+             bool keepAlive, std::string &resp);
+
+// Upgrades an open connection to the WebSocket uplink for one node.
+bool wsHandshake(Conn &conn, const Endpoint &ep, const char *apiKey, const char *nodeId, const char *contentType);
+// Sends one binary frame "<ts> <nonce> <sig> <config version>\n<body>" and
+// waits for the "<status> <json>" reply.
+int wsSend(Conn &conn, const SignedBatch &req, std::string &resp);
@@ -57,9 +57,28 @@ function setupExport() {
   });
 }
 
+function fmtMs(us) {
+  return us == null ? "-" : (us / 1000).toFixed(1);
+}
+
+async function refreshTiming() {
+  const res = await fetch(`/api/debug/timing?t=${Date.now()}`, { cache: "no-store" });
+  if (!res.ok) return;
+  const fleet = (await res.json()).fleet || {};
+  const body = document.querySelector("#timingTable tbody");
+  const stages = Object.keys(fleet);
+  body.innerHTML = stages.length ? stages.map((s) => {
+    const t = fleet[s];
+    return `<tr><td>${s}</td><td>${t.count}</td><td>${fmtMs(t.p50_us)}</td><td>${fmtMs(t.p99_us)}</td><td>${fmtMs(t.max_us)}</td></tr>`;
+  }).join("") : `<tr><td colspan="5">No timing data yet</td></tr>`;
+}
+
 function poll() {
   const auto = document.getElementById("rawAutoRefresh").checked;
-  if (auto) refreshRaw();
+  if (auto) {
+    refreshRaw();
+    refreshTiming();
+  }
   setTimeout(poll, 3000);
 }
 
@@ -68,5 +87,6 @@ window.addEventListener("DOMContentLoaded", () => {
   document.getElementById("rawRangeSelect").addEventListener("change", refreshRaw);
   setupExport();
   refreshRaw();
+  refreshTiming();
   poll();
 });